@@ -513,3 +513,36 @@ void OPL_AdjustCallbacks(float value)
     }
 }
 
+opl_driver_t *OPL_SetDriver(opl_driver_t *new_driver)
+{
+    opl_driver_t *old_driver = driver;
+
+    driver = new_driver;
+
+    return old_driver;
+}
+
+//
+// Streaming.
+//
+
+unsigned int OPL_StreamRate(void)
+{
+    if (driver != NULL && driver->stream_rate_func != NULL)
+    {
+        return driver->stream_rate_func();
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+void OPL_SetStream(opl_stream_callback_t callback, void *data)
+{
+    if (driver != NULL && driver->set_stream_func != NULL)
+    {
+        driver->set_stream_func(callback, data);
+    }
+}
+
@@ -148,5 +148,82 @@ void OPL_Delay(uint64_t us);
 
 void OPL_SetPaused(int paused);
 
+//
+// Capture and offline rendering.
+//
+
+// A register write made while capturing, and when it was made, in
+// microseconds since the capture started.
+
+typedef struct
+{
+    uint32_t time;
+    uint16_t reg;
+    uint8_t value;
+} opl_capture_write_t;
+
+typedef struct
+{
+    opl_capture_write_t *writes;
+    unsigned int num_writes;
+    unsigned int max_writes;
+} opl_capture_t;
+
+typedef struct opl_render_s opl_render_t;
+
+// Until OPL_StopCapture, record register writes in the capture instead
+// of making them, and only invoke callbacks from OPL_CaptureStep.
+
+void OPL_StartCapture(opl_capture_t *capture);
+
+// Advance the capture to the next callback and invoke it.  Returns zero
+// if there are no callbacks left.
+
+int OPL_CaptureStep(void);
+
+// Time that the capture has reached, in microseconds.
+
+uint64_t OPL_CaptureTime(void);
+
+// Stop capturing, and go back to the driver.
+
+void OPL_StopCapture(void);
+
+// Free the writes recorded by a capture.
+
+void OPL_FreeCapture(opl_capture_t *capture);
+
+// Emulate the writes of a capture, from the start, on a chip of its
+// own.  A render does not use the driver, so it can run on any thread.
+
+opl_render_t *OPL_StartRender(const opl_capture_t *capture,
+                              unsigned int rate);
+
+// Render the next nsamples stereo samples.
+
+void OPL_Render(opl_render_t *render, int16_t *buffer, unsigned int nsamples);
+
+void OPL_FinishRender(opl_render_t *render);
+
+//
+// Streaming.
+//
+
+// Fill buffer with nsamples stereo samples.
+
+typedef void (*opl_stream_callback_t)(int16_t *buffer, unsigned int nsamples,
+                                      void *data);
+
+// Sample rate of the emulator, or zero if the driver cannot play
+// streams.
+
+unsigned int OPL_StreamRate(void);
+
+// Play samples from the callback in place of the emulator, or the
+// emulator again if callback is NULL.  The callback is invoked from the
+// audio thread, and not while paused.
+
+void OPL_SetStream(opl_stream_callback_t callback, void *data);
+
 #endif
 
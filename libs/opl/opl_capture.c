@@ -0,0 +1,328 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     OPL capture driver, and offline rendering of captures.
+//
+//     While capturing, register writes are recorded instead of being
+//     sent to a chip, and callbacks are only invoked when the caller
+//     steps through them, in virtual time.  A song can be played
+//     through in a fraction of a second this way, and the recording
+//     rendered later on another thread.
+//
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opl3.h"
+
+#include "opl.h"
+#include "opl_internal.h"
+
+#include "opl_queue.h"
+
+struct opl_render_s
+{
+    const opl_capture_t *capture;
+    unsigned int rate;
+
+    // Next write to make, and the sample it is due at.
+
+    unsigned int next_write;
+    uint64_t next_time;
+
+    // Samples rendered so far.
+
+    uint64_t time;
+
+    opl3_chip chip;
+};
+
+static opl_capture_t *capture = NULL;
+static opl_driver_t *capture_saved_driver;
+static opl_callback_queue_t *capture_queue;
+static uint64_t capture_time;
+static int capture_register_num;
+
+static int OPL_Capture_Init(unsigned int port_base)
+{
+    return 1;
+}
+
+static void OPL_Capture_Shutdown(void)
+{
+}
+
+static unsigned int OPL_Capture_PortRead(opl_port_t port)
+{
+    return 0;
+}
+
+static void RecordWrite(unsigned int reg, unsigned int value)
+{
+    opl_capture_write_t *write;
+
+    if (capture->num_writes >= capture->max_writes)
+    {
+        unsigned int max_writes;
+        opl_capture_write_t *writes;
+
+        max_writes = capture->max_writes > 0 ? capture->max_writes * 2 : 4096;
+        writes = realloc(capture->writes, max_writes * sizeof(*writes));
+
+        if (writes == NULL)
+        {
+            return;
+        }
+
+        capture->writes = writes;
+        capture->max_writes = max_writes;
+    }
+
+    write = &capture->writes[capture->num_writes];
+    write->time = (uint32_t) capture_time;
+    write->reg = reg;
+    write->value = value;
+    ++capture->num_writes;
+}
+
+static void OPL_Capture_PortWrite(opl_port_t port, unsigned int value)
+{
+    if (port == OPL_REGISTER_PORT)
+    {
+        capture_register_num = value;
+    }
+    else if (port == OPL_REGISTER_PORT_OPL3)
+    {
+        capture_register_num = value | 0x100;
+    }
+    else if (port == OPL_DATA_PORT)
+    {
+        // The timers are never rendered; see WriteRegister in opl_sdl.c.
+
+        switch (capture_register_num)
+        {
+            case OPL_REG_TIMER1:
+            case OPL_REG_TIMER2:
+            case OPL_REG_TIMER_CTRL:
+                break;
+
+            default:
+                RecordWrite(capture_register_num, value);
+                break;
+        }
+    }
+}
+
+static void OPL_Capture_SetCallback(uint64_t us, opl_callback_t callback,
+                                    void *data)
+{
+    OPL_Queue_Push(capture_queue, callback, data, capture_time + us);
+}
+
+static void OPL_Capture_ClearCallbacks(void)
+{
+    OPL_Queue_Clear(capture_queue);
+}
+
+static void OPL_Capture_Lock(void)
+{
+}
+
+static void OPL_Capture_Unlock(void)
+{
+}
+
+static void OPL_Capture_SetPaused(int paused)
+{
+}
+
+static void OPL_Capture_AdjustCallbacks(float factor)
+{
+    OPL_Queue_AdjustCallbacks(capture_queue, capture_time, factor);
+}
+
+static opl_driver_t opl_capture_driver =
+{
+    "Capture",
+    OPL_Capture_Init,
+    OPL_Capture_Shutdown,
+    OPL_Capture_PortRead,
+    OPL_Capture_PortWrite,
+    OPL_Capture_SetCallback,
+    OPL_Capture_ClearCallbacks,
+    OPL_Capture_Lock,
+    OPL_Capture_Unlock,
+    OPL_Capture_SetPaused,
+    OPL_Capture_AdjustCallbacks,
+    NULL,
+    NULL,
+};
+
+void OPL_StartCapture(opl_capture_t *_capture)
+{
+    capture = _capture;
+    capture->writes = NULL;
+    capture->num_writes = 0;
+    capture->max_writes = 0;
+
+    capture_queue = OPL_Queue_Create();
+    capture_time = 0;
+    capture_register_num = 0;
+
+    capture_saved_driver = OPL_SetDriver(&opl_capture_driver);
+}
+
+int OPL_CaptureStep(void)
+{
+    opl_callback_t callback;
+    void *callback_data;
+    uint64_t time;
+
+    if (OPL_Queue_IsEmpty(capture_queue))
+    {
+        return 0;
+    }
+
+    // Write times are 32-bit, which is over an hour.
+
+    time = OPL_Queue_Peek(capture_queue);
+
+    if (time > UINT32_MAX
+     || !OPL_Queue_Pop(capture_queue, &callback, &callback_data))
+    {
+        return 0;
+    }
+
+    if (time > capture_time)
+    {
+        capture_time = time;
+    }
+
+    callback(callback_data);
+
+    return 1;
+}
+
+uint64_t OPL_CaptureTime(void)
+{
+    return capture_time;
+}
+
+void OPL_StopCapture(void)
+{
+    OPL_SetDriver(capture_saved_driver);
+    OPL_Queue_Destroy(capture_queue);
+
+    capture_queue = NULL;
+    capture = NULL;
+}
+
+void OPL_FreeCapture(opl_capture_t *capture)
+{
+    free(capture->writes);
+
+    capture->writes = NULL;
+    capture->num_writes = 0;
+    capture->max_writes = 0;
+}
+
+//
+// Rendering.
+//
+
+static void NextWriteTime(opl_render_t *render)
+{
+    const opl_capture_t *capture = render->capture;
+
+    if (render->next_write < capture->num_writes)
+    {
+        // Rounded up, as the SDL driver invokes callbacks at the end
+        // of the sample they fall in.
+
+        render->next_time =
+            ((uint64_t) capture->writes[render->next_write].time
+              * render->rate + OPL_SECOND - 1) / OPL_SECOND;
+    }
+    else
+    {
+        render->next_time = UINT64_MAX;
+    }
+}
+
+opl_render_t *OPL_StartRender(const opl_capture_t *capture,
+                              unsigned int rate)
+{
+    opl_render_t *render;
+
+    render = malloc(sizeof(opl_render_t));
+
+    if (render == NULL)
+    {
+        return NULL;
+    }
+
+    render->capture = capture;
+    render->rate = rate;
+    render->next_write = 0;
+    render->time = 0;
+
+    OPL3_Reset(&render->chip, rate);
+    NextWriteTime(render);
+
+    return render;
+}
+
+void OPL_Render(opl_render_t *render, int16_t *buffer, unsigned int nsamples)
+{
+    const opl_capture_t *capture = render->capture;
+
+    while (nsamples > 0)
+    {
+        uint64_t count;
+
+        // Make every write that is due, then emulate up to the next.
+
+        while (render->next_time <= render->time)
+        {
+            const opl_capture_write_t *write;
+
+            write = &capture->writes[render->next_write];
+            OPL3_WriteRegBuffered(&render->chip, write->reg, write->value);
+
+            ++render->next_write;
+            NextWriteTime(render);
+        }
+
+        count = render->next_time - render->time;
+
+        if (count > nsamples)
+        {
+            count = nsamples;
+        }
+
+        OPL3_GenerateStream(&render->chip, buffer, count);
+
+        buffer += count * 2;
+        nsamples -= count;
+        render->time += count;
+    }
+}
+
+void OPL_FinishRender(opl_render_t *render)
+{
+    free(render);
+}
@@ -33,6 +33,9 @@ typedef void (*opl_lock_func)(void);
 typedef void (*opl_unlock_func)(void);
 typedef void (*opl_set_paused_func)(int paused);
 typedef void (*opl_adjust_callbacks_func)(float value);
+typedef unsigned int (*opl_stream_rate_func)(void);
+typedef void (*opl_set_stream_func)(opl_stream_callback_t callback,
+                                    void *data);
 
 typedef struct
 {
@@ -48,12 +51,21 @@ typedef struct
     opl_unlock_func unlock_func;
     opl_set_paused_func set_paused_func;
     opl_adjust_callbacks_func adjust_callbacks_func;
+
+    // Only for software emulation; NULL otherwise.
+    opl_stream_rate_func stream_rate_func;
+    opl_set_stream_func set_stream_func;
 } opl_driver_t;
 
 // Sample rate to use when doing software emulation.
 
 extern unsigned int opl_sample_rate;
 
+// Replace the driver in use, returning the previous one.  Used to
+// redirect writes and callbacks while capturing.
+
+opl_driver_t *OPL_SetDriver(opl_driver_t *new_driver);
+
 
 #if (defined(__i386__) || defined(__x86_64__)) && defined(HAVE_IOPERM)
 extern opl_driver_t opl_linux_driver;
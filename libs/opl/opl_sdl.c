@@ -26,6 +26,7 @@
 #include "SDL_mixer.h"
 #endif  // DISABLE_SDL2MIXER
 
+#include "dsp.h"
 #include "opl3.h"
 
 #include "opl.h"
@@ -60,6 +61,13 @@ static opl_callback_queue_t *callback_queue;
 
 static SDL_mutex *callback_queue_mutex = NULL;
 
+// Pre-rendered samples to play in place of the emulator, if any, and the
+// mutex held while they are read.
+
+static opl_stream_callback_t stream_callback = NULL;
+static void *stream_data;
+static SDL_mutex *stream_mutex = NULL;
+
 // Current time, in us since startup:
 
 static uint64_t current_time;
@@ -168,9 +176,27 @@ static void FillBuffer(uint8_t *buffer, unsigned int nsamples)
 
     // OPL output is generated into temporary buffer and then mixed
     // (to avoid overflows etc.)
-    OPL3_GenerateStream(&opl_chip, (Bit16s *) mix_buffer, nsamples);
-    SDL_MixAudioFormat(buffer, mix_buffer, AUDIO_S16SYS, nsamples * 4,
-                       SDL_MIX_MAXVOLUME);
+    SDL_LockMutex(stream_mutex);
+
+    if (stream_callback == NULL)
+    {
+        OPL3_GenerateStream(&opl_chip, (Bit16s *) mix_buffer, nsamples);
+    }
+    else if (!opl_sdl_paused)
+    {
+        stream_callback((int16_t *) mix_buffer, nsamples, stream_data);
+    }
+    else
+    {
+        // A paused stream is silent.
+        SDL_UnlockMutex(stream_mutex);
+        return;
+    }
+
+    SDL_UnlockMutex(stream_mutex);
+
+    dsp.mixsat16((int16_t *) buffer, (const int16_t *) mix_buffer,
+                 nsamples * 2);
 }
 
 // Callback function to fill a new sound buffer:
@@ -258,6 +284,14 @@ static void OPL_SDL_Shutdown(void)
         SDL_DestroyMutex(callback_queue_mutex);
         callback_queue_mutex = NULL;
     }
+
+    if (stream_mutex != NULL)
+    {
+        SDL_DestroyMutex(stream_mutex);
+        stream_mutex = NULL;
+    }
+
+    stream_callback = NULL;
 }
 
 static unsigned int GetSliceSize(void)
@@ -350,6 +384,7 @@ static int OPL_SDL_Init(unsigned int port_base)
 
     callback_mutex = SDL_CreateMutex();
     callback_queue_mutex = SDL_CreateMutex();
+    stream_mutex = SDL_CreateMutex();
 
     // Set postmix that adds the OPL music. This is deliberately done
     // as a postmix and not using Mix_HookMusic() as the latter disables
@@ -495,6 +530,19 @@ static void OPL_SDL_AdjustCallbacks(float factor)
     SDL_UnlockMutex(callback_queue_mutex);
 }
 
+static unsigned int OPL_SDL_StreamRate(void)
+{
+    return mixing_freq;
+}
+
+static void OPL_SDL_SetStream(opl_stream_callback_t callback, void *data)
+{
+    SDL_LockMutex(stream_mutex);
+    stream_callback = callback;
+    stream_data = data;
+    SDL_UnlockMutex(stream_mutex);
+}
+
 opl_driver_t opl_sdl_driver =
 {
     "SDL",
@@ -508,6 +556,8 @@ opl_driver_t opl_sdl_driver =
     OPL_SDL_Unlock,
     OPL_SDL_SetPaused,
     OPL_SDL_AdjustCallbacks,
+    OPL_SDL_StreamRate,
+    OPL_SDL_SetStream,
 };
 
 
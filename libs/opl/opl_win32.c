@@ -185,6 +185,8 @@ opl_driver_t opl_win32_driver =
     OPL_Timer_Unlock,
     OPL_Timer_SetPaused,
     OPL_Timer_AdjustCallbacks,
+    NULL,
+    NULL,
 };
 
 #endif /* #ifdef _WIN32 */
@@ -35,6 +35,7 @@
 #include "m_random.h"
 #include "i_system.h"
 #include "i_input.h"
+#include "i_profile.h"
 #include "i_swap.h"
 
 #include "p_setup.h"
@@ -48,6 +49,7 @@
 #include "st_stuff.h"
 #include "am_map.h"
 #include "statdump.h"
+#include "bench.h"
 
 // Needs access to LFB.
 #include "v_video.h"
@@ -248,6 +250,7 @@ mobj_t *bodyque[BODYQUESIZE];
 int bodyqueslot;
 
 int vanilla_savegame_limit = 1;
+int async_savegames = 0;
 int vanilla_demo_limit = 1;
 
 //
@@ -919,7 +922,9 @@ bool G_Responder(event_t *ev) {
 static void G_RunTickers() {
     switch (gamestate) {
         case GS_LEVEL:
+            BenchBeginPhase(bench_ticker);
             P_Ticker();
+            BenchEndPhase(bench_ticker);
             ST_Ticker();
             AM_Ticker();
             HU_Ticker();
@@ -1095,6 +1100,8 @@ static void G_RebornPlayers() {
 // Make ticcmd_ts for the players.
 //
 void G_Ticker() {
+    PROFILE_BEGIN("G_Ticker");
+    P_UpdateSaveGameWrite();
     G_RebornPlayers();
     G_RunGameActions();
     G_UpdateNetConsistency();
@@ -1104,6 +1111,7 @@ void G_Ticker() {
     }
     G_UpdateOldGameState();
     G_RunTickers();
+    PROFILE_END("G_Ticker");
 } 
  
  
@@ -1599,6 +1607,7 @@ static void G_FinishLevel() {
 void G_DoCompleted(void) {
     gameaction = ga_nothing;
     G_FinishLevel();
+    R_ReportLimits();
     if (automapactive) {
         AM_Stop();
     }
@@ -1666,16 +1675,16 @@ void G_DoLoadGame(void) {
     int savedleveltime;
 	 
     gameaction = ga_nothing;
-    save_stream = M_fopen(savename, "rb");
 
-    if (save_stream == NULL) {
+    // The savegame being loaded may still be being written.
+    P_WaitSaveGameWrite();
+
+    if (!P_OpenSaveGameRead(savename)) {
         I_Error("Could not load savegame %s", savename);
     }
 
-    savegame_error = false;
-
     if (!P_ReadSaveGameHeader()) {
-        fclose(save_stream);
+        P_CloseSaveGame();
         return;
     }
 
@@ -1696,7 +1705,7 @@ void G_DoLoadGame(void) {
         I_Error("Bad savegame");
     }
 
-    fclose(save_stream);
+    P_CloseSaveGame();
 
     if (setsizeneeded) {
         R_ExecuteSetViewSize ();
@@ -1718,33 +1727,40 @@ void G_SaveGame(int slot, char* description) {
     sendsave = true;
 }
 
-void G_DoSaveGame() {
-    char* savegame_file;
-    char* temp_savegame_file;
-    char* recovery_savegame_file;
-
-    recovery_savegame_file = NULL;
-    temp_savegame_file = P_TempSaveGameFile();
-    savegame_file = P_SaveGameFile(savegameslot);
-
-    // Open the savegame file for writing.  We write to a temporary file
-    // and then rename it at the end if it was successfully written.
-    // This prevents an existing savegame from being overwritten by
-    // a corrupted one, or if a savegame buffer overrun occurs.
-    save_stream = M_fopen(temp_savegame_file, "wb");
-
-    if (save_stream == NULL) {
+//
+// Called once the savegame is on disk, or has failed to be written.
+//
+static void G_SaveGameWritten(const char* savegame_file, bool succeeded) {
+    if (!succeeded) {
         // Failed to save the game, so we're going to have to abort. But
         // to be nice, save to somewhere else before we call I_Error().
-        recovery_savegame_file = M_TempFile("recovery.dsg");
-        save_stream = M_fopen(recovery_savegame_file, "wb");
-        if (save_stream == NULL) {
+        char* temp_savegame_file = P_TempSaveGameFile();
+        char* recovery_savegame_file = M_TempFile("recovery.dsg");
+        if (!P_WriteSaveGameRecovery(recovery_savegame_file)) {
             I_Error("Failed to open either '%s' or '%s' to write savegame.",
                     temp_savegame_file, recovery_savegame_file);
         }
+        I_Error("Failed to write savegame file '%s'.\n"
+                "But your game has been saved to '%s' for recovery.",
+                savegame_file, recovery_savegame_file);
     }
 
-    savegame_error = false;
+    players[consoleplayer].message = DEH_String(GGSAVED);
+}
+
+void G_DoSaveGame() {
+    char* savegame_file;
+    char* temp_savegame_file;
+
+    // Only one savegame is written at a time.
+    P_WaitSaveGameWrite();
+
+    temp_savegame_file = P_TempSaveGameFile();
+    savegame_file = P_SaveGameFile(savegameslot);
+
+    // Serialize the game into memory. Nothing touches the disk until the
+    // whole savegame has been built.
+    P_OpenSaveGameWrite();
 
     P_WriteSaveGameHeader(savedescription);
 
@@ -1758,33 +1774,26 @@ void G_DoSaveGame() {
     // Enforce the same savegame size limit as in Vanilla Doom,
     // except if the vanilla_savegame_limit setting is turned off.
 
-    if (vanilla_savegame_limit && ftell(save_stream) > SAVEGAMESIZE) {
+    if (vanilla_savegame_limit && P_SaveGameLength() > SAVEGAMESIZE) {
         I_Error("Savegame buffer overrun");
     }
 
-    // Finish up, close the savegame file.
-    fclose(save_stream);
+    // The savegame is written to a temporary file with a single write,
+    // which is then renamed over the actual savegame file. This prevents
+    // an existing savegame from being overwritten by a corrupted one.
 
-    if (recovery_savegame_file != NULL) {
-        // We failed to save to the normal location, but we wrote a
-        // recovery file to the temp directory. Now we can bomb out
-        // with an error.
-        I_Error("Failed to open savegame file '%s' for writing.\n"
-                "But your game has been saved to '%s' for recovery.",
-                temp_savegame_file, recovery_savegame_file);
+    if (async_savegames) {
+        // The tic never waits for the disk; "game saved" is shown once
+        // the savegame is durable.
+        P_WriteSaveGameInBackground(temp_savegame_file, savegame_file, G_SaveGameWritten);
+    } else {
+        G_SaveGameWritten(savegame_file, P_WriteSaveGameFile(temp_savegame_file, savegame_file));
+        P_CloseSaveGame();
     }
 
-    // Now rename the temporary savegame file to the actual savegame
-    // file, overwriting the old savegame if there was one there.
-
-    M_remove(savegame_file);
-    M_rename(temp_savegame_file, savegame_file);
-
     gameaction = ga_nothing;
     M_StringCopy(savedescription, "", sizeof(savedescription));
 
-    players[consoleplayer].message = DEH_String(GGSAVED);
-
     // draw the pattern into the back screen
     R_FillBackScreen();
 }
@@ -2261,11 +2270,9 @@ void G_DoPlayDemo (void)
 	netdemo = true;
     }
 
-    // don't spend a lot of time in loadlevel 
-    precache = false;
     G_InitNew (skill, episode, map); 
-    precache = true; 
     starttime = I_GetTime (); 
+    BenchStart();
 
     usergame = false; 
     demoplayback = true; 
@@ -2285,6 +2292,8 @@ void G_TimeDemo (char* name)
 
     nodrawers = M_CheckParm ("-nodraw");
 
+    BenchInit();
+
     timingdemo = true; 
     singletics = true; 
 
@@ -2320,6 +2329,14 @@ bool G_CheckDemoStatus (void)
         timingdemo = false;
         demoplayback = false;
 
+        if (benchmarking)
+        {
+            printf ("timed %i gametics in %i realtics (%f fps)\n",
+                    gametic, realtics, fps);
+            BenchDump (defdemoname, gametic);
+            I_Quit ();
+        }
+
 	I_Error ("timed %i gametics in %i realtics (%f fps)",
                  gametic, realtics, fps);
     } 
@@ -77,6 +77,7 @@ void G_ScreenShot();
 int G_VanillaVersionCode();
 
 extern int vanilla_savegame_limit;
+extern int async_savegames;
 extern int vanilla_demo_limit;
 
 extern fixed_t forwardmove[2];
@@ -0,0 +1,89 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Running independent jobs on several threads. The threads only live
+//	for one I_ParallelFor call; it is meant for level loading and
+//	startup, where that cost does not matter.
+//
+
+
+#include <SDL.h>
+
+#include "i_parallel.h"
+
+
+#define MAXPARALLELTHREADS 32
+
+
+typedef struct {
+    paralleljob_t job;
+    void* data;
+    int count;
+    SDL_atomic_t next;
+} parallelfor_t;
+
+
+static void I_RunParallelJobs(parallelfor_t* work) {
+    while (true) {
+        int index = SDL_AtomicAdd(&work->next, 1);
+        if (index >= work->count) {
+            break;
+        }
+        work->job(work->data, index);
+    }
+}
+
+static int I_ParallelWorker(void* data) {
+    I_RunParallelJobs(data);
+    return 0;
+}
+
+void I_ParallelFor(int count, int numthreads, paralleljob_t job, void* data) {
+    parallelfor_t work = {
+        .job = job,
+        .data = data,
+        .count = count,
+    };
+    SDL_AtomicSet(&work.next, 0);
+
+    if (numthreads > count) {
+        numthreads = count;
+    }
+    if (numthreads > MAXPARALLELTHREADS) {
+        numthreads = MAXPARALLELTHREADS;
+    }
+
+    // If a thread can not be created the others just do more of the work.
+    SDL_Thread* threads[MAXPARALLELTHREADS];
+    int numstarted = 0;
+    for (int i = 1; i < numthreads; i++) {
+        SDL_Thread* thread = SDL_CreateThread(I_ParallelWorker, "I_ParallelWorker", &work);
+        if (thread == NULL) {
+            break;
+        }
+        threads[numstarted++] = thread;
+    }
+
+    I_RunParallelJobs(&work);
+
+    for (int i = 0; i < numstarted; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+}
+
+int I_GetCPUCount(void) {
+    int count = SDL_GetCPUCount();
+    return count > 0 ? count : 1;
+}
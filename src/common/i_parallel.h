@@ -0,0 +1,36 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Running independent jobs on several threads.
+//
+
+
+#ifndef __I_PARALLEL__
+#define __I_PARALLEL__
+
+
+typedef void (*paralleljob_t)(void* data, int index);
+
+// Calls job(data, i) for every i in [0, count) and returns once all of
+// them have finished. The calls are shared out over at most numthreads
+// threads, the calling one included, so the job must not touch the zone
+// or anything else that is not thread safe.
+void I_ParallelFor(int count, int numthreads, paralleljob_t job, void* data);
+
+// Number of logical CPUs, at least 1.
+int I_GetCPUCount(void);
+
+
+#endif
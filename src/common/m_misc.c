@@ -924,3 +924,40 @@ int M_snprintf(char *buf, size_t buf_len, const char *s, ...)
     va_end(args);
     return result;
 }
+
+// Standard (zlib/PNG) CRC-32 of a buffer.
+uint32_t M_CRC32(const void *data, size_t length)
+{
+    static uint32_t table[256];
+    static bool table_ready = false;
+    const byte *p = data;
+    uint32_t crc;
+    size_t i;
+
+    if (!table_ready)
+    {
+        for (i = 0; i < 256; ++i)
+        {
+            uint32_t c = (uint32_t) i;
+            int k;
+
+            for (k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+            }
+
+            table[i] = c;
+        }
+
+        table_ready = true;
+    }
+
+    crc = 0xffffffff;
+
+    for (i = 0; i < length; ++i)
+    {
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
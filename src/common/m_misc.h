@@ -61,6 +61,7 @@ bool M_StringStartsWith(const char *s, const char *prefix);
 bool M_StringEndsWith(const char *s, const char *suffix);
 int M_vsnprintf(char *buf, size_t buf_len, const char *s, va_list args);
 int M_snprintf(char *buf, size_t buf_len, const char *s, ...) PRINTF_ATTR(3, 4);
+uint32_t M_CRC32(const void *data, size_t length);
 
 
 // debugging code to check there are no loops in a linked list
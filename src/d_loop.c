@@ -24,6 +24,7 @@
 #include "d_ticcmd.h"
 
 #include "i_system.h"
+#include "i_profile.h"
 #include "i_timer.h"
 #include "i_video.h"
 
@@ -673,6 +674,8 @@ static int CountNumTics(int realtics) {
 void TryRunTics(void) {
     static int oldentertics;
 
+    PROFILE_BEGIN("TryRunTics");
+
     // Get real tics.
     int entertic = I_GetTime() / ticdup;
     int realtics = entertic - oldentertics;
@@ -688,6 +691,7 @@ void TryRunTics(void) {
     int counts = CountNumTics(realtics);
     WaitForNewTics(entertic, counts);
     RunGameSimulation(counts);
+    PROFILE_END("TryRunTics");
 }
 
 void D_RegisterLoopCallbacks(loop_interface_t *i)
@@ -56,6 +56,7 @@
 
 #include "i_endoom.h"
 #include "i_input.h"
+#include "i_profile.h"
 #include "i_joystick.h"
 #include "i_system.h"
 #include "i_video.h"
@@ -72,6 +73,7 @@
 
 #include "p_setup.h"
 #include "r_local.h"
+#include "bench.h"
 #include "statdump.h"
 
 #include "d_main.h"
@@ -230,13 +232,17 @@ static bool D_Display() {
                 // Just put away the help screen.
                 redrawsbar = true;
             }
+            BenchBeginPhase(bench_hud);
             ST_Drawer(viewheight == SCREENHEIGHT, redrawsbar);
+            BenchEndPhase(bench_hud);
             fullscreen = viewheight == SCREENHEIGHT;
             // Draw the view directly.
             if (!automapactive) {
                 R_RenderPlayerView(&players[displayplayer]);
             }
+            BenchBeginPhase(bench_hud);
             HU_Drawer();
+            BenchEndPhase(bench_hud);
 
             break;
 
@@ -374,6 +380,7 @@ void D_BindVariables(void)
     M_BindIntVariable("snd_channels",           &snd_channels);
     M_BindIntVariable("vanilla_savegame_limit", &vanilla_savegame_limit);
     M_BindIntVariable("vanilla_demo_limit",     &vanilla_demo_limit);
+    M_BindIntVariable("async_savegames",        &async_savegames);
     M_BindIntVariable("show_endoom",            &show_endoom);
     M_BindIntVariable("show_diskicon",          &show_diskicon);
 
@@ -412,6 +419,59 @@ bool D_GrabMouseCallback(void)
     return (gamestate == GS_LEVEL) && !demoplayback && !advancedemo;
 }
 
+static void D_InitProfile() {
+    //!
+    // @category obscure
+    // @arg <filename>
+    //
+    // Write the time spent in the main loop, playsim, renderer, sound,
+    // network and lump loading code to the specified file, in the Chrome
+    // trace_event format. Only available in builds configured with
+    // -DBROOM_PROFILE=ON.
+    //
+    int p = M_CheckParmWithArgs("-profile", 1);
+    if (p == 0) {
+        return;
+    }
+#ifdef BROOM_PROFILE
+    I_StartProfile(myargv[p + 1]);
+    I_AtExit(I_StopProfile, true);
+#else
+    fprintf(stderr, "D_InitProfile: -profile needs a build with BROOM_PROFILE\n");
+#endif
+}
+
+// File receiving the per-frame screen CRCs, see -framecrc.
+static FILE* framecrcfile = NULL;
+
+static void D_InitFrameCRC() {
+    //!
+    // @category video
+    // @arg <filename>
+    //
+    // Write a CRC-32 of the screen buffer to the specified file for every
+    // frame drawn, one line per frame. Used to check that the different
+    // drawers (see -refdrawers and -nosimd) give identical output.
+    //
+    int p = M_CheckParmWithArgs("-framecrc", 1);
+    if (p == 0) {
+        return;
+    }
+    framecrcfile = M_fopen(myargv[p + 1], "w");
+    if (framecrcfile == NULL) {
+        I_Error("D_InitFrameCRC: Failed to open %s", myargv[p + 1]);
+    }
+}
+
+static void D_WriteFrameCRC() {
+    if (framecrcfile == NULL) {
+        return;
+    }
+    size_t size = SCREENWIDTH * SCREENHEIGHT * sizeof(*I_VideoBuffer);
+    uint32_t crc = M_CRC32(I_VideoBuffer, size);
+    fprintf(framecrcfile, "%d %08x\n", gametic, crc);
+}
+
 // Variables used for doing screen melt effect
 static int wipestart = 0;
 static bool wipe = false;
@@ -448,6 +508,7 @@ static void D_UpdateDisplay() {
     }
 
     wipe = D_Display();
+    D_WriteFrameCRC();
     if (wipe) {
         // start wipe on this frame
         D_StartWipe();
@@ -456,22 +517,29 @@ static void D_UpdateDisplay() {
 
     // normal update
     // page flip or blit buffer
+    BenchBeginPhase(bench_blit);
     I_FinishUpdate();
+    BenchEndPhase(bench_blit);
 }
 
 //
 //  D_RunFrame
 //
 static void D_RunFrame() {
+    PROFILE_BEGIN("D_RunFrame");
     if (wipe) {
         D_DoWipe();
+        PROFILE_END("D_RunFrame");
         return;
     }
+    BenchBeginFrame();
     // Will run at least one tic.
     TryRunTics();
     // Move positional sounds.
     S_UpdateSounds(players[consoleplayer].mo);
     D_UpdateDisplay();
+    BenchEndFrame();
+    PROFILE_END("D_RunFrame");
 }
 
 static void D_CheckIncompatibleIwad() {
@@ -503,6 +571,7 @@ void D_DoomLoop() {
     I_SetGrabMouseCallback(D_GrabMouseCallback);
     I_InitGraphics();
     EnableLoadingDisk();
+    D_InitFrameCRC();
 
     TryRunTics();
 
@@ -1164,13 +1233,14 @@ void PrintGameVersion(void)
 
 //
 // Don't show ENDOOM if we have it disabled, or we're running
-// in screensaver or control test mode. Only show it once the
-// game has actually started.
+// in screensaver, headless or control test mode. Only show it once
+// the game has actually started.
 //
 static bool D_CanShowEndoom() {
     return show_endoom
            && main_loop_started
            && !screensaver_mode
+           && !headless
            && M_CheckParm("-testcontrols") == 0;
 }
 
@@ -1301,6 +1371,8 @@ void D_DoomMain() {
     // print banner
     I_PrintBanner(PACKAGE_STRING);
 
+    D_InitProfile();
+
     DEH_printf("Z_Init: Init zone memory allocation daemon. \n");
     Z_Init ();
 
@@ -0,0 +1,546 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Audio sample kernels. The scalar functions are the reference; the
+//     vector versions process 8 or 16 samples per step and finish the
+//     remainder with the scalar code, so every implementation gives the
+//     same output.
+//
+
+
+#include <stdint.h>
+#include <string.h>
+#include <SDL_cpuinfo.h>
+
+#include "dsp.h"
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_DSP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define HAVE_DSP_AVX2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+
+// Bits of fraction used by the linear resampler, so that both weights
+// fit in a signed 16-bit value.
+#define LERP_BITS 14
+#define LERP_ONE (1 << LERP_BITS)
+
+
+//
+// Scalar reference kernels.
+//
+
+static void ExpandU8Scalar(int16_t* out, const uint8_t* in, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = (int16_t) (in[i] * 257 - 32768);
+    }
+}
+
+static inline int16_t Lerp(const int16_t* in, uint32_t pos) {
+    const int16_t* s = &in[pos >> 16];
+    int f = (pos & 0xffff) >> (16 - LERP_BITS);
+    return (int16_t) ((s[0] * (LERP_ONE - f) + s[1] * f) >> LERP_BITS);
+}
+
+static void ResampleLinearScalar(int16_t* out, const int16_t* in,
+                                 uint32_t frac, uint32_t step, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = Lerp(in, frac);
+        frac += step;
+    }
+}
+
+static void ResampleZOHScalar(int16_t* out, const int16_t* in, uint32_t frac,
+                              uint32_t step, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = in[frac >> 16];
+        frac += step;
+    }
+}
+
+static void MixPanScalar(int32_t* mix, const int16_t* in, int count,
+                         int left, int right) {
+    for (int i = 0; i < count; i++) {
+        mix[i * 2] += (in[i] * left) >> 8;
+        mix[i * 2 + 1] += (in[i] * right) >> 8;
+    }
+}
+
+static inline int16_t Saturate(int32_t value) {
+    value = value < INT16_MIN ? INT16_MIN : value;
+    value = value > INT16_MAX ? INT16_MAX : value;
+    return (int16_t) value;
+}
+
+static void MixSat32Scalar(int16_t* out, const int32_t* mix, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = Saturate(out[i] + mix[i]);
+    }
+}
+
+static void MixSat16Scalar(int16_t* out, const int16_t* in, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = Saturate(out[i] + in[i]);
+    }
+}
+
+static const dspfuncs_t dsp_scalar_funcs = {
+    "scalar",
+    ExpandU8Scalar,
+    ResampleLinearScalar,
+    ResampleZOHScalar,
+    MixPanScalar,
+    MixSat32Scalar,
+    MixSat16Scalar,
+};
+
+// Both samples of a linear interpolation, as one 32-bit value.
+static inline int32_t LoadPair(const int16_t* in, uint32_t pos) {
+    int32_t pair;
+    memcpy(&pair, &in[pos >> 16], sizeof(pair));
+    return pair;
+}
+
+// The weights of both samples, packed the same way as LoadPair.
+static inline uint32_t PairWeights(uint32_t pos) {
+    uint32_t f = (pos & 0xffff) >> (16 - LERP_BITS);
+    return (LERP_ONE - f) | (f << 16);
+}
+
+
+#ifdef HAVE_DSP_SSE2
+
+static void ExpandU8SSE2(int16_t* out, const uint8_t* in, int count) {
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    int i = 0;
+
+    // x * 257 - 32768 is the byte repeated in both halves, sign flipped.
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+        __m128i lo = _mm_xor_si128(_mm_unpacklo_epi8(x, x), bias);
+        __m128i hi = _mm_xor_si128(_mm_unpackhi_epi8(x, x), bias);
+        _mm_storeu_si128((__m128i*) &out[i], lo);
+        _mm_storeu_si128((__m128i*) &out[i + 8], hi);
+    }
+
+    ExpandU8Scalar(out + i, in + i, count - i);
+}
+
+// Linear interpolation of 4 samples: the sample pairs are loaded one at a
+// time, weighted and summed with a single multiply-add.
+static inline __m128i Lerp4SSE2(const int16_t* in, uint32_t pos,
+                                uint32_t step) {
+    uint32_t p1 = pos + step, p2 = p1 + step, p3 = p2 + step;
+    __m128i pairs = _mm_set_epi32(LoadPair(in, p3), LoadPair(in, p2),
+                                  LoadPair(in, p1), LoadPair(in, pos));
+    __m128i weights = _mm_set_epi32(PairWeights(p3), PairWeights(p2),
+                                    PairWeights(p1), PairWeights(pos));
+    return _mm_srai_epi32(_mm_madd_epi16(pairs, weights), LERP_BITS);
+}
+
+static void ResampleLinearSSE2(int16_t* out, const int16_t* in,
+                               uint32_t frac, uint32_t step, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i lo = Lerp4SSE2(in, frac, step);
+        __m128i hi = Lerp4SSE2(in, frac + step * 4, step);
+        _mm_storeu_si128((__m128i*) &out[i], _mm_packs_epi32(lo, hi));
+        frac += step * 8;
+    }
+
+    ResampleLinearScalar(out + i, in, frac, step, count - i);
+}
+
+static void ResampleZOHSSE2(int16_t* out, const int16_t* in, uint32_t frac,
+                            uint32_t step, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        uint32_t p[8];
+        for (int j = 0; j < 8; j++) {
+            p[j] = (frac + step * j) >> 16;
+        }
+        __m128i x = _mm_set_epi16(in[p[7]], in[p[6]], in[p[5]], in[p[4]],
+                                  in[p[3]], in[p[2]], in[p[1]], in[p[0]]);
+        _mm_storeu_si128((__m128i*) &out[i], x);
+        frac += step * 8;
+    }
+
+    ResampleZOHScalar(out + i, in, frac, step, count - i);
+}
+
+// Product of 8 samples, each repeated for left and right, with the
+// left/right volume pairs.
+static inline void MixPan4SSE2(int32_t* mix, __m128i samples, __m128i volume) {
+    __m128i lo = _mm_mullo_epi16(samples, volume);
+    __m128i hi = _mm_mulhi_epi16(samples, volume);
+    __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8);
+    __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8);
+    __m128i* m = (__m128i*) mix;
+    _mm_storeu_si128(m, _mm_add_epi32(_mm_loadu_si128(m), a));
+    _mm_storeu_si128(m + 1, _mm_add_epi32(_mm_loadu_si128(m + 1), b));
+}
+
+static void MixPanSSE2(int32_t* mix, const int16_t* in, int count, int left,
+                       int right) {
+    const __m128i volume = _mm_set1_epi32(left | (right << 16));
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+        MixPan4SSE2(mix + i * 2, _mm_unpacklo_epi16(x, x), volume);
+        MixPan4SSE2(mix + i * 2 + 8, _mm_unpackhi_epi16(x, x), volume);
+    }
+
+    MixPanScalar(mix + i * 2, in + i, count - i, left, right);
+}
+
+static void MixSat32SSE2(int16_t* out, const int32_t* mix, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &out[i]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        lo = _mm_add_epi32(lo, _mm_loadu_si128((const __m128i*) &mix[i]));
+        hi = _mm_add_epi32(hi, _mm_loadu_si128((const __m128i*) &mix[i + 4]));
+        _mm_storeu_si128((__m128i*) &out[i], _mm_packs_epi32(lo, hi));
+    }
+
+    MixSat32Scalar(out + i, mix + i, count - i);
+}
+
+static void MixSat16SSE2(int16_t* out, const int16_t* in, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &out[i]);
+        __m128i y = _mm_loadu_si128((const __m128i*) &in[i]);
+        _mm_storeu_si128((__m128i*) &out[i], _mm_adds_epi16(x, y));
+    }
+
+    MixSat16Scalar(out + i, in + i, count - i);
+}
+
+static const dspfuncs_t dsp_sse2_funcs = {
+    "SSE2",
+    ExpandU8SSE2,
+    ResampleLinearSSE2,
+    ResampleZOHSSE2,
+    MixPanSSE2,
+    MixSat32SSE2,
+    MixSat16SSE2,
+};
+
+#endif // HAVE_DSP_SSE2
+
+
+#ifdef HAVE_DSP_AVX2
+
+TARGET_AVX2
+static void ExpandU8AVX2(int16_t* out, const uint8_t* in, int count) {
+    const __m256i bias = _mm256_set1_epi16((short) 0x8000);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_cvtepu8_epi16(
+            _mm_loadu_si128((const __m128i*) &in[i]));
+        x = _mm256_or_si256(x, _mm256_slli_epi16(x, 8));
+        _mm256_storeu_si256((__m256i*) &out[i], _mm256_xor_si256(x, bias));
+    }
+
+    ExpandU8Scalar(out + i, in + i, count - i);
+}
+
+// Linear interpolation of 8 samples. A dword gather at 2-byte scale loads
+// each sample together with the one after it.
+TARGET_AVX2
+static inline __m256i Lerp8AVX2(const int16_t* in, __m256i pos) {
+    __m256i index = _mm256_srli_epi32(pos, 16);
+    __m256i pairs = _mm256_i32gather_epi32((const int*) in, index, 2);
+    __m256i f = _mm256_srli_epi32(_mm256_and_si256(pos,
+                                                   _mm256_set1_epi32(0xffff)),
+                                  16 - LERP_BITS);
+    __m256i weights = _mm256_or_si256(
+        _mm256_sub_epi32(_mm256_set1_epi32(LERP_ONE), f),
+        _mm256_slli_epi32(f, 16));
+    return _mm256_srai_epi32(_mm256_madd_epi16(pairs, weights), LERP_BITS);
+}
+
+TARGET_AVX2
+static void ResampleLinearAVX2(int16_t* out, const int16_t* in,
+                               uint32_t frac, uint32_t step, int count) {
+    const __m256i step8 = _mm256_set1_epi32((int) (step * 8));
+    __m256i pos = _mm256_add_epi32(
+        _mm256_set1_epi32((int) frac),
+        _mm256_mullo_epi32(_mm256_set1_epi32((int) step),
+                           _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = Lerp8AVX2(in, pos);
+        pos = _mm256_add_epi32(pos, step8);
+        __m256i hi = Lerp8AVX2(in, pos);
+        pos = _mm256_add_epi32(pos, step8);
+
+        // packs works within each 128-bit lane; put the quarters back in
+        // order.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                                  0xd8);
+        _mm256_storeu_si256((__m256i*) &out[i], packed);
+        frac += step * 16;
+    }
+
+    ResampleLinearScalar(out + i, in, frac, step, count - i);
+}
+
+TARGET_AVX2
+static void MixPanAVX2(int32_t* mix, const int16_t* in, int count, int left,
+                       int right) {
+    const __m256i volume = _mm256_setr_epi32(left, right, left, right,
+                                             left, right, left, right);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+        __m256i a = _mm256_cvtepi16_epi32(_mm_unpacklo_epi16(x, x));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_unpackhi_epi16(x, x));
+        __m256i* m = (__m256i*) (mix + i * 2);
+        a = _mm256_srai_epi32(_mm256_mullo_epi32(a, volume), 8);
+        b = _mm256_srai_epi32(_mm256_mullo_epi32(b, volume), 8);
+        _mm256_storeu_si256(m, _mm256_add_epi32(_mm256_loadu_si256(m), a));
+        _mm256_storeu_si256(m + 1,
+                            _mm256_add_epi32(_mm256_loadu_si256(m + 1), b));
+    }
+
+    MixPanScalar(mix + i * 2, in + i, count - i, left, right);
+}
+
+TARGET_AVX2
+static void MixSat32AVX2(int16_t* out, const int32_t* mix, int count) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*) &out[i]));
+        __m256i hi = _mm256_cvtepi16_epi32(
+            _mm_loadu_si128((const __m128i*) &out[i + 8]));
+        lo = _mm256_add_epi32(lo, _mm256_loadu_si256((const __m256i*) &mix[i]));
+        hi = _mm256_add_epi32(hi,
+                              _mm256_loadu_si256((const __m256i*) &mix[i + 8]));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                                  0xd8);
+        _mm256_storeu_si256((__m256i*) &out[i], packed);
+    }
+
+    MixSat32Scalar(out + i, mix + i, count - i);
+}
+
+TARGET_AVX2
+static void MixSat16AVX2(int16_t* out, const int16_t* in, int count) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) &out[i]);
+        __m256i y = _mm256_loadu_si256((const __m256i*) &in[i]);
+        _mm256_storeu_si256((__m256i*) &out[i], _mm256_adds_epi16(x, y));
+    }
+
+    MixSat16Scalar(out + i, in + i, count - i);
+}
+
+// A gather does not help zero order hold: a dword gather would read one
+// sample past the last position.
+static const dspfuncs_t dsp_avx2_funcs = {
+    "AVX2",
+    ExpandU8AVX2,
+    ResampleLinearAVX2,
+#ifdef HAVE_DSP_SSE2
+    ResampleZOHSSE2,
+#else
+    ResampleZOHScalar,
+#endif
+    MixPanAVX2,
+    MixSat32AVX2,
+    MixSat16AVX2,
+};
+
+#endif // HAVE_DSP_AVX2
+
+
+#ifdef HAVE_DSP_NEON
+
+static void ExpandU8NEON(int16_t* out, const uint8_t* in, int count) {
+    const uint16x8_t bias = vdupq_n_u16(0x8000);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t x = vld1q_u8(&in[i]);
+        uint8x16x2_t z = vzipq_u8(x, x);
+        uint16x8_t lo = veorq_u16(vreinterpretq_u16_u8(z.val[0]), bias);
+        uint16x8_t hi = veorq_u16(vreinterpretq_u16_u8(z.val[1]), bias);
+        vst1q_s16(&out[i], vreinterpretq_s16_u16(lo));
+        vst1q_s16(&out[i + 8], vreinterpretq_s16_u16(hi));
+    }
+
+    ExpandU8Scalar(out + i, in + i, count - i);
+}
+
+static void ResampleLinearNEON(int16_t* out, const int16_t* in,
+                               uint32_t frac, uint32_t step, int count) {
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        int16_t s0[4], s1[4], w0[4], w1[4];
+        for (int j = 0; j < 4; j++) {
+            const int16_t* s = &in[frac >> 16];
+            int f = (frac & 0xffff) >> (16 - LERP_BITS);
+            s0[j] = s[0];
+            s1[j] = s[1];
+            w0[j] = (int16_t) (LERP_ONE - f);
+            w1[j] = (int16_t) f;
+            frac += step;
+        }
+        int32x4_t sum = vmull_s16(vld1_s16(s0), vld1_s16(w0));
+        sum = vmlal_s16(sum, vld1_s16(s1), vld1_s16(w1));
+        vst1_s16(&out[i], vmovn_s32(vshrq_n_s32(sum, LERP_BITS)));
+    }
+
+    ResampleLinearScalar(out + i, in, frac, step, count - i);
+}
+
+static void MixPanNEON(int32_t* mix, const int16_t* in, int count, int left,
+                       int right) {
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        int16x4_t x = vld1_s16(&in[i]);
+        int32x4x2_t m = vld2q_s32(&mix[i * 2]);
+        m.val[0] = vaddq_s32(m.val[0],
+                             vshrq_n_s32(vmull_n_s16(x, (int16_t) left), 8));
+        m.val[1] = vaddq_s32(m.val[1],
+                             vshrq_n_s32(vmull_n_s16(x, (int16_t) right), 8));
+        vst2q_s32(&mix[i * 2], m);
+    }
+
+    MixPanScalar(mix + i * 2, in + i, count - i, left, right);
+}
+
+static void MixSat32NEON(int16_t* out, const int32_t* mix, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t x = vld1q_s16(&out[i]);
+        int32x4_t lo = vaddq_s32(vmovl_s16(vget_low_s16(x)),
+                                 vld1q_s32(&mix[i]));
+        int32x4_t hi = vaddq_s32(vmovl_s16(vget_high_s16(x)),
+                                 vld1q_s32(&mix[i + 4]));
+        vst1q_s16(&out[i], vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+
+    MixSat32Scalar(out + i, mix + i, count - i);
+}
+
+static void MixSat16NEON(int16_t* out, const int16_t* in, int count) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        vst1q_s16(&out[i], vqaddq_s16(vld1q_s16(&out[i]), vld1q_s16(&in[i])));
+    }
+
+    MixSat16Scalar(out + i, in + i, count - i);
+}
+
+static const dspfuncs_t dsp_neon_funcs = {
+    "NEON",
+    ExpandU8NEON,
+    ResampleLinearNEON,
+    ResampleZOHScalar,
+    MixPanNEON,
+    MixSat32NEON,
+    MixSat16NEON,
+};
+
+#endif // HAVE_DSP_NEON
+
+
+dspfuncs_t dsp = {
+    "scalar",
+    ExpandU8Scalar,
+    ResampleLinearScalar,
+    ResampleZOHScalar,
+    MixPanScalar,
+    MixSat32Scalar,
+    MixSat16Scalar,
+};
+
+
+const dspfuncs_t* DSP_GetFuncs(dspimpl_t impl) {
+    switch (impl) {
+        case dsp_scalar:
+            return &dsp_scalar_funcs;
+
+#ifdef HAVE_DSP_SSE2
+        case dsp_sse2:
+            return SDL_HasSSE2() ? &dsp_sse2_funcs : NULL;
+#endif
+#ifdef HAVE_DSP_AVX2
+        case dsp_avx2:
+            return SDL_HasAVX2() ? &dsp_avx2_funcs : NULL;
+#endif
+#ifdef HAVE_DSP_NEON
+        case dsp_neon:
+            return SDL_HasNEON() ? &dsp_neon_funcs : NULL;
+#endif
+
+        default:
+            return NULL;
+    }
+}
+
+//
+// DSP_Init
+// Pick the widest kernels the CPU supports.
+//
+void DSP_Init(void) {
+    static const dspimpl_t order[] = { dsp_avx2, dsp_sse2, dsp_neon };
+
+    for (int i = 0; i < (int) (sizeof(order) / sizeof(*order)); i++) {
+        const dspfuncs_t* funcs = DSP_GetFuncs(order[i]);
+        if (funcs != NULL) {
+            dsp = *funcs;
+            return;
+        }
+    }
+
+    dsp = dsp_scalar_funcs;
+}
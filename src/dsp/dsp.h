@@ -0,0 +1,71 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Audio sample kernels, with SSE2/AVX2/NEON versions.
+//
+
+
+#ifndef __DSP__
+#define __DSP__
+
+#include <stdint.h>
+
+
+typedef enum {
+    dsp_scalar,
+    dsp_sse2,
+    dsp_avx2,
+    dsp_neon,
+    NUMDSPIMPLS
+} dspimpl_t;
+
+// Every implementation gives bit-exact results; the scalar one is the
+// reference. Sample counts are of int16_t values, not stereo frames,
+// except for the resamplers and mixpan, which work on mono input.
+typedef struct {
+    const char* name;
+
+    // Unsigned 8-bit to signed 16-bit: out = in * 257 - 32768.
+    void (*expandu8)(int16_t* out, const uint8_t* in, int count);
+
+    // Resample "in" by stepping a 16.16 fixed point position from "frac"
+    // by "step" per output sample. Linear interpolates with 14 bits of
+    // fraction; zero order hold takes the sample at the position. Linear
+    // reads one sample past the last position, which must be readable.
+    void (*resamplelinear)(int16_t* out, const int16_t* in, uint32_t frac,
+                           uint32_t step, int count);
+    void (*resamplezoh)(int16_t* out, const int16_t* in, uint32_t frac,
+                        uint32_t step, int count);
+
+    // Add mono "in" to the stereo "mix" at volume left/right out of 256.
+    void (*mixpan)(int32_t* mix, const int16_t* in, int count, int left,
+                   int right);
+
+    // out = saturate(out + mix)
+    void (*mixsat32)(int16_t* out, const int32_t* mix, int count);
+    void (*mixsat16)(int16_t* out, const int16_t* in, int count);
+} dspfuncs_t;
+
+// Kernels for the running CPU, scalar until DSP_Init is called.
+extern dspfuncs_t dsp;
+
+// Select the widest kernels the CPU supports. Safe to call more than once.
+void DSP_Init(void);
+
+// Kernels of one implementation, or NULL if it is not compiled in or not
+// supported by the CPU.
+const dspfuncs_t* DSP_GetFuncs(dspimpl_t impl);
+
+#endif
@@ -0,0 +1,293 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Checks every DSP implementation against the scalar reference and
+//	compares their throughput with the per-sample loops the mixers
+//	used before: the sound effect mixer's interpolate, filter and pan
+//	loop, its saturating copy, and SDL_MixAudioFormat in the OPL
+//	callback.
+//
+//	Build with "cmake --build . --target dsp-bench".
+//
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SDL.h"
+
+#include "dsp.h"
+
+
+#define NUMFRAMES 4096
+#define DEFAULT_ROUNDS 5000
+
+// 11025 Hz sound effect to 44100 Hz with a pitch shift, as 16.16.
+#define STEP 0x4400
+
+
+static uint8_t samples8[NUMFRAMES + 1];
+static int16_t samples16[NUMFRAMES + 1];
+static int16_t resampled[NUMFRAMES * 4];
+static int32_t mix32[NUMFRAMES * 8];
+static int16_t out16[NUMFRAMES * 4];
+static int16_t check16[NUMFRAMES * 4];
+static int32_t check32[NUMFRAMES * 8];
+
+static volatile unsigned sink;
+
+
+static void InitSamples(void) {
+    // Fixed seed, so every run uses the same samples.
+    unsigned seed = 1993;
+
+    for (int i = 0; i <= NUMFRAMES; i++) {
+        seed = seed * 1103515245 + 12345;
+        samples8[i] = (uint8_t) (seed >> 16);
+        samples16[i] = (int16_t) (seed >> 12);
+    }
+}
+
+static double Seconds(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void FillOutput(void) {
+    for (int i = 0; i < NUMFRAMES * 2; i++) {
+        out16[i] = samples16[i / 2];
+        mix32[i] = samples16[(i * 7) % NUMFRAMES] * 3;
+    }
+}
+
+//
+// The loops the kernels replace.
+//
+
+static void MixVoiceOld(int32_t* out, int frames, int left, int right) {
+    uint64_t pos = 0;
+    int filtered = samples8[0] * 257 - 32768;
+    int alpha = 1 << 15;
+
+    for (int i = 0; i < frames; i++) {
+        uint32_t index = (uint32_t) (pos >> 16);
+        int frac = (int) (pos & 0xffff) >> 1;
+        int s0 = samples8[index] * 257 - 32768;
+        int s1 = samples8[index + 1] * 257 - 32768;
+        int value = s0 + (((s1 - s0) * frac) >> 15);
+
+        filtered += ((value - filtered) * alpha) >> 15;
+
+        out[0] += (filtered * left) >> 8;
+        out[1] += (filtered * right) >> 8;
+        out += 2;
+
+        pos += STEP;
+    }
+}
+
+static void MixSat32Old(int16_t* out, const int32_t* mix, int count) {
+    for (int i = 0; i < count; i++) {
+        int32_t value = out[i] + mix[i];
+
+        if (value < -32768) value = -32768;
+        else if (value > 32767) value = 32767;
+
+        out[i] = (int16_t) value;
+    }
+}
+
+static int Frames(void) {
+    // Output frames that read no further than the end of the samples.
+    return (int) (((uint64_t) (NUMFRAMES - 1) << 16) / STEP);
+}
+
+static void MixVoiceDSP(const dspfuncs_t* funcs, int32_t* out, int frames,
+                        int left, int right) {
+    funcs->expandu8(samples16, samples8, NUMFRAMES + 1);
+    funcs->resamplelinear(resampled, samples16, 0, STEP, frames);
+    funcs->mixpan(out, resampled, frames, left, right);
+}
+
+//
+// Bit-exactness of every kernel against the scalar one.
+//
+
+static bool CheckFuncs(const dspfuncs_t* ref, const dspfuncs_t* funcs) {
+    int16_t save[NUMFRAMES + 1];
+    bool ok = true;
+
+    memcpy(save, samples16, sizeof(save));
+
+    // Odd counts exercise the scalar tails too.
+    for (int count = NUMFRAMES - 37; count <= NUMFRAMES; count += 37) {
+        ref->expandu8(check16, samples8, count);
+        funcs->expandu8(out16, samples8, count);
+        ok &= memcmp(check16, out16, count * sizeof(int16_t)) == 0;
+    }
+
+    int frames = Frames();
+
+    ref->resamplelinear(check16, save, 0x1234, STEP, frames);
+    funcs->resamplelinear(out16, save, 0x1234, STEP, frames);
+    ok &= memcmp(check16, out16, frames * sizeof(int16_t)) == 0;
+
+    ref->resamplezoh(check16, save, 0x1234, STEP, frames);
+    funcs->resamplezoh(out16, save, 0x1234, STEP, frames);
+    ok &= memcmp(check16, out16, frames * sizeof(int16_t)) == 0;
+
+    FillOutput();
+    memcpy(check32, mix32, sizeof(mix32));
+    ref->mixpan(check32, save, NUMFRAMES - 3, 201, 37);
+    funcs->mixpan(mix32, save, NUMFRAMES - 3, 201, 37);
+    ok &= memcmp(check32, mix32, sizeof(mix32)) == 0;
+
+    FillOutput();
+    memcpy(check16, out16, sizeof(out16));
+    ref->mixsat32(check16, mix32, NUMFRAMES * 2 - 5);
+    funcs->mixsat32(out16, mix32, NUMFRAMES * 2 - 5);
+    ok &= memcmp(check16, out16, sizeof(out16)) == 0;
+
+    FillOutput();
+    memcpy(check16, out16, sizeof(out16));
+    ref->mixsat16(check16, save, NUMFRAMES - 5);
+    funcs->mixsat16(out16, save, NUMFRAMES - 5);
+    ok &= memcmp(check16, out16, sizeof(out16)) == 0;
+
+    memcpy(samples16, save, sizeof(save));
+
+    return ok;
+}
+
+static void Report(const char* name, const char* impl, double time,
+                   double base_time, int rounds, int samples) {
+    double per_sample = time * 1e9 / ((double) rounds * samples);
+    printf("  %-10s %-8s %7.3f ns/sample  %5.2fx\n", name, impl, per_sample,
+           time > 0 ? base_time / time : 0);
+}
+
+static void BenchMixVoice(const dspfuncs_t* funcs, int rounds, double* base) {
+    int frames = Frames();
+
+    memset(mix32, 0, sizeof(mix32));
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        if (funcs == NULL) {
+            MixVoiceOld(mix32, frames, 201, 37);
+        } else {
+            MixVoiceDSP(funcs, mix32, frames, 201, 37);
+        }
+    }
+    double time = Seconds(start);
+    sink += mix32[rounds % frames];
+
+    if (funcs == NULL) {
+        *base = time;
+    }
+    Report("mixvoice", funcs != NULL ? funcs->name : "old", time, *base,
+           rounds, frames);
+}
+
+static void BenchMixSat32(const dspfuncs_t* funcs, int rounds, double* base) {
+    FillOutput();
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        if (funcs == NULL) {
+            MixSat32Old(out16, mix32, NUMFRAMES * 2);
+        } else {
+            funcs->mixsat32(out16, mix32, NUMFRAMES * 2);
+        }
+    }
+    double time = Seconds(start);
+    sink += out16[rounds % NUMFRAMES];
+
+    if (funcs == NULL) {
+        *base = time;
+    }
+    Report("mixsat32", funcs != NULL ? funcs->name : "old", time, *base,
+           rounds, NUMFRAMES * 2);
+}
+
+static void BenchMixSat16(const dspfuncs_t* funcs, int rounds, double* base) {
+    FillOutput();
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        if (funcs == NULL) {
+            SDL_MixAudioFormat((Uint8*) out16, (const Uint8*) samples16,
+                               AUDIO_S16SYS, NUMFRAMES * sizeof(int16_t),
+                               SDL_MIX_MAXVOLUME);
+        } else {
+            funcs->mixsat16(out16, samples16, NUMFRAMES);
+        }
+    }
+    double time = Seconds(start);
+    sink += out16[rounds % NUMFRAMES];
+
+    if (funcs == NULL) {
+        *base = time;
+    }
+    Report("mixsat16", funcs != NULL ? funcs->name : "SDL", time, *base,
+           rounds, NUMFRAMES);
+}
+
+int main(int argc, char** argv) {
+    int rounds = DEFAULT_ROUNDS;
+    if (argc > 1) {
+        rounds = atoi(argv[1]);
+        if (rounds < 1) {
+            fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InitSamples();
+
+    const dspfuncs_t* ref = DSP_GetFuncs(dsp_scalar);
+    const dspfuncs_t* impls[NUMDSPIMPLS];
+    int numimpls = 0;
+
+    for (int i = 0; i < NUMDSPIMPLS; i++) {
+        const dspfuncs_t* funcs = DSP_GetFuncs((dspimpl_t) i);
+        if (funcs == NULL) {
+            continue;
+        }
+        if (!CheckFuncs(ref, funcs)) {
+            fprintf(stderr, "%s: results differ from scalar\n", funcs->name);
+            return 1;
+        }
+        impls[numimpls++] = funcs;
+    }
+
+    double base;
+
+    BenchMixVoice(NULL, rounds, &base);
+    for (int i = 0; i < numimpls; i++) {
+        BenchMixVoice(impls[i], rounds, &base);
+    }
+
+    BenchMixSat32(NULL, rounds, &base);
+    for (int i = 0; i < numimpls; i++) {
+        BenchMixSat32(impls[i], rounds, &base);
+    }
+
+    BenchMixSat16(NULL, rounds, &base);
+    for (int i = 0; i < numimpls; i++) {
+        BenchMixSat16(impls[i], rounds, &base);
+    }
+
+    return 0;
+}
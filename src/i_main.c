@@ -37,6 +37,40 @@
 
 void D_DoomMain (void);
 
+#ifdef BROOM_BENCH
+
+static void AddArg(const char *arg)
+{
+    myargv = realloc(myargv, (myargc + 1) * sizeof(char *));
+    assert(myargv != NULL);
+    myargv[myargc++] = M_StringDuplicate(arg);
+}
+
+//
+// broom-bench only times demos: it always runs without a window or
+// sound, and writes its report to bench.json unless -bench is given.
+//
+static void AddBenchArgs(void)
+{
+    if (!M_ParmExists("-timedemo"))
+    {
+        fprintf(stderr, "Usage: %s -iwad <wad> -timedemo <demo> "
+                        "[-bench <file.json>]\n", myargv[0]);
+        exit(1);
+    }
+
+    AddArg("-headless");
+    AddArg("-nosound");
+
+    if (!M_ParmExists("-bench"))
+    {
+        AddArg("-bench");
+        AddArg("bench.json");
+    }
+}
+
+#endif
+
 int main(int argc, char **argv)
 {
     // save arguments
@@ -67,6 +101,10 @@ int main(int argc, char **argv)
     M_FindResponseFile();
     M_SetExeDir();
 
+#ifdef BROOM_BENCH
+    AddBenchArgs();
+#endif
+
     #ifdef SDL_HINT_NO_SIGNAL_HANDLERS
     SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
     #endif
@@ -688,6 +688,64 @@ static void P_CountSectorLines() {
     }
 }
 
+//
+// Record the sectors across the two-sided lines of each sector, so that
+// the P_Find*Surrounding functions do not have to work them out again
+// on every call.
+//
+static void P_BuildSectorNeighbours() {
+    int total = 0;
+    for (int i = 0; i < numsectors; i++) {
+        total += sectors[i].linecount;
+    }
+    sector_t** buffer = Z_Malloc(total * sizeof(sector_t*), PU_LEVEL, NULL);
+
+    for (int i = 0; i < numsectors; i++) {
+        sector_t* sector = &sectors[i];
+        sector->neighbours = buffer;
+        sector->neighbourcount = 0;
+        for (int j = 0; j < sector->linecount; j++) {
+            sector_t* other = getNextSector(sector->lines[j], sector);
+            if (other != NULL) {
+                sector->neighbours[sector->neighbourcount] = other;
+                sector->neighbourcount++;
+            }
+        }
+        buffer += sector->neighbourcount;
+    }
+}
+
+//
+// Record the two-sided lines of each sector, which sound can travel
+// through, with the sector across each, in one array for the level.
+//
+static void P_BuildSoundEdges() {
+    int total = 0;
+    for (int i = 0; i < numsectors; i++) {
+        total += sectors[i].linecount;
+    }
+    soundedge_t* buffer = Z_Malloc(total * sizeof(soundedge_t), PU_LEVEL, NULL);
+
+    for (int i = 0; i < numsectors; i++) {
+        sector_t* sector = &sectors[i];
+        sector->soundedges = buffer;
+        sector->soundedgecount = 0;
+        for (int j = 0; j < sector->linecount; j++) {
+            line_t* line = sector->lines[j];
+            if (!(line->flags & ML_TWOSIDED)) {
+                // Solid walls block all sound.
+                continue;
+            }
+            soundedge_t* edge = &sector->soundedges[sector->soundedgecount];
+            edge->line = line;
+            edge->other = (sector == line->frontsector) ? line->backsector : line->frontsector;
+            edge->soundblock = (line->flags & ML_SOUNDBLOCK) != 0;
+            sector->soundedgecount++;
+        }
+        buffer += sector->soundedgecount;
+    }
+}
+
 //
 // Look up sector number for each subsector.
 //
@@ -709,6 +767,8 @@ static void P_GroupLines() {
     P_CountSectorLines();
     P_BuildSectorLineTable();
     P_AssignLinesToSectors();
+    P_BuildSectorNeighbours();
+    P_BuildSoundEdges();
     P_SetSectorsBoundingBox();
 }
 
@@ -817,6 +877,11 @@ static int P_GetLevelLump(int episode, int map) {
 static void P_LoadLevelLumps(int episode, int map) {
     int lumpnum = P_GetLevelLump(episode, map);
 
+    // Have the OS read every map lump while the first ones are loaded.
+    for (int i = ML_THINGS; i <= ML_BLOCKMAP; i++) {
+        W_PrefetchLumpNum(lumpnum + i);
+    }
+
     maplumpinfo = lumpinfo[lumpnum];
     leveltime = 0;
     bodyqueslot = 0;
@@ -839,6 +904,7 @@ static void P_FreeMemoryForLevel() {
     // Make sure all sounds are stopped before Z_FreeTags.
     S_Start();
     Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
+    P_ClearThinkerPools();
 }
 
 //
@@ -877,8 +943,10 @@ void P_SetupLevel(int episode, int map) {
         P_RandomlySpawnActivePlayers();
     }
     P_ClearSpecialRespawnQueue();
+    P_BuildTagIndex();
     // set up world state
     P_SpawnSpecials();
+    R_ResetLimits();
     if (precache) {
         // preload graphics
         R_PrecacheLevel();
@@ -890,6 +958,8 @@ void P_SetupLevel(int episode, int map) {
 // P_Init
 //
 void P_Init() {
+    P_InitThinkerArray();
+    P_InitSight();
     P_InitSwitchList();
     P_InitPicAnims();
     R_InitSprites(sprnames);
@@ -13,13 +13,17 @@
 // GNU General Public License for more details.
 //
 // DESCRIPTION:
-//	Fixed point arithemtics, implementation.
+//	Fixed point arithemtics.
 //
 
 
 #ifndef __M_FIXED__
 #define __M_FIXED__
 
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
 
 //
 // Fixed point, 32bit as 16.16.
@@ -29,8 +33,25 @@
 
 typedef int fixed_t;
 
-fixed_t FixedMul(fixed_t a, fixed_t b);
-fixed_t FixedDiv(fixed_t a, fixed_t b);
+//
+// Both are called from the inner loops of the renderer and the playsim,
+// so they are defined here to be inlined at every call site.
+//
+static inline fixed_t FixedMul(fixed_t a, fixed_t b) {
+    int64_t result = ((int64_t) a * (int64_t) b) >> FRACBITS;
+    return (fixed_t) result;
+}
+
+//
+// Saturates to INT_MIN or INT_MAX when the quotient does not fit.
+//
+static inline fixed_t FixedDiv(fixed_t a, fixed_t b) {
+    if ((abs(a) >> 14) >= abs(b)) {
+        return (a ^ b) < 0 ? INT_MIN : INT_MAX;
+    }
+    int64_t result = ((int64_t) a << FRACBITS) / b;
+    return (fixed_t) result;
+}
 
 
 #endif
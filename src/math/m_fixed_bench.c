@@ -0,0 +1,151 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Micro-benchmark of the inline FixedMul/FixedDiv against copies of
+//	the old out-of-line ones from m_fixed.c, which also checks that
+//	both give the same results.
+//
+//	Build with "cmake --build . --target fixed-bench".
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "m_fixed.h"
+
+
+#define NUMVALUES 4096
+#define DEFAULT_ROUNDS 20000
+
+
+static fixed_t values[NUMVALUES];
+
+// Copies of the functions as they were in m_fixed.c, so that the inline
+// ones are checked against the old code rather than against themselves.
+// Called through volatile pointers so that the compiler, or the linker with
+// BROOM_LTO, can not inline them.
+static fixed_t OldFixedMul(fixed_t a, fixed_t b) {
+    int64_t result = ((int64_t) a * (int64_t) b) >> FRACBITS;
+    return (fixed_t) result;
+}
+
+static fixed_t OldFixedDiv(fixed_t a, fixed_t b) {
+    if ((abs(a) >> 14) >= abs(b)) {
+        return (a ^ b) < 0 ? INT_MIN : INT_MAX;
+    }
+    int64_t result = ((int64_t) a << FRACBITS) / b;
+    return (fixed_t) result;
+}
+
+static fixed_t (*volatile outofline_mul)(fixed_t, fixed_t) = OldFixedMul;
+static fixed_t (*volatile outofline_div)(fixed_t, fixed_t) = OldFixedDiv;
+
+
+static void InitValues(void) {
+    // Fixed seed, so every run uses the same operands.
+    unsigned seed = 1993;
+
+    for (int i = 0; i < NUMVALUES; i++) {
+        seed = seed * 1103515245 + 12345;
+        fixed_t value = (fixed_t) ((seed >> 8) & 0xffffff) - 0x800000;
+        values[i] = (value == 0) ? FRACUNIT : value;
+    }
+}
+
+static double Seconds(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static unsigned InlineMul(int rounds) {
+    unsigned sum = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 1; i < NUMVALUES; i++) {
+            sum += FixedMul(values[i - 1], values[i]);
+        }
+    }
+    return sum;
+}
+
+static unsigned CallMul(int rounds) {
+    fixed_t (*mul)(fixed_t, fixed_t) = outofline_mul;
+    unsigned sum = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 1; i < NUMVALUES; i++) {
+            sum += mul(values[i - 1], values[i]);
+        }
+    }
+    return sum;
+}
+
+static unsigned InlineDiv(int rounds) {
+    unsigned sum = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 1; i < NUMVALUES; i++) {
+            sum += FixedDiv(values[i - 1], values[i]);
+        }
+    }
+    return sum;
+}
+
+static unsigned CallDiv(int rounds) {
+    fixed_t (*div)(fixed_t, fixed_t) = outofline_div;
+    unsigned sum = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 1; i < NUMVALUES; i++) {
+            sum += div(values[i - 1], values[i]);
+        }
+    }
+    return sum;
+}
+
+static void Compare(const char* name, unsigned (*inline_func)(int),
+                    unsigned (*call_func)(int), int rounds) {
+    clock_t start = clock();
+    unsigned call_sum = call_func(rounds);
+    double call_time = Seconds(start);
+
+    start = clock();
+    unsigned inline_sum = inline_func(rounds);
+    double inline_time = Seconds(start);
+
+    if (call_sum != inline_sum) {
+        fprintf(stderr, "%s: results differ (%u != %u)\n", name, call_sum, inline_sum);
+        exit(1);
+    }
+
+    double ops = (double) rounds * (NUMVALUES - 1);
+    printf("%s: call %.2f ns/op, inline %.2f ns/op, %.2fx\n",
+           name, call_time * 1e9 / ops, inline_time * 1e9 / ops,
+           inline_time > 0 ? call_time / inline_time : 0);
+}
+
+int main(int argc, char** argv) {
+    int rounds = DEFAULT_ROUNDS;
+    if (argc > 1) {
+        rounds = atoi(argv[1]);
+        if (rounds < 1) {
+            fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    InitValues();
+    Compare("FixedMul", InlineMul, CallMul, rounds);
+    Compare("FixedDiv", InlineDiv, CallDiv, rounds);
+
+    return 0;
+}
@@ -189,4 +189,8 @@ int mem_fseek(MEMFILE *stream, signed long position, mem_rel_t whence)
 	}
 }
 
+long mem_ftell(MEMFILE *stream)
+{
+	return stream->position;
+}
 
@@ -0,0 +1,491 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Segregated size class zone backend. It manages the same zone memory
+//	as the default allocator, with the same tag, user and purge rules,
+//	but without walking the block list:
+//
+//	- Small blocks are recycled through one free list per size class,
+//	  so most allocations and frees are O(1).
+//	- Everything else comes from a best-fit tree of free extents, a
+//	  treap keyed by size and address, and is merged with its free
+//	  neighbours when freed.
+//	- Allocated blocks are kept in a list per tag, oldest first, so
+//	  Z_FreeTags only visits the blocks it frees, and purgable blocks
+//	  are thrown out oldest first, and only when memory runs out.
+//
+
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "z_segregated.h"
+#include "z_zone.h"
+#include "i_system.h"
+
+
+#define ZONEID 0x1d4a11
+
+// id of a free block waiting in a size class list. Free blocks in the
+// tree have an id of 0.
+#define CLASSFREEID 0x1d4a12
+
+#define SIZECLASS_STEP 16
+#define NUMSIZECLASSES 64
+#define SMALL_LIMIT (SIZECLASS_STEP * NUMSIZECLASSES)
+#define LARGE_BLOCK -1
+
+// Aligned to 16 bytes so that the header size, and so every payload, is a
+// multiple of 16, as malloc would give.
+typedef struct segblock_s {
+    alignas(16) int size; // including the header
+    int tag;  // PU_FREE if this is free
+    int id;   // ZONEID if allocated
+    int sizeclass;  // or LARGE_BLOCK
+    struct segblock_s* physprev;  // block just before this one in memory
+    void** user;
+    union {
+        // tag list or size class list
+        struct {
+            struct segblock_s* next;
+            struct segblock_s* prev;
+        };
+        // free tree
+        struct {
+            struct segblock_s* left;
+            struct segblock_s* right;
+        };
+    };
+} segblock_t;
+
+static_assert(sizeof(segblock_t) % SIZECLASS_STEP == 0,
+              "zone block header must keep payloads aligned");
+
+// Smallest free extent worth splitting off.
+#define MINFRAGMENT (sizeof(segblock_t) + 64)
+
+
+static segblock_t* freetree;
+static segblock_t* classfree[NUMSIZECLASSES];
+
+// Allocated blocks by tag, oldest first.
+static segblock_t* taghead[PU_NUM_TAGS];
+static segblock_t* tagtail[PU_NUM_TAGS];
+
+// Never freed; stops merging past the end of the zone.
+static segblock_t* endblock;
+static segblock_t* firstblock;
+
+static bool zero_on_free;
+static bool scan_on_free;
+
+
+static inline segblock_t* Z_SegNext(segblock_t* block) {
+    return (segblock_t*) ((byte*) block + block->size);
+}
+
+static inline bool Z_SegInTree(segblock_t* block) {
+    return block->tag == PU_FREE && block->id == 0;
+}
+
+
+//
+// Free tree. A max-heap on a hash of the address keeps it balanced
+// whatever order blocks are freed in.
+//
+
+static inline unsigned Z_SegPriority(const segblock_t* block) {
+    return (unsigned) (((uintptr_t) block >> 4) * 2654435761u);
+}
+
+static inline bool Z_SegLess(const segblock_t* a, const segblock_t* b) {
+    return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static segblock_t* Z_SegTreeInsert(segblock_t* root, segblock_t* block) {
+    if (root == NULL) {
+        block->left = NULL;
+        block->right = NULL;
+        return block;
+    }
+    if (Z_SegLess(block, root)) {
+        root->left = Z_SegTreeInsert(root->left, block);
+        if (Z_SegPriority(root->left) > Z_SegPriority(root)) {
+            segblock_t* child = root->left;
+            root->left = child->right;
+            child->right = root;
+            root = child;
+        }
+    } else {
+        root->right = Z_SegTreeInsert(root->right, block);
+        if (Z_SegPriority(root->right) > Z_SegPriority(root)) {
+            segblock_t* child = root->right;
+            root->right = child->left;
+            child->left = root;
+            root = child;
+        }
+    }
+    return root;
+}
+
+// Join two subtrees, every block of a being less than every block of b.
+static segblock_t* Z_SegTreeJoin(segblock_t* a, segblock_t* b) {
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (Z_SegPriority(a) > Z_SegPriority(b)) {
+        a->right = Z_SegTreeJoin(a->right, b);
+        return a;
+    }
+    b->left = Z_SegTreeJoin(a, b->left);
+    return b;
+}
+
+static segblock_t* Z_SegTreeRemove(segblock_t* root, segblock_t* block) {
+    if (root == block) {
+        return Z_SegTreeJoin(root->left, root->right);
+    }
+    if (Z_SegLess(block, root)) {
+        root->left = Z_SegTreeRemove(root->left, block);
+    } else {
+        root->right = Z_SegTreeRemove(root->right, block);
+    }
+    return root;
+}
+
+static segblock_t* Z_SegBestFit(int size) {
+    segblock_t* best = NULL;
+    segblock_t* node = freetree;
+
+    while (node != NULL) {
+        if (node->size >= size) {
+            best = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+//
+// Put a block back in the tree, merged with any free neighbours.
+//
+static void Z_SegRelease(segblock_t* block) {
+    segblock_t* next = Z_SegNext(block);
+    if (Z_SegInTree(next)) {
+        freetree = Z_SegTreeRemove(freetree, next);
+        block->size += next->size;
+    }
+
+    segblock_t* prev = block->physprev;
+    if (prev != NULL && Z_SegInTree(prev)) {
+        freetree = Z_SegTreeRemove(freetree, prev);
+        prev->size += block->size;
+        block = prev;
+    }
+    Z_SegNext(block)->physprev = block;
+
+    block->tag = PU_FREE;
+    block->id = 0;
+    block->user = NULL;
+    block->sizeclass = LARGE_BLOCK;
+    freetree = Z_SegTreeInsert(freetree, block);
+}
+
+//
+// Take a block of at least size bytes out of the tree, splitting off
+// what is left over.
+//
+static segblock_t* Z_SegTakeFree(int size) {
+    segblock_t* block = Z_SegBestFit(size);
+    if (block == NULL) {
+        return NULL;
+    }
+    freetree = Z_SegTreeRemove(freetree, block);
+
+    int extra = block->size - size;
+    if (extra > (int) MINFRAGMENT) {
+        segblock_t* rest = (segblock_t*) ((byte*) block + size);
+        rest->size = extra;
+        rest->physprev = block;
+        Z_SegNext(rest)->physprev = rest;
+        block->size = size;
+
+        rest->tag = PU_FREE;
+        rest->id = 0;
+        rest->user = NULL;
+        rest->sizeclass = LARGE_BLOCK;
+        freetree = Z_SegTreeInsert(freetree, rest);
+    }
+    return block;
+}
+
+//
+// Give every block waiting in the size class lists back to the tree.
+// Returns false if there were none.
+//
+static bool Z_SegFlushClasses() {
+    bool flushed = false;
+
+    for (int i = 0; i < NUMSIZECLASSES; i++) {
+        while (classfree[i] != NULL) {
+            segblock_t* block = classfree[i];
+            classfree[i] = block->next;
+            Z_SegRelease(block);
+            flushed = true;
+        }
+    }
+    return flushed;
+}
+
+//
+// Throw out the oldest purgable block. Returns false if there are none.
+//
+static bool Z_SegPurgeOne() {
+    for (int tag = PU_PURGELEVEL; tag < PU_NUM_TAGS; tag++) {
+        if (taghead[tag] != NULL) {
+            Z_SegFree((byte*) taghead[tag] + sizeof(segblock_t));
+            return true;
+        }
+    }
+    return false;
+}
+
+static segblock_t* Z_SegAllocBlock(int size) {
+    bool purging = false;
+    segblock_t* block;
+
+    while ((block = Z_SegTakeFree(size)) == NULL) {
+        if (Z_SegFlushClasses()) {
+            continue;
+        }
+        if (!purging) {
+            // let anyone still reading cached data finish first
+            Z_CallPurgeCallback();
+            purging = true;
+        }
+        if (!Z_SegPurgeOne()) {
+            I_Error("Z_Malloc: failed on allocation of %i bytes", size);
+        }
+    }
+    return block;
+}
+
+
+static void Z_SegLinkTag(segblock_t* block) {
+    int tag = block->tag;
+
+    block->next = NULL;
+    block->prev = tagtail[tag];
+    if (tagtail[tag] != NULL) {
+        tagtail[tag]->next = block;
+    } else {
+        taghead[tag] = block;
+    }
+    tagtail[tag] = block;
+
+    Z_AddTagBytes(tag, block->size);
+}
+
+static void Z_SegUnlinkTag(segblock_t* block) {
+    int tag = block->tag;
+
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        taghead[tag] = block->next;
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    } else {
+        tagtail[tag] = block->prev;
+    }
+
+    Z_AddTagBytes(tag, -block->size);
+}
+
+
+void Z_SegInit(byte* base, int size, bool zero, bool scan) {
+    zero_on_free = zero;
+    scan_on_free = scan;
+
+    // Keep the blocks aligned as well as malloc would: the start of the
+    // zone, the header and every block size are multiples of 16.
+    uintptr_t start = ((uintptr_t) base + 15) & ~(uintptr_t) 15;
+    size -= (int) (start - (uintptr_t) base);
+    size &= ~15;
+
+    firstblock = (segblock_t*) start;
+    firstblock->size = size - sizeof(segblock_t);
+    firstblock->physprev = NULL;
+
+    endblock = Z_SegNext(firstblock);
+    endblock->size = sizeof(segblock_t);
+    endblock->tag = PU_STATIC;
+    endblock->id = ZONEID;
+    endblock->user = NULL;
+    endblock->sizeclass = LARGE_BLOCK;
+
+    // This sets up everything else about the first block.
+    Z_SegRelease(firstblock);
+}
+
+void* Z_SegMalloc(int size, int tag, void* user) {
+    if (user == NULL && tag >= PU_PURGELEVEL) {
+        I_Error("Z_Malloc: an owner is required for purgable blocks");
+    }
+
+    size = (size + SIZECLASS_STEP - 1) & ~(SIZECLASS_STEP - 1);
+    if (size == 0) {
+        size = SIZECLASS_STEP;
+    }
+
+    segblock_t* block;
+    if (size <= SMALL_LIMIT) {
+        int sizeclass = size / SIZECLASS_STEP - 1;
+        block = classfree[sizeclass];
+        if (block != NULL) {
+            classfree[sizeclass] = block->next;
+        } else {
+            block = Z_SegAllocBlock(size + sizeof(segblock_t));
+        }
+        block->sizeclass = sizeclass;
+    } else {
+        block = Z_SegAllocBlock(size + sizeof(segblock_t));
+        block->sizeclass = LARGE_BLOCK;
+    }
+
+    block->tag = tag;
+    block->id = ZONEID;
+    block->user = user;
+    Z_SegLinkTag(block);
+
+    void* result = (byte*) block + sizeof(segblock_t);
+    if (user != NULL) {
+        *block->user = result;
+    }
+    return result;
+}
+
+// Scan the zone for pointers into a freed block, see -zonescan.
+static void Z_SegScanForBlock(void* start, void* end) {
+    for (segblock_t* block = firstblock; block != endblock; block = Z_SegNext(block)) {
+        int tag = block->tag;
+        if (block->id != ZONEID
+         || (tag != PU_STATIC && tag != PU_LEVEL && tag != PU_LEVSPEC)) {
+            continue;
+        }
+
+        void** mem = (void**) ((byte*) block + sizeof(segblock_t));
+        int len = (block->size - sizeof(segblock_t)) / sizeof(void*);
+        for (int i = 0; i < len; ++i) {
+            if (start <= mem[i] && mem[i] <= end) {
+                fprintf(stderr, "%p has dangling pointer into freed block "
+                                "%p (%p -> %p)\n", mem, start, &mem[i], mem[i]);
+            }
+        }
+    }
+}
+
+void Z_SegFree(void* ptr) {
+    segblock_t* block = (segblock_t*) ((byte*) ptr - sizeof(segblock_t));
+
+    if (block->id != ZONEID) {
+        I_Error("Z_Free: freed a pointer without ZONEID");
+    }
+
+    if (block->user != NULL) {
+        // clear the user's mark
+        *block->user = 0;
+    }
+    Z_SegUnlinkTag(block);
+
+    if (zero_on_free) {
+        memset(ptr, 0, block->size - sizeof(segblock_t));
+    }
+    if (scan_on_free) {
+        Z_SegScanForBlock(ptr, (byte*) ptr + block->size - sizeof(segblock_t));
+    }
+
+    if (block->sizeclass == LARGE_BLOCK) {
+        Z_SegRelease(block);
+        return;
+    }
+
+    block->tag = PU_FREE;
+    block->id = CLASSFREEID;
+    block->user = NULL;
+    block->next = classfree[block->sizeclass];
+    classfree[block->sizeclass] = block;
+}
+
+void Z_SegFreeTags(int lowtag, int hightag) {
+    if (lowtag < 0) {
+        lowtag = 0;
+    }
+    if (hightag >= PU_NUM_TAGS) {
+        hightag = PU_NUM_TAGS - 1;
+    }
+
+    for (int tag = lowtag; tag <= hightag; tag++) {
+        while (taghead[tag] != NULL) {
+            Z_SegFree((byte*) taghead[tag] + sizeof(segblock_t));
+        }
+    }
+}
+
+void Z_SegCheckHeap(void) {
+    segblock_t* prev = NULL;
+
+    for (segblock_t* block = firstblock; block != endblock; block = Z_SegNext(block)) {
+        if (block->physprev != prev) {
+            I_Error("Z_CheckHeap: block doesn't have proper back link\n");
+        }
+        if (block->size < (int) sizeof(segblock_t) || (byte*) Z_SegNext(block) > (byte*) endblock) {
+            I_Error("Z_CheckHeap: block size does not touch the next block\n");
+        }
+        if (Z_SegInTree(block) && Z_SegInTree(Z_SegNext(block))) {
+            I_Error("Z_CheckHeap: two consecutive free blocks\n");
+        }
+        prev = block;
+    }
+    if (endblock->physprev != prev) {
+        I_Error("Z_CheckHeap: block doesn't have proper back link\n");
+    }
+}
+
+void Z_SegChangeTag(void* ptr, int tag, const char* file, int line) {
+    segblock_t* block = (segblock_t*) ((byte*) ptr - sizeof(segblock_t));
+    if (block->id != ZONEID) {
+        I_Error("%s:%i: Z_ChangeTag: block without a ZONEID!", file, line);
+    }
+    if (tag >= PU_PURGELEVEL && block->user == NULL) {
+        I_Error("%s:%i: Z_ChangeTag: an owner is required for purgable blocks",
+                file, line);
+    }
+
+    // Moving to the end of the list makes a block that is cached again
+    // the last to be purged.
+    Z_SegUnlinkTag(block);
+    block->tag = tag;
+    Z_SegLinkTag(block);
+}
@@ -0,0 +1,39 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Segregated size class zone backend, selected with -zone segregated.
+//	Only used by z_zone.c.
+//
+
+
+#ifndef __Z_SEGREGATED__
+#define __Z_SEGREGATED__
+
+#include "doomtype.h"
+
+
+void Z_SegInit(byte* base, int size, bool zero_on_free, bool scan_on_free);
+void* Z_SegMalloc(int size, int tag, void* user);
+void Z_SegFree(void* ptr);
+void Z_SegFreeTags(int lowtag, int hightag);
+void Z_SegCheckHeap(void);
+void Z_SegChangeTag(void* ptr, int tag, const char* file, int line);
+
+// Provided by z_zone.c.
+void Z_CallPurgeCallback(void);
+void Z_AddTagBytes(int tag, int bytes);
+
+
+#endif
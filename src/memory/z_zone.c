@@ -25,6 +25,7 @@
 #include "doomtype.h"
 #include "i_system.h"
 #include "m_argv.h"
+#include "z_segregated.h"
 
 
 
@@ -67,6 +68,15 @@ static memzone_t *mainzone;
 static bool zero_on_free;
 static bool scan_on_free;
 
+// Use the segregated size class backend in z_segregated.c.
+static bool segregated;
+
+// Called before a purgable block is thrown out by Z_Malloc.
+static void (*purge_callback)(void);
+
+// Bytes allocated with each tag, including block headers.
+static int tagbytes[PU_NUM_TAGS];
+
 
 //
 // Z_Init
@@ -75,8 +85,53 @@ void Z_Init (void)
 {
     memblock_t*	block;
     int		size;
+    int		p;
+    byte*	base;
 
-    mainzone = (memzone_t *)I_ZoneBase (&size);
+    // [Deliberately undocumented]
+    // Zone memory debugging flag. If set, memory is zeroed after it is freed
+    // to deliberately break any code that attempts to use it after free.
+    //
+    zero_on_free = M_ParmExists("-zonezero");
+
+    // [Deliberately undocumented]
+    // Zone memory debugging flag. If set, each time memory is freed, the zone
+    // heap is scanned to look for remaining pointers to the freed block.
+    //
+    scan_on_free = M_ParmExists("-zonescan");
+
+    //!
+    // @category obscure
+    // @arg <backend>
+    //
+    // Select the zone memory allocator: "default", the original
+    // first-fit block list, or "segregated", which keeps free lists
+    // per size class and a best-fit tree, so that allocation time does
+    // not depend on how many blocks the zone holds.
+    //
+    p = M_CheckParmWithArgs("-zone", 1);
+
+    if (p > 0)
+    {
+        if (!strcmp(myargv[p+1], "segregated"))
+        {
+            segregated = true;
+        }
+        else if (strcmp(myargv[p+1], "default") != 0)
+        {
+            I_Error("Z_Init: Unknown zone allocator '%s'", myargv[p+1]);
+        }
+    }
+
+    base = I_ZoneBase (&size);
+
+    if (segregated)
+    {
+        Z_SegInit(base, size, zero_on_free, scan_on_free);
+        return;
+    }
+
+    mainzone = (memzone_t *) base;
     mainzone->size = size;
 
     // set the entire zone to one free block
@@ -94,18 +149,6 @@ void Z_Init (void)
     block->tag = PU_FREE;
 
     block->size = mainzone->size - sizeof(memzone_t);
-
-    // [Deliberately undocumented]
-    // Zone memory debugging flag. If set, memory is zeroed after it is freed
-    // to deliberately break any code that attempts to use it after free.
-    //
-    zero_on_free = M_ParmExists("-zonezero");
-
-    // [Deliberately undocumented]
-    // Zone memory debugging flag. If set, each time memory is freed, the zone
-    // heap is scanned to look for remaining pointers to the freed block.
-    //
-    scan_on_free = M_ParmExists("-zonescan");
 }
 
 // Scan the zone heap for pointers within the specified range, and warn about
@@ -153,6 +196,12 @@ void Z_Free (void* ptr)
     memblock_t*		block;
     memblock_t*		other;
 
+    if (segregated)
+    {
+        Z_SegFree(ptr);
+        return;
+    }
+
     block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
 
     if (block->id != ZONEID)
@@ -164,6 +213,11 @@ void Z_Free (void* ptr)
 	    *block->user = 0;
     }
 
+    if (block->tag != PU_FREE)
+    {
+        tagbytes[block->tag] -= block->size;
+    }
+
     // mark as free
     block->tag = PU_FREE;
     block->user = NULL;
@@ -231,6 +285,11 @@ Z_Malloc
     memblock_t*	base;
     void *result;
 
+    if (segregated)
+    {
+        return Z_SegMalloc(size, tag, user);
+    }
+
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
     // scan through the block list,
@@ -269,6 +328,12 @@ Z_Malloc
             }
             else
             {
+                // let anyone still reading cached data finish first
+                if (purge_callback != NULL)
+                {
+                    purge_callback();
+                }
+
                 // free the rover block (adding the size to base)
 
                 // the rover can be the base block
@@ -310,6 +375,7 @@ Z_Malloc
 
     base->user = user;
     base->tag = tag;
+    tagbytes[tag] += base->size;
 
     result  = (void *) ((byte *)base + sizeof(memblock_t));
 
@@ -338,6 +404,12 @@ Z_FreeTags
 {
     memblock_t*	block;
     memblock_t*	next;
+
+    if (segregated)
+    {
+        Z_SegFreeTags(lowtag, hightag);
+        return;
+    }
 	
     for (block = mainzone->blocklist.next ;
 	 block != &mainzone->blocklist ;
@@ -361,6 +433,12 @@ Z_FreeTags
 void Z_CheckHeap (void)
 {
     memblock_t*	block;
+
+    if (segregated)
+    {
+        Z_SegCheckHeap();
+        return;
+    }
 	
     for (block = mainzone->blocklist.next ; ; block = block->next)
     {
@@ -384,10 +462,50 @@ void Z_CheckHeap (void)
 
 
 
+//
+// Z_SetPurgeCallback
+// Install a function to call before Z_Malloc purges any cached block, or
+// NULL to remove it. Used by code that holds on to PU_CACHE data across
+// allocations.
+//
+void Z_SetPurgeCallback(void (*callback)(void))
+{
+    purge_callback = callback;
+}
+
+void Z_CallPurgeCallback(void)
+{
+    if (purge_callback != NULL)
+    {
+        purge_callback();
+    }
+}
+
+
+//
+// Z_TagBytes
+// Number of bytes currently allocated with a tag, block headers included.
+//
+int Z_TagBytes(int tag)
+{
+    return tagbytes[tag];
+}
+
+void Z_AddTagBytes(int tag, int bytes)
+{
+    tagbytes[tag] += bytes;
+}
+
+
 //
 // Z_ChangeTag
 //
 void Z_ChangeTag2(void *ptr, int tag, const char *file, int line) {
+    if (segregated) {
+        Z_SegChangeTag(ptr, tag, file, line);
+        return;
+    }
+
     memblock_t* block = (memblock_t *) ((byte *) ptr - sizeof(memblock_t));
     if (block->id != ZONEID) {
         I_Error("%s:%i: Z_ChangeTag: block without a ZONEID!", file, line);
@@ -396,5 +514,7 @@ void Z_ChangeTag2(void *ptr, int tag, const char *file, int line) {
         I_Error("%s:%i: Z_ChangeTag: an owner is required for purgable blocks",
                 file, line);
     }
+    tagbytes[block->tag] -= block->size;
+    tagbytes[tag] += block->size;
     block->tag = tag;
 }
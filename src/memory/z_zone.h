@@ -51,6 +51,8 @@ void Z_Free(void* ptr);
 void Z_FreeTags(int lowtag, int hightag);
 void Z_CheckHeap(void);
 void Z_ChangeTag2(void* ptr, int tag, const char* file, int line);
+void Z_SetPurgeCallback(void (*callback)(void));
+int Z_TagBytes(int tag);
 
 //
 // This is used to get the local FILE:LINE info from CPP
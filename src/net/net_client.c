@@ -22,6 +22,7 @@
 #include "config.h"
 #include "doomtype.h"
 #include "d_loop.h"
+#include "i_profile.h"
 #include "i_timer.h"
 #include "m_fixed.h"
 #include "m_config.h"
@@ -895,6 +896,7 @@ void NET_CL_Run(void) {
     if (!net_client_connected) {
         return;
     }
+    PROFILE_BEGIN("NET_CL_Run");
     NET_CL_ReceiveServerPackets();
     // Run the common connection code to send any packets as needed
     NET_Conn_Run(&client_connection);
@@ -909,6 +911,7 @@ void NET_CL_Run(void) {
         // Check if our resend requests have timed out
         NET_CL_CheckResends();
     }
+    PROFILE_END("NET_CL_Run");
 }
 
 static void NET_CL_SendSYN(net_connect_data_t *data) {
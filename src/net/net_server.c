@@ -23,6 +23,7 @@
 
 #include "doomtype.h"
 #include "d_mode.h"
+#include "i_profile.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "m_argv.h"
@@ -1944,12 +1945,14 @@ void NET_SV_Run(void) {
     if (!server_initialized) {
         return;
     }
+    PROFILE_BEGIN("NET_SV_Run");
     NET_SV_ReceivePackets();
     if (master_server) {
         UpdateMasterServer();
     }
     NET_SV_RunActiveClients();
     NET_SV_RunState();
+    PROFILE_END("NET_SV_Run");
 }
 
 void NET_SV_Shutdown(void)
@@ -84,22 +84,31 @@ static dirtype_t diags[] = {
 
 //
 // Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
+// Traverse adjacent sectors, depth first,
 // sound blocking lines cut off traversal.
 //
 static mobj_t *soundtarget;
 
-static bool P_CanPropagateSound(const line_t* line, int sound_blocks) {
-    if (!(line->flags & ML_TWOSIDED)) {
-        // Solid walls block all sound.
-        return false;
-    }
-    P_LineOpening(line);
+// A sector being flooded, and the next of its lines to follow.
+typedef struct {
+    sector_t* sector;
+    int soundblocks;
+    int edge;
+} soundframe_t;
+
+// Stands in for the call stack of the original recursive flood, so that
+// deep maps can not overflow it.
+static soundframe_t* soundstack = NULL;
+static int maxsoundstack = 0;
+
+static bool P_CanPropagateSound(const soundedge_t* edge, int sound_blocks) {
+    // Solid walls, which block all sound, have no edges.
+    P_LineOpening(edge->line);
     if (openrange <= 0) {
         // Closed doors block all sound.
         return false;
     }
-    if (line->flags & ML_SOUNDBLOCK) {
+    if (edge->soundblock) {
         // Line is set to block sounds. Only allow propagation
         // if this is the first line to block the sound.
         return sound_blocks == 0;
@@ -117,7 +126,10 @@ static bool P_CanFloodSector(const sector_t* sec, int soundblocks) {
     return soundblocks + 1 < sec->soundtraversed;
 }
 
-static void P_RecursiveSound(sector_t* sec, int soundblocks) {
+//
+// Flood a sector, and push it to have its neighbours flooded in turn.
+//
+static void P_FloodSoundSector(sector_t* sec, int soundblocks, int* depth) {
     if (!P_CanFloodSector(sec, soundblocks)) {
         return;
     }
@@ -127,22 +139,47 @@ static void P_RecursiveSound(sector_t* sec, int soundblocks) {
     // Wake up all monsters in this sector.
     sec->soundtarget = soundtarget;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        const line_t* line = sec->lines[i];
-        if (!P_CanPropagateSound(line, soundblocks)) {
+    if (*depth == maxsoundstack) {
+        maxsoundstack = maxsoundstack ? maxsoundstack * 2 : 64;
+        soundstack = I_Realloc(soundstack, maxsoundstack * sizeof(*soundstack));
+    }
+    soundframe_t* frame = &soundstack[*depth];
+    frame->sector = sec;
+    frame->soundblocks = soundblocks;
+    frame->edge = 0;
+    (*depth)++;
+}
+
+//
+// Visits the sectors, and calls P_LineOpening, in exactly the order that
+// the original recursive version did.
+//
+static void P_RecursiveSound(sector_t* start) {
+    int depth = 0;
+    P_FloodSoundSector(start, 0, &depth);
+
+    while (depth > 0) {
+        soundframe_t* frame = &soundstack[depth - 1];
+        if (frame->edge == frame->sector->soundedgecount) {
+            // All of this sector's lines followed.
+            depth--;
+            continue;
+        }
+        const soundedge_t* edge = &frame->sector->soundedges[frame->edge];
+        frame->edge++;
+
+        if (!P_CanPropagateSound(edge, frame->soundblocks)) {
             continue;
         }
-        sector_t* other =
-            (sec == line->frontsector) ? line->backsector : line->frontsector;
-        if (line->flags & ML_SOUNDBLOCK) {
+        if (edge->soundblock) {
             // This is a sound-blocking line, but we do not block sound here.
-            // Instead, we recursively call the function for the next
-            // sound-blocking line to block the sound, and so simulate
-            // sound attenuation. This makes the monsters' reactions to the
+            // Instead, we carry on the flood until the next sound-blocking
+            // line, which blocks the sound, and so simulate sound
+            // attenuation. This makes the monsters' reactions to the
             // player more organic and realistic (checkout Doom 2 MAP01).
-            P_RecursiveSound(other, 1);
+            P_FloodSoundSector(edge->other, 1, &depth);
         } else {
-            P_RecursiveSound(other, soundblocks);
+            P_FloodSoundSector(edge->other, frame->soundblocks, &depth);
         }
     }
 }
@@ -155,7 +192,7 @@ static void P_RecursiveSound(sector_t* sec, int soundblocks) {
 void P_NoiseAlert(mobj_t* target, mobj_t* emitter) {
     soundtarget = target;
     validcount++;
-    P_RecursiveSound(emitter->subsector->sector, 0);
+    P_RecursiveSound(emitter->subsector->sector);
 }
 
 
@@ -61,10 +61,31 @@
 extern thinker_t thinkercap;
 
 
+// Each kind of thinker is allocated from its own pool.
+typedef enum
+{
+    tp_mobj,
+    tp_ceiling,
+    tp_door,
+    tp_floor,
+    tp_plat,
+    tp_fireflicker,
+    tp_lightflash,
+    tp_strobe,
+    tp_glow,
+    NUMTHINKERPOOLS
+} thinkerpool_t;
+
+void P_InitThinkerArray();
 void P_InitThinkers();
+void P_ClearThinkerPools();
+void *P_AllocThinker(thinkerpool_t pool, int size);
+void P_FreeThinkerMemory(thinker_t *thinker);
 void P_AddThinker(thinker_t *thinker);
 void P_RemoveThinker(thinker_t *thinker);
 bool P_IsThinkerRemoved(thinker_t *thinker);
+uint64_t P_ThinkerCalls(thinkerpool_t type);
+const char *P_ThinkerName(thinkerpool_t type);
 
 
 //
@@ -205,9 +226,37 @@ bool P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y);
 bool P_TryMove(mobj_t *thing, fixed_t x, fixed_t y);
 bool P_TeleportMove(mobj_t *thing, fixed_t x, fixed_t y);
 void P_SlideMove(mobj_t *mo);
-bool P_CheckSight(const mobj_t* t1, const mobj_t* t2);
 void P_UseLines(player_t *player);
 
+//
+// P_SIGHT
+//
+
+// Scratch space for P_CheckSightBatch. Start zeroed; every thread that
+// checks sight at the same time as others needs its own.
+typedef struct {
+    int* linemarks;
+    int numlinemarks;
+    int mark;
+} sightcontext_t;
+
+typedef struct {
+    const mobj_t* looker;
+    const mobj_t* target;
+    bool visible; // set by P_CheckSightBatch
+} sightquery_t;
+
+// Called by P_Init, see -checksight.
+void P_InitSight(void);
+
+bool P_CheckSight(const mobj_t* t1, const mobj_t* t2);
+void P_CheckSightBatch(sightcontext_t* context, sightquery_t* queries, int count);
+
+// Drops the P_CheckSight results cached so far. Called at the start of
+// every tic and when a floor or ceiling moves.
+void P_InvalidateSightCache(void);
+void P_SightCacheStats(uint64_t* hits, uint64_t* misses);
+
 bool P_ChangeSector(const sector_t *sector, bool crunch);
 
 extern mobj_t *linetarget; // who got hit (or NULL)
@@ -16,17 +16,21 @@
 //	LineOfSight/Visibility checks, uses REJECT Lookup Table.
 //
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "p_local.h"
 
 #include "doomstat.h"
 #include "i_system.h"
+#include "m_argv.h"
 
 //
 // P_CheckSight
 //
 
-// eye z of looker
+// eye z of looker, for the Doom 1.2 check
 static fixed_t sightzstart;
 
 // This is the highest point of t2 that can be seen from t1.
@@ -35,9 +39,50 @@ fixed_t topslope;
 // This is the lowest point of t2 that can be seen from t1.
 fixed_t bottomslope;
 
-static divline_t strace; // from t1 to t2
-static fixed_t t2x;
-static fixed_t t2y;
+// State of one sight check through the BSP. Everything it changes is in
+// here or in its context, so checks on different contexts can run at
+// the same time.
+typedef struct {
+    sightcontext_t* context;
+    fixed_t sightzstart; // eye z of looker
+    fixed_t topslope;
+    fixed_t bottomslope;
+    divline_t strace; // from t1 to t2
+    fixed_t t2x;
+    fixed_t t2y;
+} sighttrace_t;
+
+// Results of P_CheckSight during the current tic. The slot is picked by
+// the subsectors and rough heights of the two things, and an entry is
+// only used when their positions match exactly, so a hit gives the
+// same answer as walking the BSP again.
+#define SIGHTCACHE_SIZE 1024
+
+typedef struct {
+    unsigned stamp;
+    fixed_t x1, y1, z1, height1;
+    fixed_t x2, y2, z2, height2;
+    fixed_t topslope;
+    fixed_t bottomslope;
+    bool visible;
+} sightcacheentry_t;
+
+static sightcacheentry_t sightcache[SIGHTCACHE_SIZE];
+
+// Entries from an older stamp are stale. Bumped every tic and whenever
+// a floor or ceiling moves.
+static unsigned sightstamp = 1;
+
+static uint64_t sightcachehits;
+static uint64_t sightcachemisses;
+
+// Used by P_CheckSight, which only runs on the main thread.
+static sightcontext_t sightcontext;
+
+// Check every P_CheckSight against P_CheckSightBatch, on a context of its
+// own.
+static bool checksight;
+static sightcontext_t checkcontext;
 
 
 // PTR_SightTraverse() for Doom 1.2 sight calculations taken
@@ -190,7 +235,7 @@ static bool P_IsTwoSided(const seg_t* seg) {
 // 1. The endpoints of the segment are on different sides of the strace.
 // 2. The endpoints of the strace are on different sides of the segment.
 //
-static bool P_CrossesStrace(const seg_t* seg) {
+static bool P_CrossesStrace(const sighttrace_t* trace, const seg_t* seg) {
     const line_t* line = seg->linedef;
     divline_t divl = {
         .x = line->v1->x,
@@ -201,14 +246,14 @@ static bool P_CrossesStrace(const seg_t* seg) {
 
     const vertex_t* v1 = line->v1;
     const vertex_t* v2 = line->v2;
-    int s1 = P_DivlineSide(v1->x, v1->y, &strace);
-    int s2 = P_DivlineSide(v2->x, v2->y, &strace);
+    int s1 = P_DivlineSide(v1->x, v1->y, &trace->strace);
+    int s2 = P_DivlineSide(v2->x, v2->y, &trace->strace);
     if (s1 == s2) {
         // endpoints of segment are on the same side of strace
         return false;
     }
-    s1 = P_DivlineSide(strace.x, strace.y, &divl);
-    s2 = P_DivlineSide(t2x, t2y, &divl);
+    s1 = P_DivlineSide(trace->strace.x, trace->strace.y, &divl);
+    s2 = P_DivlineSide(trace->t2x, trace->t2y, &divl);
     return s1 != s2;
 }
 
@@ -231,7 +276,7 @@ static void P_CalculateOpeningSpace(const seg_t* seg, fixed_t* top,
 // Returns true if the line of sight is vertically blocked (i.e., there's an
 // obstruction in the vertical direction), and false if it is clear.
 //
-static bool P_CheckVerticalObstruction(const seg_t* seg) {
+static bool P_CheckVerticalObstruction(sighttrace_t* trace, const seg_t* seg) {
     const sector_t* front = seg->frontsector;
     const sector_t* back = seg->backsector;
 
@@ -248,26 +293,26 @@ static bool P_CheckVerticalObstruction(const seg_t* seg) {
     // More info on this bug here:
     // https://doomwiki.org/wiki/Barrel_explosions_which_do_no_damage
     // https://www.doomworld.com/forum/topic/72743-theory-about-barrel-explosions-which-do-no-damage-bug/
-    fixed_t frac = P_InterceptVector2(&strace, &divl);
+    fixed_t frac = P_InterceptVector2(&trace->strace, &divl);
 
     fixed_t open_top;
     fixed_t open_bottom;
     P_CalculateOpeningSpace(seg, &open_top, &open_bottom);
 
     if (front->floorheight != back->floorheight) {
-        fixed_t slope = FixedDiv(open_bottom - sightzstart, frac);
-        if (slope > bottomslope) {
-            bottomslope = slope;
+        fixed_t slope = FixedDiv(open_bottom - trace->sightzstart, frac);
+        if (slope > trace->bottomslope) {
+            trace->bottomslope = slope;
         }
     }
     if (front->ceilingheight != back->ceilingheight) {
-        fixed_t slope = FixedDiv(open_top - sightzstart, frac);
-        if (slope < topslope) {
-            topslope = slope;
+        fixed_t slope = FixedDiv(open_top - trace->sightzstart, frac);
+        if (slope < trace->topslope) {
+            trace->topslope = slope;
         }
     }
 
-    return topslope <= bottomslope;
+    return trace->topslope <= trace->bottomslope;
 }
 
 static bool P_IsClosedDoor(const seg_t* seg) {
@@ -286,7 +331,7 @@ static bool P_HasSightBlockingWall(const seg_t *seg) {
            || front->ceilingheight != back->ceilingheight;
 }
 
-static bool P_TwoSidedBlocksStrace(const seg_t *seg) {
+static bool P_TwoSidedBlocksStrace(sighttrace_t* trace, const seg_t *seg) {
     if (!P_HasSightBlockingWall(seg)) {
         // no wall to block sight with
         return false;
@@ -294,11 +339,11 @@ static bool P_TwoSidedBlocksStrace(const seg_t *seg) {
     if (P_IsClosedDoor(seg)) {
         return true;
     }
-    return P_CheckVerticalObstruction(seg);
+    return P_CheckVerticalObstruction(trace, seg);
 }
 
-static bool P_BlocksStrace(const seg_t* seg) {
-    if (!P_CrossesStrace(seg)) {
+static bool P_BlocksStrace(sighttrace_t* trace, const seg_t* seg) {
+    if (!P_CrossesStrace(trace, seg)) {
         // Does not cross strace, so segment can't block it.
         return false;
     }
@@ -307,7 +352,7 @@ static bool P_BlocksStrace(const seg_t* seg) {
         return true;
     }
     if (P_IsTwoSided(seg)) {
-        return P_TwoSidedBlocksStrace(seg);
+        return P_TwoSidedBlocksStrace(trace, seg);
     }
     // All solid walls block strace.
     return true;
@@ -320,27 +365,29 @@ static bool P_BlocksStrace(const seg_t* seg) {
 // otherwise returns true.
 //
 // Parameters:
+//   - trace: The sight check in progress.
 //   - num: The index of the subsector to check.
 //
 // Returns:
 //   - bool: True if the strace crosses the subsector, false if blocked.
 //
-static bool P_CrossSubsector(int num) {
+static bool P_CrossSubsector(sighttrace_t* trace, int num) {
     if (num >= numsubsectors) {
         I_Error("P_CrossSubsector: ss %i with numss = %i", num, numsubsectors);
     }
+    sightcontext_t* context = trace->context;
     const subsector_t* sub = &subsectors[num];
     for (int i = 0; i < sub->numlines; i++) {
-        seg_t* seg = &segs[sub->firstline + i];
-        line_t* line = seg->linedef;
+        const seg_t* seg = &segs[sub->firstline + i];
+        int linenum = seg->linedef - lines;
 
-        if (line->validcount == validcount) {
+        if (context->linemarks[linenum] == context->mark) {
             // already checked other side
             continue;
         }
-        line->validcount = validcount;
+        context->linemarks[linenum] = context->mark;
 
-        if (P_BlocksStrace(seg)) {
+        if (P_BlocksStrace(trace, seg)) {
             return false;
         }
     }
@@ -353,54 +400,77 @@ static bool P_CrossSubsector(int num) {
 // P_CrossBSPNode
 // Returns true if strace crosses the given node successfully.
 //
-static bool P_CrossBSPNode(int bspnum) {
+static bool P_CrossBSPNode(sighttrace_t* trace, int bspnum) {
     if (bspnum & NF_SUBSECTOR) {
         if (bspnum == -1) {
-            return P_CrossSubsector(0);
+            return P_CrossSubsector(trace, 0);
         }
-        return P_CrossSubsector(bspnum & (~NF_SUBSECTOR));
+        return P_CrossSubsector(trace, bspnum & (~NF_SUBSECTOR));
     }
 
-    node_t* bsp = &nodes[bspnum];
+    const node_t* bsp = &nodes[bspnum];
 
     // decide which side the start point is on
-    int side = P_DivlineSide(strace.x, strace.y, (divline_t *) bsp);
+    int side = P_DivlineSide(trace->strace.x, trace->strace.y, (const divline_t *) bsp);
     if (side == 2) {
         // an "on" should cross both sides
         side = 0;
     }
 
     // cross the starting side
-    if (!P_CrossBSPNode(bsp->children[side])) {
+    if (!P_CrossBSPNode(trace, bsp->children[side])) {
         return false;
     }
 
     // the partition plane is crossed here
-    if (side == P_DivlineSide(t2x, t2y, (divline_t *) bsp)) {
+    if (side == P_DivlineSide(trace->t2x, trace->t2y, (const divline_t *) bsp)) {
         // the line doesn't touch the other side
         return true;
     }
 
     // cross the ending side
-    return P_CrossBSPNode(bsp->children[side ^ 1]);
+    return P_CrossBSPNode(trace, bsp->children[side ^ 1]);
 }
 
-static bool P_SightUnobstructed(const mobj_t* t1, const mobj_t* t2) {
-    validcount++;
+//
+// Starts a new check on the context. Lines marked by earlier checks on
+// it hold an older mark, so they count as unchecked.
+//
+static void P_BeginSightCheck(sightcontext_t* context) {
+    if (context->numlinemarks < numlines) {
+        context->linemarks = I_Realloc(context->linemarks,
+                                       numlines * sizeof(*context->linemarks));
+        memset(context->linemarks + context->numlinemarks, 0,
+               (numlines - context->numlinemarks) * sizeof(*context->linemarks));
+        context->numlinemarks = numlines;
+    }
+    if (context->mark == INT_MAX) {
+        memset(context->linemarks, 0,
+               context->numlinemarks * sizeof(*context->linemarks));
+        context->mark = 0;
+    }
+    context->mark++;
+}
 
-    sightzstart = t1->z + t1->height - (t1->height >> 2);
-    bottomslope = t2->z - sightzstart;
-    topslope = bottomslope + t2->height;
+static bool P_SightUnobstructed(sighttrace_t* trace, sightcontext_t* context,
+                                const mobj_t* t1, const mobj_t* t2)
+{
+    P_BeginSightCheck(context);
 
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
+    trace->context = context;
+    trace->sightzstart = t1->z + t1->height - (t1->height >> 2);
+    trace->bottomslope = t2->z - trace->sightzstart;
+    trace->topslope = trace->bottomslope + t2->height;
+
+    trace->strace.x = t1->x;
+    trace->strace.y = t1->y;
+    trace->t2x = t2->x;
+    trace->t2y = t2->y;
+    trace->strace.dx = t2->x - t1->x;
+    trace->strace.dy = t2->y - t1->y;
 
     // the head node is the last node output
-    return P_CrossBSPNode(numnodes - 1);
+    return P_CrossBSPNode(trace, numnodes - 1);
 }
 
 
@@ -415,12 +485,89 @@ static bool P_CheckRejectTable(const mobj_t* t1, const mobj_t* t2) {
     return (rejectmatrix[bytenum] & bitnum) != 0;
 }
 
+
 //
-// P_CheckSight
-// Returns true if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_InitSight
 //
-bool P_CheckSight(const mobj_t* t1, const mobj_t* t2) {
+void P_InitSight(void) {
+    //!
+    // @category obscure
+    //
+    // Run every sight check a second time through the batched check,
+    // and stop with an error if the two disagree.
+    //
+    checksight = M_ParmExists("-checksight");
+}
+
+void P_InvalidateSightCache(void) {
+    sightstamp++;
+}
+
+void P_SightCacheStats(uint64_t* hits, uint64_t* misses) {
+    *hits = sightcachehits;
+    *misses = sightcachemisses;
+}
+
+static sightcacheentry_t* P_SightCacheEntry(const mobj_t* t1, const mobj_t* t2) {
+    unsigned ss1 = t1->subsector - subsectors;
+    unsigned ss2 = t2->subsector - subsectors;
+
+    // 64 unit height buckets
+    unsigned zrange1 = (unsigned) t1->z >> (FRACBITS + 6);
+    unsigned zrange2 = (unsigned) t2->z >> (FRACBITS + 6);
+
+    unsigned hash = ss1 * 0x9e3779b1u;
+    hash ^= ss2 * 0x85ebca6bu;
+    hash ^= (zrange1 << 8 | zrange2) * 0xc2b2ae35u;
+    hash ^= hash >> 16;
+
+    return &sightcache[hash & (SIGHTCACHE_SIZE - 1)];
+}
+
+static bool P_SightCacheMatches(const sightcacheentry_t* entry,
+                                const mobj_t* t1, const mobj_t* t2)
+{
+    return entry->stamp == sightstamp
+           && entry->x1 == t1->x && entry->y1 == t1->y
+           && entry->z1 == t1->z && entry->height1 == t1->height
+           && entry->x2 == t2->x && entry->y2 == t2->y
+           && entry->z2 == t2->z && entry->height2 == t2->height;
+}
+
+static bool P_CachedSightUnobstructed(const mobj_t* t1, const mobj_t* t2) {
+    sightcacheentry_t* entry = P_SightCacheEntry(t1, t2);
+    if (P_SightCacheMatches(entry, t1, t2)) {
+        sightcachehits++;
+        topslope = entry->topslope;
+        bottomslope = entry->bottomslope;
+        return entry->visible;
+    }
+    sightcachemisses++;
+
+    sighttrace_t trace;
+    bool visible = P_SightUnobstructed(&trace, &sightcontext, t1, t2);
+
+    // Left for P_AimLineAttack, as before.
+    topslope = trace.topslope;
+    bottomslope = trace.bottomslope;
+
+    entry->stamp = sightstamp;
+    entry->x1 = t1->x;
+    entry->y1 = t1->y;
+    entry->z1 = t1->z;
+    entry->height1 = t1->height;
+    entry->x2 = t2->x;
+    entry->y2 = t2->y;
+    entry->z2 = t2->z;
+    entry->height2 = t2->height;
+    entry->topslope = trace.topslope;
+    entry->bottomslope = trace.bottomslope;
+    entry->visible = visible;
+
+    return visible;
+}
+
+static bool P_CheckSightOnce(const mobj_t* t1, const mobj_t* t2) {
     if (P_CheckRejectTable(t1, t2)) {
         // can't possibly be connected
         return false;
@@ -430,5 +577,78 @@ bool P_CheckSight(const mobj_t* t1, const mobj_t* t2) {
     if (gameversion <= exe_doom_1_2) {
         return P_SightUnobstructedOld(t1, t2);
     }
-    return P_SightUnobstructed(t1, t2);
+    return P_CachedSightUnobstructed(t1, t2);
+}
+
+//
+// Checks that a batch agrees with P_CheckSight, see -checksight. The
+// same pair is queried twice, so that repeated pairs are covered too.
+//
+static void P_VerifySight(const mobj_t* t1, const mobj_t* t2, bool visible) {
+    sightquery_t queries[2] = {
+        { t1, t2, !visible },
+        { t1, t2, !visible },
+    };
+    P_CheckSightBatch(&checkcontext, queries, 2);
+
+    for (int i = 0; i < 2; i++) {
+        if (queries[i].visible != visible) {
+            I_Error("P_CheckSight: batched check gave %d instead of %d "
+                    "(mobj types %d and %d)", queries[i].visible, visible,
+                    t1->type, t2->type);
+        }
+    }
+}
+
+//
+// P_CheckSight
+// Returns true if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+bool P_CheckSight(const mobj_t* t1, const mobj_t* t2) {
+    bool visible = P_CheckSightOnce(t1, t2);
+
+    // The Doom 1.2 check is not separate from P_CheckSight in a batch.
+    if (checksight && gameversion > exe_doom_1_2) {
+        P_VerifySight(t1, t2, visible);
+    }
+    return visible;
+}
+
+//
+// P_CheckSightBatch
+// Sets visible for each query to what P_CheckSight(looker, target) would
+// return. Only reads the level and the things, and keeps its own state in
+// the context, so several batches can run at once, each with its own
+// context. Does not touch topslope and bottomslope, or the sight cache.
+// With -gameversion 1.2 sight checks use P_PathTraverse, and then a batch
+// is neither of those.
+//
+void P_CheckSightBatch(sightcontext_t* context, sightquery_t* queries, int count) {
+    // Cheap REJECT lookups first, for the whole batch.
+    for (int i = 0; i < count; i++) {
+        queries[i].visible = !P_CheckRejectTable(queries[i].looker, queries[i].target);
+    }
+
+    for (int i = 0; i < count; i++) {
+        sightquery_t* query = &queries[i];
+        if (!query->visible) {
+            continue;
+        }
+        if (gameversion <= exe_doom_1_2) {
+            // P_PathTraverse uses globals, so this one is not reentrant.
+            query->visible = P_SightUnobstructedOld(query->looker, query->target);
+            continue;
+        }
+        if (i > 0 && query->looker == queries[i - 1].looker
+            && query->target == queries[i - 1].target)
+        {
+            // Same sightline again.
+            query->visible = queries[i - 1].visible;
+            continue;
+        }
+        sighttrace_t trace;
+        query->visible = P_SightUnobstructed(&trace, context, query->looker,
+                                             query->target);
+    }
 }
@@ -20,7 +20,12 @@
 
 #include "p_tick.h"
 
+#include <stddef.h>
+
 #include "doomstat.h"
+#include "i_profile.h"
+#include "i_system.h"
+#include "m_argv.h"
 #include "p_local.h"
 #include "z_zone.h"
 
@@ -29,9 +34,9 @@ int leveltime;
 
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc, so they can be operated on
-// uniformly. The actual structures will vary in size, but the first element
-// must be thinker_t.
+// All thinkers should be allocated by P_AllocThinker, so they can be
+// operated on uniformly. The actual structures will vary in size, but the
+// first element must be thinker_t.
 //
 
 
@@ -39,12 +44,181 @@ int leveltime;
 thinker_t thinkercap;
 
 
+//
+// THINKER POOLS
+// Thinkers of each kind are carved out of slabs of zone memory, so that
+// they sit next to each other, and are recycled through a free list
+// instead of going back to the zone. The slabs are PU_LEVEL, and all go
+// at once when the level is freed.
+//
+
+// Aim for slabs of about this many bytes.
+#define POOLSLABSIZE 16384
+
+typedef struct poolobject_s poolobject_t;
+
+typedef struct {
+    int size;
+    poolobject_t* freelist;
+} pool_t;
+
+// Every thinker is preceded by the pool it came from.
+struct poolobject_s {
+    pool_t* pool;
+    union {
+        poolobject_t* nextfree;
+        thinker_t thinker;
+    };
+};
+
+#define POOLHEADERSIZE offsetof(poolobject_t, thinker)
+
+static pool_t pools[NUMTHINKERPOOLS];
+
+static const char* thinkernames[NUMTHINKERPOOLS] = {
+    "P_MobjThinker",
+    "T_MoveCeiling",
+    "T_VerticalDoor",
+    "T_MoveFloor",
+    "T_PlatRaise",
+    "T_FireFlicker",
+    "T_LightFlash",
+    "T_StrobeFlash",
+    "T_Glow",
+};
+
+// Calls made by P_RunThinkers, by kind of thinker.
+static uint64_t thinkercalls[NUMTHINKERPOOLS];
+
+
+//
+// THINKER ARRAY
+// The thinkers are also kept in an array, in the same order as the list.
+// P_RunThinkers walks the array, which lets it fetch the next thinkers
+// ahead of time instead of following one pointer after another, and
+// drops removed thinkers by sliding the rest down as it goes. The list
+// is still kept for everything else that looks at the thinkers.
+//
+
+static thinker_t** thinkerarray = NULL;
+static int numthinkers = 0;
+static int maxthinkers = 0;
+
+// Walk the list, as the original code did, instead of the array.
+static bool listthinkers;
+
+// How far ahead of the thinker being run to fetch.
+#define THINKERPREFETCH 4
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+
+//
+// P_ClearThinkerPools
+// Forget all the slabs, once Z_FreeTags has freed them.
+//
+void P_ClearThinkerPools() {
+    for (int i = 0; i < NUMTHINKERPOOLS; i++) {
+        pools[i].freelist = NULL;
+    }
+}
+
+static void P_AddPoolSlab(pool_t* pool) {
+    int stride = (POOLHEADERSIZE + pool->size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    int count = POOLSLABSIZE / stride;
+    if (count < 16) {
+        count = 16;
+    }
+
+    byte* slab = Z_Malloc(count * stride, PU_LEVEL, NULL);
+
+    // Hand them out in address order.
+    for (int i = count - 1; i >= 0; i--) {
+        poolobject_t* object = (poolobject_t*) (slab + i * stride);
+        object->pool = pool;
+        object->nextfree = pool->freelist;
+        pool->freelist = object;
+    }
+}
+
+//
+// P_AllocThinker
+// Get the memory for a new thinker of the given kind. It is not cleared.
+//
+void* P_AllocThinker(thinkerpool_t type, int size) {
+    pool_t* pool = &pools[type];
+
+    if (pool->size == 0) {
+        pool->size = size;
+    } else if (pool->size != size) {
+        I_Error("P_AllocThinker: pool %d holds objects of %d bytes, not %d",
+                type, pool->size, size);
+    }
+
+    if (pool->freelist == NULL) {
+        P_AddPoolSlab(pool);
+    }
+    poolobject_t* object = pool->freelist;
+    pool->freelist = object->nextfree;
+
+    return &object->thinker;
+}
+
+static inline pool_t* P_ThinkerPool(thinker_t* thinker) {
+    return ((poolobject_t*) ((byte*) thinker - POOLHEADERSIZE))->pool;
+}
+
+//
+// P_ThinkerCalls
+// Number of times thinkers of a kind have been run, for profiling.
+//
+uint64_t P_ThinkerCalls(thinkerpool_t type) {
+    return thinkercalls[type];
+}
+
+const char* P_ThinkerName(thinkerpool_t type) {
+    return thinkernames[type];
+}
+
+//
+// P_FreeThinkerMemory
+// Give the memory of a thinker, which must not be in the thinker list,
+// back to its pool.
+//
+void P_FreeThinkerMemory(thinker_t* thinker) {
+    poolobject_t* object = (poolobject_t*) ((byte*) thinker - POOLHEADERSIZE);
+    pool_t* pool = P_ThinkerPool(thinker);
+
+    object->nextfree = pool->freelist;
+    pool->freelist = object;
+}
+
+
+//
+// P_InitThinkerArray
+//
+void P_InitThinkerArray() {
+    //!
+    // @category obscure
+    //
+    // Run the thinkers by walking the linked list, the way the original
+    // code did, rather than from an array. The order, and so the game, is
+    // the same either way; useful to check that it is.
+    //
+    listthinkers = M_ParmExists("-listthinkers");
+}
+
 //
 // P_InitThinkers
 //
 void P_InitThinkers() {
     thinkercap.prev = &thinkercap;
     thinkercap.next  = &thinkercap;
+    numthinkers = 0;
 }
 
 //
@@ -56,6 +230,13 @@ void P_AddThinker(thinker_t* thinker) {
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    if (numthinkers == maxthinkers) {
+        maxthinkers = maxthinkers ? maxthinkers * 2 : 1024;
+        thinkerarray = I_Realloc(thinkerarray, maxthinkers * sizeof(*thinkerarray));
+    }
+    thinkerarray[numthinkers] = thinker;
+    numthinkers++;
 }
 
 //
@@ -78,13 +259,17 @@ bool P_IsThinkerRemoved(thinker_t* thinker) {
 static void P_FreeThinker(thinker_t* thinker) {
     thinker->next->prev = thinker->prev;
     thinker->prev->next = thinker->next;
-    Z_Free(thinker);
+    P_FreeThinkerMemory(thinker);
 }
 
-//
-// P_RunThinkers
-//
-void P_RunThinkers() {
+static inline void P_RunThinker(thinker_t* thinker) {
+    if (thinker->function.acp1) {
+        thinkercalls[P_ThinkerPool(thinker) - pools]++;
+        thinker->function.acp1(thinker);
+    }
+}
+
+static void P_RunThinkerList() {
     thinker_t* current_thinker = thinkercap.next;
     thinker_t* next_thinker;
 
@@ -94,14 +279,56 @@ void P_RunThinkers() {
             next_thinker = current_thinker->next;
             P_FreeThinker(current_thinker);
 	} else {
-	    if (current_thinker->function.acp1) {
-                current_thinker->function.acp1(current_thinker);
-            }
+            P_RunThinker(current_thinker);
             // "acp1" can actually change the thinker list.
             next_thinker = current_thinker->next;
 	}
         current_thinker = next_thinker;
     }
+
+    // The list has lost the removed thinkers; make the array match.
+    numthinkers = 0;
+    for (thinker_t* th = thinkercap.next; th != &thinkercap; th = th->next) {
+        thinkerarray[numthinkers] = th;
+        numthinkers++;
+    }
+}
+
+static void P_RunThinkerArray() {
+    int kept = 0;
+
+    // Thinkers spawned while this runs are added to the end, and run in
+    // the same tic, as they would be from the list.
+    for (int i = 0; i < numthinkers; i++) {
+        if (i + THINKERPREFETCH < numthinkers) {
+            PREFETCH(thinkerarray[i + THINKERPREFETCH]);
+        }
+
+        thinker_t* thinker = thinkerarray[i];
+        if (P_IsThinkerRemoved(thinker)) {
+            // Time to free it.
+            P_FreeThinker(thinker);
+            continue;
+        }
+        thinkerarray[kept] = thinker;
+        kept++;
+
+        P_RunThinker(thinker);
+    }
+    numthinkers = kept;
+}
+
+//
+// P_RunThinkers
+//
+void P_RunThinkers() {
+    PROFILE_BEGIN("P_RunThinkers");
+    if (listthinkers) {
+        P_RunThinkerList();
+    } else {
+        P_RunThinkerArray();
+    }
+    PROFILE_END("P_RunThinkers");
 }
 
 static void P_UpdateLevelTime() {
@@ -136,6 +363,7 @@ void P_Ticker() {
     if (P_IsGamePaused()) {
         return;
     }
+    P_InvalidateSightCache();
     P_RunPlayersThinker();
     P_RunThinkers();
     P_UpdateSpecials();
@@ -31,8 +31,9 @@ side_t* sidedef;
 line_t* linedef;
 sector_t* frontsector;
 sector_t* backsector;
-drawseg_t drawsegs[MAXDRAWSEGS];
-drawseg_t *ds_p;
+drawseg_t* drawsegs;
+drawseg_t* ds_p;
+static int maxdrawsegs;
 
 
 void R_RenderWallRange(int start, int stop);
@@ -42,9 +43,27 @@ void R_RenderWallRange(int start, int stop);
 // R_ClearDrawSegs
 //
 void R_ClearDrawSegs(void) {
+    if (drawsegs == NULL) {
+        maxdrawsegs = MAXDRAWSEGS;
+        drawsegs = I_Realloc(NULL, maxdrawsegs * sizeof(*drawsegs));
+    }
     ds_p = drawsegs;
 }
 
+//
+// R_CheckDrawSegs
+// Make room for one more drawseg.
+//
+void R_CheckDrawSegs(void) {
+    int count = ds_p - drawsegs;
+    if (count < maxdrawsegs) {
+        return;
+    }
+    maxdrawsegs *= 2;
+    drawsegs = I_Realloc(drawsegs, maxdrawsegs * sizeof(*drawsegs));
+    ds_p = drawsegs + count;
+}
+
 
 
 //
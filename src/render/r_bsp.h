@@ -27,13 +27,14 @@ extern line_t*		linedef;
 extern sector_t*	frontsector;
 extern sector_t*	backsector;
 
-extern drawseg_t	drawsegs[MAXDRAWSEGS];
+extern drawseg_t*	drawsegs;
 extern drawseg_t*	ds_p;
 
 
 // BSP?
 void R_ClearClipSegs();
 void R_ClearDrawSegs();
+void R_CheckDrawSegs(void);
 
 
 void R_RenderSectors();
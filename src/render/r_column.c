@@ -29,15 +29,15 @@
 // R_DrawColumn
 // Source is the top of the column to scale.
 //
-lighttable_t* dc_colormap;
-int dc_x;
-int dc_yl;
-int dc_yh;
-fixed_t dc_iscale;
-fixed_t dc_texturemid;
+THREAD_LOCAL lighttable_t* dc_colormap;
+THREAD_LOCAL int dc_x;
+THREAD_LOCAL int dc_yl;
+THREAD_LOCAL int dc_yh;
+THREAD_LOCAL fixed_t dc_iscale;
+THREAD_LOCAL fixed_t dc_texturemid;
 
 // first pixel in a column (possibly virtual)
-const byte* dc_source;
+THREAD_LOCAL const byte* dc_source;
 
 
 void R_DrawColumn() {
@@ -100,3 +100,57 @@ void R_DrawColumnLow() {
         R_DrawPixel(x + 1, y, color);
     }
 }
+
+//
+// R_DrawColumnFast
+// Same output as R_DrawColumn, but the destination address is computed once
+// and then stepped one row at a time, and the texture coordinate is stepped
+// instead of being recomputed from scratch for every pixel.
+//
+void R_DrawColumnFast() {
+    int count = dc_yh - dc_yl;
+
+    // Zero length, column does not exceed a pixel.
+    if (count < 0) {
+        return;
+    }
+    if ((unsigned) dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+        I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+    }
+
+    pixel_t* dest = R_ScreenPointer(dc_x, dc_yl);
+    fixed_t frac = dc_texturemid + ((dc_yl - centery) * dc_iscale);
+
+    do {
+        *dest = dc_colormap[dc_source[(frac >> FRACBITS) & 127]];
+        dest += SCREENWIDTH;
+        frac += dc_iscale;
+    } while (count--);
+}
+
+//
+// Low detail version of R_DrawColumnFast above.
+//
+void R_DrawColumnLowFast() {
+    int count = dc_yh - dc_yl;
+
+    // Zero length.
+    if (count < 0) {
+        return;
+    }
+    if ((unsigned) dc_x >= SCREENWIDTH || dc_yl < 0 || dc_yh >= SCREENHEIGHT) {
+        I_Error("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+    }
+
+    // Blocky mode, need to multiply by 2.
+    pixel_t* dest = R_ScreenPointer(dc_x << 1, dc_yl);
+    fixed_t frac = dc_texturemid + ((dc_yl - centery) * dc_iscale);
+
+    do {
+        pixel_t color = dc_colormap[dc_source[(frac >> FRACBITS) & 127]];
+        dest[0] = color;
+        dest[1] = color;
+        dest += SCREENWIDTH;
+        frac += dc_iscale;
+    } while (count--);
+}
@@ -23,15 +23,16 @@
 #include "r_fuzz_column.h"
 #include "r_player_column.h"
 
-extern lighttable_t *dc_colormap;
-extern int dc_x;
-extern int dc_yl;
-extern int dc_yh;
-extern fixed_t dc_iscale;
-extern fixed_t dc_texturemid;
+// Drawer inputs are per thread, see r_threads.c.
+extern THREAD_LOCAL lighttable_t *dc_colormap;
+extern THREAD_LOCAL int dc_x;
+extern THREAD_LOCAL int dc_yl;
+extern THREAD_LOCAL int dc_yh;
+extern THREAD_LOCAL fixed_t dc_iscale;
+extern THREAD_LOCAL fixed_t dc_texturemid;
 
 // first pixel in a column
-extern const byte *dc_source;
+extern THREAD_LOCAL const byte *dc_source;
 
 
 // The span blitting interface.
@@ -39,4 +40,8 @@ extern const byte *dc_source;
 void R_DrawColumn();
 void R_DrawColumnLow();
 
+// Pixel-identical to the above, using direct pointer stepping.
+void R_DrawColumnFast();
+void R_DrawColumnLowFast();
+
 #endif
@@ -31,15 +31,23 @@
 //
 //
 
+#include <stdint.h>
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
 
 #include "deh_str.h"
+#include "i_parallel.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "m_argv.h"
+#include "m_config.h"
+#include "sha1.h"
 #include "z_zone.h"
 
 
+#include "w_checksum.h"
+#include "w_prefetch.h"
 #include "w_wad.h"
 
 #include "doomdef.h"
@@ -220,6 +228,41 @@ static void R_DrawColumnInCache(column_t* column, byte* cache, int originy,
     }
 }
 
+//
+// Draw one patch of a texture into the columns of its composite that are
+// covered by more than one patch. Does not touch the zone, so composites
+// can be built on worker threads.
+//
+static void R_DrawPatchInComposite(int texnum, byte* block,
+                                   const texpatch_t* texture_patch,
+                                   const patch_t* patch)
+{
+    const texture_t* texture = textures[texnum];
+    const short* collump = texturecolumnlump[texnum];
+    const unsigned short* colofs = texturecolumnofs[texnum];
+
+    int x1 = texture_patch->originx;
+    int x2 = x1 + SHORT(patch->width);
+    int x = (x1 < 0) ? 0 : x1;
+    if (x2 > texture->width) {
+        x2 = texture->width;
+    }
+
+    for (; x < x2; x++) {
+        if (collump[x] >= 0) {
+            // Column does not have multiple patches.
+            continue;
+        }
+
+        column_t* column = GET_COLUMN(patch, x - x1);
+        byte* cache = block + colofs[x];
+        int originy = texture_patch->originy;
+        int cacheheight = texture->height;
+
+        R_DrawColumnInCache(column, cache, originy, cacheheight);
+    }
+}
+
 //
 // R_GenerateComposite
 // Using the texture definition, the composite texture is created from the
@@ -227,8 +270,6 @@ static void R_DrawColumnInCache(column_t* column, byte* cache, int originy,
 //
 static void R_GenerateComposite(int texnum) {
     const texture_t* texture = textures[texnum];
-    const short* collump = texturecolumnlump[texnum];
-    const unsigned short* colofs = texturecolumnofs[texnum];
 
     byte* block = Z_Malloc(texturecompositesize[texnum], PU_STATIC,
                            &texturecomposite[texnum]);
@@ -236,28 +277,8 @@ static void R_GenerateComposite(int texnum) {
     // Composite the columns together.
     for (int i = 0; i < texture->patchcount; i++) {
         const texpatch_t* texture_patch = &texture->patches[i];
-        patch_t* patch = W_CacheLumpNum(texture_patch->patch, PU_CACHE);
-
-        int x1 = texture_patch->originx;
-        int x2 = x1 + SHORT(patch->width);
-        int x = (x1 < 0) ? 0 : x1;
-        if (x2 > texture->width) {
-            x2 = texture->width;
-        }
-
-        for (; x < x2; x++) {
-            if (collump[x] >= 0) {
-                // Column does not have multiple patches.
-                continue;
-            }
-
-            column_t* column = GET_COLUMN(patch, x - x1);
-            byte* cache = block + colofs[x];
-            int originy = texture_patch->originy;
-            int cacheheight = texture->height;
-
-            R_DrawColumnInCache(column, cache, originy, cacheheight);
-        }
+        const patch_t* patch = W_CacheLumpNum(texture_patch->patch, PU_CACHE);
+        R_DrawPatchInComposite(texnum, block, texture_patch, patch);
     }
 
     // Now that the texture has been built in column cache,
@@ -329,6 +350,14 @@ static void R_GenerateLookup(int texnum) {
     const texture_t* texture = textures[texnum];
     short width = texture->width;
 
+    // Allocate lumps needed for each texture column
+    size_t size = width * sizeof(**texturecolumnlump);
+    texturecolumnlump[texnum] = Z_Malloc((int) size, PU_STATIC, NULL);
+
+    // Allocate texture offsets
+    size = width * sizeof(**texturecolumnofs);
+    texturecolumnofs[texnum] = Z_Malloc((int) size, PU_STATIC, NULL);
+
     byte* patchcount = (byte *) Z_Malloc(width, PU_STATIC, &patchcount);
     memset(patchcount, 0, width);
 
@@ -490,14 +519,6 @@ static void R_InitTextureData(int tex_num, texture_t* texture) {
     // Save texture in textures array
     textures[tex_num] = texture;
 
-    // Allocate lumps needed for each texture column
-    size_t size = width * sizeof(**texturecolumnlump);
-    texturecolumnlump[tex_num] = Z_Malloc((int) size, PU_STATIC, NULL);
-
-    // Allocate texture offsets
-    size = width * sizeof(**texturecolumnofs);
-    texturecolumnofs[tex_num] = Z_Malloc((int) size, PU_STATIC, NULL);
-
     // Set texture width mask
     // Nearest power of two
     int j = 1 << ((int) log2(width));
@@ -605,6 +626,334 @@ static void R_AllocTextureDefinitions() {
     numtextures = numtextures1 + numtextures2;
 }
 
+//
+// TEXTURE CACHE
+// The column lookups of every texture, and the composites of those that
+// need one, are saved to a file keyed by the loaded WADs. The next start
+// with the same WADs maps the file and points into it, instead of reading
+// every patch again to build the lookups. The file is only ever used by
+// the machine that wrote it, so it is in native byte order.
+//
+
+#define TEXCACHE_MAGIC "BRMTEXC"
+#define TEXCACHE_VERSION 1
+#define TEXCACHE_BYTEORDER 0x01020304
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    sha1_digest_t key;
+    int32_t numtextures;
+    uint32_t length;
+} texcacheheader_t;
+
+// Offsets are from the start of the file; composite is 0 if there is none.
+typedef struct {
+    int32_t width;
+    int32_t compositesize;
+    uint32_t columnlump;
+    uint32_t columnofs;
+    uint32_t composite;
+} texcacheentry_t;
+
+// NULL if the cache is disabled.
+static char* texcachepath;
+
+// Kept open while the lookups point into its mapping.
+static wad_file_t* texcachefile;
+
+static void R_InitTextureCache() {
+    //!
+    // @category obscure
+    //
+    // Do not use the texture cache; build the texture lookups from
+    // the patches at every start.
+    //
+    if (M_ParmExists("-notexcache")) {
+        return;
+    }
+
+    //!
+    // @category obscure
+    // @arg <file>
+    //
+    // Keep the texture cache in the given file. The default is
+    // texture.cache in the configuration directory.
+    //
+    int p = M_CheckParmWithArgs("-texcache", 1);
+    if (p > 0) {
+        texcachepath = M_StringDuplicate(myargv[p + 1]);
+    } else {
+        texcachepath = M_StringJoin(configdir, "texture.cache", NULL);
+    }
+}
+
+//
+// The cache is keyed by the WAD directory, the lump names dehacked may
+// have replaced, and the size and modification time of every WAD file,
+// since W_Checksum would not notice a patch edited in place.
+//
+static void R_TextureCacheKey(sha1_digest_t key) {
+    sha1_digest_t directory;
+    W_Checksum(directory);
+
+    sha1_context_t context;
+    SHA1_Init(&context);
+    SHA1_Update(&context, directory, sizeof(directory));
+    SHA1_UpdateString(&context, (char *) DEH_String("TEXTURE1"));
+    SHA1_UpdateString(&context, (char *) DEH_String("TEXTURE2"));
+    SHA1_UpdateString(&context, (char *) DEH_String("PNAMES"));
+
+    const wad_file_t* last = NULL;
+    for (unsigned int i = 0; i < numlumps; i++) {
+        const wad_file_t* wad = lumpinfo[i]->wad_file;
+        if (wad == last) {
+            continue;
+        }
+        last = wad;
+
+        struct stat st;
+        SHA1_UpdateString(&context, (char *) wad->path);
+        SHA1_UpdateInt32(&context, wad->length);
+        if (M_stat(wad->path, &st) == 0) {
+            SHA1_UpdateInt32(&context, (unsigned int) st.st_mtime);
+        }
+    }
+
+    SHA1_Final(key, &context);
+}
+
+static bool R_TextureCacheRangeValid(uint32_t offset, size_t size,
+                                     uint32_t length)
+{
+    return offset % sizeof(int32_t) == 0 && offset <= length
+           && size <= length - offset;
+}
+
+//
+// Every column has to point at a lump that exists and a column inside it,
+// or inside the composite, or R_GetColumn would read out of bounds.
+//
+static bool R_TextureCacheColumnsValid(int texnum, const byte* data,
+                                       const texcacheentry_t* entry)
+{
+    const texture_t* texture = textures[texnum];
+    const short* collump = (const short *) (data + entry->columnlump);
+    const unsigned short* colofs = (const unsigned short *) (data + entry->columnofs);
+
+    for (int x = 0; x < texture->width; x++) {
+        int lump = collump[x];
+        int ofs = colofs[x];
+
+        if (lump == -1) {
+            if (ofs + texture->height > entry->compositesize) {
+                return false;
+            }
+        } else if (lump <= 0 || (unsigned int) lump >= numlumps
+                   || ofs + sizeof(column_t) > (size_t) W_LumpLength(lump)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool R_TextureCacheValid(const byte* data, uint32_t length,
+                                const sha1_digest_t key)
+{
+    const texcacheheader_t* header = (const texcacheheader_t *) data;
+    size_t tablesize = sizeof(*header) + numtextures * sizeof(texcacheentry_t);
+
+    if (length < tablesize
+        || memcmp(header->magic, TEXCACHE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != TEXCACHE_VERSION
+        || header->byteorder != TEXCACHE_BYTEORDER
+        || memcmp(header->key, key, sizeof(sha1_digest_t)) != 0
+        || header->numtextures != numtextures
+        || header->length != length)
+    {
+        return false;
+    }
+
+    const texcacheentry_t* entries = (const texcacheentry_t *) (header + 1);
+    for (int i = 0; i < numtextures; i++) {
+        const texcacheentry_t* entry = &entries[i];
+        int width = textures[i]->width;
+
+        if (entry->width != width
+            || entry->compositesize < 0 || entry->compositesize > 0x10000
+            || !R_TextureCacheRangeValid(entry->columnlump,
+                                         width * sizeof(**texturecolumnlump), length)
+            || !R_TextureCacheRangeValid(entry->columnofs,
+                                         width * sizeof(**texturecolumnofs), length)
+            || (entry->composite != 0
+                && !R_TextureCacheRangeValid(entry->composite,
+                                             entry->compositesize, length))
+            || !R_TextureCacheColumnsValid(i, data, entry))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Point the texture lookups and composites into the cache file. Returns
+// false if there is no usable cache for the loaded WADs.
+//
+static bool R_LoadTextureCache(const sha1_digest_t key) {
+    if (!M_FileExists(texcachepath)) {
+        return false;
+    }
+    wad_file_t* file = W_OpenFile(texcachepath);
+    if (file == NULL) {
+        return false;
+    }
+
+    // Without a mapping, read the whole file into the zone.
+    byte* data = file->mapped;
+    if (data == NULL) {
+        data = Z_Malloc(file->length, PU_STATIC, NULL);
+        if (W_Read(file, 0, data, file->length) < file->length) {
+            Z_Free(data);
+            W_CloseFile(file);
+            return false;
+        }
+    }
+
+    if (!R_TextureCacheValid(data, file->length, key)) {
+        if (file->mapped == NULL) {
+            Z_Free(data);
+        }
+        W_CloseFile(file);
+        return false;
+    }
+
+    const texcacheentry_t* entries =
+        (const texcacheentry_t *) (data + sizeof(texcacheheader_t));
+    for (int i = 0; i < numtextures; i++) {
+        const texcacheentry_t* entry = &entries[i];
+        texturecolumnlump[i] = (short *) (data + entry->columnlump);
+        texturecolumnofs[i] = (unsigned short *) (data + entry->columnofs);
+        texturecompositesize[i] = entry->compositesize;
+        texturecomposite[i] = entry->composite != 0 ? data + entry->composite
+                                                    : NULL;
+    }
+
+    if (file->mapped != NULL) {
+        texcachefile = file;
+    } else {
+        W_CloseFile(file);
+    }
+    return true;
+}
+
+static uint32_t R_TextureCacheAlign(uint32_t offset) {
+    return (offset + sizeof(int32_t) - 1) & ~(uint32_t) (sizeof(int32_t) - 1);
+}
+
+//
+// Write the lookups just generated, and the composites built from them,
+// to the cache file. Written to a temporary file and renamed, so other
+// instances starting at the same time never see a partial file.
+//
+static void R_SaveTextureCache(const sha1_digest_t key) {
+    uint32_t length = sizeof(texcacheheader_t) + numtextures * sizeof(texcacheentry_t);
+    texcacheentry_t* entries = I_Realloc(NULL, numtextures * sizeof(*entries));
+
+    for (int i = 0; i < numtextures; i++) {
+        texcacheentry_t* entry = &entries[i];
+        int width = textures[i]->width;
+
+        entry->width = width;
+        entry->compositesize = texturecompositesize[i];
+        entry->columnlump = R_TextureCacheAlign(length);
+        length = entry->columnlump + width * sizeof(**texturecolumnlump);
+        entry->columnofs = R_TextureCacheAlign(length);
+        length = entry->columnofs + width * sizeof(**texturecolumnofs);
+        entry->composite = 0;
+        if (texturecompositesize[i] > 0) {
+            entry->composite = R_TextureCacheAlign(length);
+            length = entry->composite + texturecompositesize[i];
+        }
+    }
+
+    byte* data = I_Realloc(NULL, length);
+    memset(data, 0, length);
+
+    texcacheheader_t* header = (texcacheheader_t *) data;
+    memcpy(header->magic, TEXCACHE_MAGIC, sizeof(header->magic));
+    header->version = TEXCACHE_VERSION;
+    header->byteorder = TEXCACHE_BYTEORDER;
+    memcpy(header->key, key, sizeof(sha1_digest_t));
+    header->numtextures = numtextures;
+    header->length = length;
+    memcpy(header + 1, entries, numtextures * sizeof(*entries));
+
+    for (int i = 0; i < numtextures; i++) {
+        const texcacheentry_t* entry = &entries[i];
+        const texture_t* texture = textures[i];
+
+        memcpy(data + entry->columnlump, texturecolumnlump[i],
+               texture->width * sizeof(**texturecolumnlump));
+        memcpy(data + entry->columnofs, texturecolumnofs[i],
+               texture->width * sizeof(**texturecolumnofs));
+
+        if (entry->composite != 0) {
+            for (int j = 0; j < texture->patchcount; j++) {
+                const texpatch_t* texture_patch = &texture->patches[j];
+                const patch_t* patch = W_CacheLumpNum(texture_patch->patch, PU_CACHE);
+                R_DrawPatchInComposite(i, data + entry->composite, texture_patch, patch);
+            }
+        }
+    }
+
+    char suffix[32];
+    M_snprintf(suffix, sizeof(suffix), ".%lx.tmp",
+               (unsigned long) ((uintptr_t) data ^ (uintptr_t) time(NULL)));
+    char* temp = M_StringJoin(texcachepath, suffix, NULL);
+
+    if (M_WriteFile(temp, data, length)) {
+#ifdef _WIN32
+        M_remove(texcachepath);
+#endif
+        if (M_rename(temp, texcachepath) != 0) {
+            M_remove(temp);
+        }
+    }
+
+    free(temp);
+    free(data);
+    free(entries);
+}
+
+//
+// Fill in the column lookups of every texture, from the cache if it
+// matches the loaded WADs, otherwise from the patches.
+//
+static void R_InitTextureLookups() {
+    sha1_digest_t key;
+
+    R_InitTextureCache();
+    if (texcachepath != NULL) {
+        R_TextureCacheKey(key);
+        if (R_LoadTextureCache(key)) {
+            return;
+        }
+    }
+
+    // Precalculate whatever possible.
+    for (int i = 0; i < numtextures; i++) {
+        R_GenerateLookup(i);
+    }
+
+    if (texcachepath != NULL) {
+        R_SaveTextureCache(key);
+    }
+}
+
 //
 // R_InitTextures
 // Initializes the texture list with the textures from the world map.
@@ -623,10 +972,7 @@ static void R_InitTextures() {
     R_FreeTextureDefinitions();
     Z_Free(patchlookup);
 
-    // Precalculate whatever possible.
-    for (int i = 0; i < numtextures; i++) {
-        R_GenerateLookup(i);
-    }
+    R_InitTextureLookups();
 
     R_InitTranslationTable();
     GenerateTextureHashTable();
@@ -771,8 +1117,40 @@ int R_TextureNumForName(const char *name) {
 
 //
 // R_PrecacheLevel
-// Preloads all relevant graphics for the level.
+// Preloads all relevant graphics for the level. The lumps are gathered
+// first and read together by W_PrefetchLumps, then the composites of
+// the textures in use are built on worker threads.
 //
+
+// Zone memory held at once by composites being built and their patches.
+#define COMPOSITE_BATCH_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+    int texnum;
+    byte* block;
+    int firstpatch;
+} compositejob_t;
+
+typedef struct {
+    compositejob_t* jobs;
+    int numjobs;
+    const patch_t** patches;
+    int numpatches;
+} compositebatch_t;
+
+static lumpindex_t* precachelumps;
+static int numprecachelumps;
+static int maxprecachelumps;
+
+static void R_AddPrecacheLump(int lump) {
+    if (numprecachelumps == maxprecachelumps) {
+        maxprecachelumps = maxprecachelumps ? maxprecachelumps * 2 : 1024;
+        precachelumps = I_Realloc(precachelumps,
+                                  maxprecachelumps * sizeof(*precachelumps));
+    }
+    precachelumps[numprecachelumps++] = lump;
+}
+
 static void R_PrecacheSprites() {
     char* spritepresent = Z_Malloc(numsprites, PU_STATIC, NULL);
     memset(spritepresent, 0, numsprites);
@@ -792,8 +1170,7 @@ static void R_PrecacheSprites() {
         for (int j = 0; j < sprites[i].numframes; j++) {
             const spriteframe_t* sf = &sprites[i].spriteframes[j];
             for (int k = 0; k < 8; k++) {
-                int lump = firstspritelump + sf->lump[k];
-                W_CacheLumpNum(lump, PU_CACHE);
+                R_AddPrecacheLump(firstspritelump + sf->lump[k]);
             }
         }
     }
@@ -801,7 +1178,7 @@ static void R_PrecacheSprites() {
     Z_Free(spritepresent);
 }
 
-static void R_PrecacheTextures() {
+static char* R_FindLevelTextures() {
     char* texturepresent = Z_Malloc(numtextures, PU_STATIC, NULL);
     memset(texturepresent, 0, numtextures);
     for (int i = 0; i < numsides; i++) {
@@ -816,18 +1193,19 @@ static void R_PrecacheTextures() {
     // an episode dependent name.
     texturepresent[sky_tex] = 1;
 
+    return texturepresent;
+}
+
+static void R_PrecacheTextures(const char* texturepresent) {
     for (int i = 0; i < numtextures; i++) {
         if (texturepresent[i] == 0) {
             continue;
         }
         const texture_t* texture = textures[i];
         for (int j = 0; j < texture->patchcount; j++) {
-            int lump = texture->patches[j].patch;
-            W_CacheLumpNum(lump, PU_CACHE);
+            R_AddPrecacheLump(texture->patches[j].patch);
         }
     }
-
-    Z_Free(texturepresent);
 }
 
 //
@@ -844,19 +1222,104 @@ static void R_PrecacheFlats() {
 
     for (int i = 0; i < numflats; i++) {
         if (flatpresent[i]) {
-            int lump = firstflat + i;
-            W_CacheLumpNum(lump, PU_CACHE);
+            R_AddPrecacheLump(firstflat + i);
         }
     }
 
     Z_Free(flatpresent);
 }
 
-void R_PrecacheLevel() {
-    if (demoplayback) {
-        return;
+static void R_CompositeWorker(void* data, int index) {
+    const compositebatch_t* batch = data;
+    const compositejob_t* job = &batch->jobs[index];
+    const texture_t* texture = textures[job->texnum];
+
+    for (int i = 0; i < texture->patchcount; i++) {
+        R_DrawPatchInComposite(job->texnum, job->block, &texture->patches[i],
+                               batch->patches[job->firstpatch + i]);
+    }
+}
+
+//
+// Build the composites of a batch on all CPUs, then make them and the
+// patches they were built from purgable again.
+//
+static void R_BuildCompositeBatch(compositebatch_t* batch) {
+    I_ParallelFor(batch->numjobs, I_GetCPUCount(), R_CompositeWorker, batch);
+
+    for (int i = 0; i < batch->numjobs; i++) {
+        const compositejob_t* job = &batch->jobs[i];
+        const texture_t* texture = textures[job->texnum];
+
+        Z_ChangeTag(job->block, PU_CACHE);
+        for (int j = 0; j < texture->patchcount; j++) {
+            W_ReleaseLumpNum(texture->patches[j].patch);
+        }
+    }
+
+    batch->numjobs = 0;
+    batch->numpatches = 0;
+}
+
+//
+// Generate the composites of the textures in use, so that R_GetColumn
+// does not have to while the level is drawn. The zone is only touched
+// here, on the main thread: the patches are locked with PU_STATIC and
+// the composite blocks allocated before the workers start.
+//
+static void R_PrecacheComposites(const char* texturepresent) {
+    compositebatch_t batch = {0};
+    int maxpatches = 0;
+    int batchbytes = 0;
+
+    batch.jobs = I_Realloc(NULL, numtextures * sizeof(*batch.jobs));
+
+    for (int i = 0; i < numtextures; i++) {
+        if (texturepresent[i] == 0 || texturecompositesize[i] == 0
+            || texturecomposite[i] != NULL)
+        {
+            continue;
+        }
+
+        const texture_t* texture = textures[i];
+        if (batch.numpatches + texture->patchcount > maxpatches) {
+            maxpatches = (batch.numpatches + texture->patchcount) * 2;
+            batch.patches = I_Realloc(batch.patches,
+                                      maxpatches * sizeof(*batch.patches));
+        }
+
+        compositejob_t* job = &batch.jobs[batch.numjobs++];
+        job->texnum = i;
+        job->firstpatch = batch.numpatches;
+        for (int j = 0; j < texture->patchcount; j++) {
+            int lump = texture->patches[j].patch;
+            batch.patches[batch.numpatches++] = W_CacheLumpNum(lump, PU_STATIC);
+            batchbytes += W_LumpLength(lump);
+        }
+        job->block = Z_Malloc(texturecompositesize[i], PU_STATIC,
+                              &texturecomposite[i]);
+        batchbytes += texturecompositesize[i];
+
+        if (batchbytes >= COMPOSITE_BATCH_BYTES) {
+            R_BuildCompositeBatch(&batch);
+            batchbytes = 0;
+        }
     }
+    R_BuildCompositeBatch(&batch);
+
+    free(batch.patches);
+    free(batch.jobs);
+}
+
+void R_PrecacheLevel() {
+    numprecachelumps = 0;
+
+    char* texturepresent = R_FindLevelTextures();
     R_PrecacheFlats();
-    R_PrecacheTextures();
+    R_PrecacheTextures(texturepresent);
     R_PrecacheSprites();
+    W_PrefetchLumps(precachelumps, numprecachelumps);
+
+    R_PrecacheComposites(texturepresent);
+    Z_Free(texturepresent);
 }
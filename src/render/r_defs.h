@@ -81,11 +81,22 @@ typedef struct
 } degenmobj_t;
 
 
+//
+// A two-sided line of a sector, and the sector on the other side of it,
+// which sound can travel through.
+//
+typedef struct
+{
+    struct sector_s* other;
+    struct line_s* line;
+    bool soundblock;
+} soundedge_t;
+
 //
 // The SECTORS record, at runtime.
 // Stores things/mobjs.
 //
-typedef struct
+typedef struct sector_s
 {
     fixed_t floorheight;
     fixed_t ceilingheight;
@@ -123,6 +134,15 @@ typedef struct
 
     // [linecount] size
     struct line_s** lines;
+
+    // The sectors on the other side of the two-sided lines, in the same
+    // order as lines; see getNextSector.
+    int neighbourcount;
+    struct sector_s** neighbours;
+
+    // The two-sided lines, in the same order as lines.
+    int soundedgecount;
+    soundedge_t* soundedges;
 } sector_t;
 
 
@@ -409,8 +429,11 @@ typedef struct
 // one visplane). Each X position in the visplane has a particular vertical
 // line of texture which is to be drawn.
 // 
-typedef struct
+typedef struct visplane_s
 {
+    // Next plane in the same hash bucket.
+    struct visplane_s* next;
+
     fixed_t height;
     int picnum;
     int lightlevel;
@@ -41,7 +41,35 @@ static int fuzzoffset[FUZZTABLE] = {
     FUZZOFF
 };
 
-static int fuzzpos = 0;
+// Per thread, so that the worker threads can each be given the position a
+// queued column starts at. See r_threads.c.
+static THREAD_LOCAL int fuzzpos = 0;
+
+
+int R_GetFuzzPos() {
+    return fuzzpos;
+}
+
+void R_SetFuzzPos(int pos) {
+    fuzzpos = pos;
+}
+
+//
+// Advance the fuzz table position as if the current column had been drawn
+// by R_DrawFuzzColumn, without drawing anything.
+//
+void R_SkipFuzzColumn() {
+    if (dc_yh < dc_yl) {
+        return;
+    }
+
+    int yl = (dc_yl < FUZZOFF) ? FUZZOFF : dc_yl;
+    int yh = (dc_yh >= viewheight - FUZZOFF) ? viewheight - FUZZOFF - 1 : dc_yh;
+
+    if (yl <= yh) {
+        fuzzpos = (fuzzpos + (yh - yl + 1)) % FUZZTABLE;
+    }
+}
 
 
 void R_DrawFuzzColumn() {
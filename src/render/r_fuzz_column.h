@@ -23,4 +23,9 @@
 void R_DrawFuzzColumn();
 void R_DrawFuzzColumnLow();
 
+// Position in the fuzz table, which carries over from column to column.
+int R_GetFuzzPos();
+void R_SetFuzzPos(int pos);
+void R_SkipFuzzColumn();
+
 #endif
@@ -19,11 +19,18 @@
 //
 
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "bench.h"
 #include "d_loop.h"
+#include "i_profile.h"
+#include "m_argv.h"
 #include "m_menu.h"
 #include "r_local.h"
 #include "r_sky.h"
+#include "r_span_simd.h"
+#include "r_threads.h"
 
 
 // Field of View.
@@ -91,6 +98,17 @@ void (*fuzzcolfunc)(void);
 void (*transcolfunc)(void);
 void (*spanfunc)(void);
 
+// Use the per-pixel reference drawers instead of the pointer stepping ones.
+static bool refdrawers;
+
+// Keep the renderer limits of the original executable.
+bool vanillalimits;
+
+renderlimits_t renderlimits;
+
+// Levels before the current one.
+static renderlimits_t pastlimits;
+
 
 //
 // R_PointOnSide
@@ -424,20 +442,109 @@ static void R_UpdateSpriteScales() {
     pspriteiscale = FRACUNIT * SCREENWIDTH / viewwidth;
 }
 
-static void R_UpdateDrawFuncs() {
+static void R_SelectDrawFuncs() {
     if (detailshift) {
-        colfunc = &R_DrawColumnLow;
-        basecolfunc = &R_DrawColumnLow;
+        if (refdrawers) {
+            colfunc = &R_DrawColumnLow;
+            basecolfunc = &R_DrawColumnLow;
+            spanfunc = &R_DrawSpanLow;
+        } else {
+            colfunc = &R_DrawColumnLowFast;
+            basecolfunc = &R_DrawColumnLowFast;
+            spanfunc = simdspanlowfunc ? simdspanlowfunc : &R_DrawSpanLowFast;
+        }
         fuzzcolfunc = &R_DrawFuzzColumnLow;
         transcolfunc = &R_DrawTranslatedColumnLow;
-        spanfunc = &R_DrawSpanLow;
         return;
     }
-    colfunc = &R_DrawColumn;
-    basecolfunc = &R_DrawColumn;
+    if (refdrawers) {
+        colfunc = &R_DrawColumn;
+        basecolfunc = &R_DrawColumn;
+        spanfunc = &R_DrawSpan;
+    } else {
+        colfunc = &R_DrawColumnFast;
+        basecolfunc = &R_DrawColumnFast;
+        spanfunc = simdspanfunc ? simdspanfunc : &R_DrawSpanFast;
+    }
     fuzzcolfunc = &R_DrawFuzzColumn;
     transcolfunc = &R_DrawTranslatedColumn;
-    spanfunc = &R_DrawSpan;
+}
+
+static void R_UpdateDrawFuncs() {
+    R_SelectDrawFuncs();
+    if (R_ThreadsEnabled()) {
+        R_QueueDrawFuncs();
+    }
+}
+
+//
+// R_SetReferenceDrawers
+// Switch between the reference drawers and the fast ones. Both produce the
+// same image; the change takes effect on the next refresh.
+//
+void R_SetReferenceDrawers(bool enable) {
+    refdrawers = enable;
+    setsizeneeded = true;
+}
+
+//
+// R_CountLimit
+//
+void R_CountLimit(renderlimit_t* limit, int count, int vanillalimit) {
+    if (count > limit->peak) {
+        limit->peak = count;
+    }
+    if (count > vanillalimit) {
+        limit->overflows++;
+    }
+    limit->vanillalimit = vanillalimit;
+}
+
+static void R_AddLimit(renderlimit_t* total, const renderlimit_t* limit) {
+    if (limit->peak > total->peak) {
+        total->peak = limit->peak;
+    }
+    total->overflows += limit->overflows;
+    if (limit->vanillalimit != 0) {
+        total->vanillalimit = limit->vanillalimit;
+    }
+}
+
+static void R_AddLimits(renderlimits_t* total, const renderlimits_t* limits) {
+    R_AddLimit(&total->visplanes, &limits->visplanes);
+    R_AddLimit(&total->openings, &limits->openings);
+    R_AddLimit(&total->drawsegs, &limits->drawsegs);
+    R_AddLimit(&total->vissprites, &limits->vissprites);
+}
+
+void R_ResetLimits(void) {
+    R_AddLimits(&pastlimits, &renderlimits);
+    memset(&renderlimits, 0, sizeof(renderlimits));
+}
+
+void R_TotalLimits(renderlimits_t* totals) {
+    *totals = pastlimits;
+    R_AddLimits(totals, &renderlimits);
+}
+
+static void R_ReportLimit(const char* name, const renderlimit_t* limit) {
+    if (limit->overflows > 0) {
+        printf("R_ReportLimits: %d frames had more %s than the vanilla "
+               "limit of %d (peak %d)\n",
+               limit->overflows, name, limit->vanillalimit, limit->peak);
+    }
+}
+
+//
+// R_ReportLimits
+// Called on level exit, so that map authors can see which frames would
+// have crashed the original executable.
+//
+void R_ReportLimits(void) {
+    R_ReportLimit("visplanes", &renderlimits.visplanes);
+    R_ReportLimit("openings", &renderlimits.openings);
+    R_ReportLimit("drawsegs", &renderlimits.drawsegs);
+    R_ReportLimit("vissprites", &renderlimits.vissprites);
 }
 
 static void R_UpdateProjectionPlane() {
@@ -478,6 +585,35 @@ void R_ExecuteSetViewSize() {
 // R_Init
 //
 void R_Init(void) {
+    //!
+    // @category video
+    //
+    // Draw walls, floors and ceilings with the simple per-pixel reference
+    // drawers. The output is identical, only slower; useful to verify the
+    // fast drawers against.
+    //
+    refdrawers = M_ParmExists("-refdrawers");
+
+    //!
+    // @category compat
+    //
+    // Keep the static renderer limits of the original executable: at most
+    // 128 sprites and 256 drawsegs are drawn per frame, and running out of
+    // visplanes or openings is a fatal error.
+    //
+    vanillalimits = M_ParmExists("-vanillalimits");
+
+    //!
+    // @category video
+    //
+    // Do not use the SSE2/AVX2/NEON span drawers or audio kernels, even
+    // if the CPU supports them.
+    //
+    if (!M_ParmExists("-nosimd")) {
+        R_InitSpanSIMD();
+    }
+    R_InitThreads();
+
     R_InitData();
     printf(".");
     printf(".");
@@ -556,8 +692,14 @@ static void R_SetupFrame(player_t* player) {
 // R_RenderView
 //
 void R_RenderPlayerView(player_t* player) {
+    bool threaded = R_ThreadsEnabled();
+
+    PROFILE_BEGIN("R_RenderPlayerView");
     R_SetupFrame(player);
     R_CleanUpState();
+    if (threaded) {
+        R_BeginThreadedFrame();
+    }
 
     // Check for new console commands.
     NetUpdate();
@@ -565,21 +707,43 @@ void R_RenderPlayerView(player_t* player) {
     // Render solid walls and portals (two-sided lines that connect sectors).
     // These are always perpendicular to the player's ground plane and
     // define the world boundary.
+    PROFILE_BEGIN("R_RenderSectors");
+    BenchBeginPhase(bench_rendersectors);
     R_RenderSectors();
+    BenchEndPhase(bench_rendersectors);
+    PROFILE_END("R_RenderSectors");
 
     // Check for new console commands.
     NetUpdate();
 
     // Render floors/ceilings.
     // These are always perpendicular to the player's vertical plane.
+    PROFILE_BEGIN("R_DrawPlanes");
+    BenchBeginPhase(bench_drawplanes);
     R_DrawPlanes();
-    
+    BenchEndPhase(bench_drawplanes);
+    PROFILE_END("R_DrawPlanes");
+
     // Check for new console commands.
     NetUpdate();
 
     // Render map objects and partially transparent walls.
+    PROFILE_BEGIN("R_DrawMasked");
+    BenchBeginPhase(bench_drawmasked);
     R_DrawMasked();
+    BenchEndPhase(bench_drawmasked);
+    PROFILE_END("R_DrawMasked");
+
+    // Draw everything queued by the steps above, in parallel.
+    if (threaded) {
+        PROFILE_BEGIN("R_FinishThreadedFrame");
+        BenchBeginPhase(bench_drawqueue);
+        R_FinishThreadedFrame();
+        BenchEndPhase(bench_drawqueue);
+        PROFILE_END("R_FinishThreadedFrame");
+    }
 
     // Check for new console commands.
     NetUpdate();
+    PROFILE_END("R_RenderPlayerView");
 }
@@ -45,6 +45,30 @@ extern int validcount;
 
 extern bool setsizeneeded;
 
+// Emulate the static limits of the vanilla renderer.
+extern bool vanillalimits;
+
+//
+// Usage of the renderer pools, to see how close a map comes to the
+// static limits of the original executable.
+//
+typedef struct {
+    // Highest count seen in a single frame.
+    int peak;
+    // Number of frames that went past the vanilla limit.
+    int overflows;
+    int vanillalimit;
+} renderlimit_t;
+
+typedef struct {
+    renderlimit_t visplanes;
+    renderlimit_t openings;
+    renderlimit_t drawsegs;
+    renderlimit_t vissprites;
+} renderlimits_t;
+
+extern renderlimits_t renderlimits;
+
 
 //
 // Lighting LUT.
@@ -128,4 +152,19 @@ void R_SetViewSize(int blocks, int detail);
 
 void R_ExecuteSetViewSize(void);
 
+// Select the per-pixel reference drawers instead of the fast ones.
+void R_SetReferenceDrawers(bool enable);
+
+// Record the count a pool reached this frame.
+void R_CountLimit(renderlimit_t* limit, int count, int vanillalimit);
+
+// Called by P_SetupLevel.
+void R_ResetLimits(void);
+
+// Print the pools that went past their vanilla limits this level.
+void R_ReportLimits(void);
+
+// Usage of the renderer pools over every level played so far.
+void R_TotalLimits(renderlimits_t* totals);
+
 #endif
@@ -32,15 +32,23 @@
 //
 
 // Here comes the obnoxious "visplane".
+// The planes are allocated one by one, as floorplane and ceilingplane
+// have to stay valid while more planes are added.
 #define MAXVISPLANES 128
-static visplane_t visplanes[MAXVISPLANES];
-static visplane_t* lastvisplane;
+static visplane_t** visplanes;
+static int numvisplanes;
+static int maxvisplanes;
 visplane_t* floorplane;
 visplane_t* ceilingplane;
 
+// Planes chained by height, picnum and light level.
+#define VISPLANEHASHSIZE 128
+static visplane_t* visplanehash[VISPLANEHASHSIZE];
+
 // ?
 #define MAXOPENINGS SCREENWIDTH * 64
-static short openings[MAXOPENINGS];
+static short* openings;
+static int maxopenings;
 short* lastopening;
 
 
@@ -75,17 +83,82 @@ void R_ClearPlanes() {
 	ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    if (openings == NULL) {
+        maxopenings = MAXOPENINGS;
+        openings = I_Realloc(NULL, maxopenings * sizeof(*openings));
+    }
+
+    numvisplanes = 0;
+    memset(visplanehash, 0, sizeof(visplanehash));
     lastopening = openings;
 }
 
+//
+// Move a drawseg clip array along with the openings it points into.
+// The arrays are indexed by screen x, so test the first element used.
+//
+static short* R_MoveOpening(short* clip, int x1, const short* oldopenings,
+                            int count) {
+    if (clip == NULL) {
+        return NULL;
+    }
+    if (clip + x1 < oldopenings || clip + x1 >= oldopenings + count) {
+        // Points into negonearray or screenheightarray.
+        return clip;
+    }
+    return openings + (clip - oldopenings);
+}
+
+//
+// R_CheckOpenings
+// Make room for count more openings.
+//
+void R_CheckOpenings(int count) {
+    int used = lastopening - openings;
+    if (used + count <= maxopenings) {
+        return;
+    }
+
+    short* oldopenings = openings;
+    while (used + count > maxopenings) {
+        maxopenings *= 2;
+    }
+    openings = I_Realloc(openings, maxopenings * sizeof(*openings));
+    lastopening = openings + used;
+
+    for (drawseg_t* ds = drawsegs; ds < ds_p; ds++) {
+        ds->sprtopclip = R_MoveOpening(ds->sprtopclip, ds->x1, oldopenings, used);
+        ds->sprbottomclip = R_MoveOpening(ds->sprbottomclip, ds->x1, oldopenings, used);
+        ds->maskedtexturecol = R_MoveOpening(ds->maskedtexturecol, ds->x1, oldopenings, used);
+    }
+}
+
+
+static unsigned R_VisplaneHash(fixed_t height, int picnum, int lightlevel) {
+    unsigned hash = (unsigned) picnum * 3 + (unsigned) lightlevel
+                  + (unsigned) height * 7;
+    return hash % VISPLANEHASHSIZE;
+}
+
+static void R_GrowVisplanes() {
+    int oldmax = maxvisplanes;
+
+    maxvisplanes = maxvisplanes ? maxvisplanes * 2 : MAXVISPLANES;
+    visplanes = I_Realloc(visplanes, maxvisplanes * sizeof(*visplanes));
+    for (int i = oldmax; i < maxvisplanes; i++) {
+        visplanes[i] = I_Realloc(NULL, sizeof(**visplanes));
+    }
+}
 
 static visplane_t* R_NewVisplane(fixed_t height, int pic, int light) {
-    if (lastvisplane - visplanes == MAXVISPLANES) {
+    if (vanillalimits && numvisplanes == MAXVISPLANES) {
         I_Error("R_NewVisplane: no more visplanes");
     }
-    visplane_t*	new_plane = lastvisplane;
-    lastvisplane++;
+    if (numvisplanes == maxvisplanes) {
+        R_GrowVisplanes();
+    }
+    visplane_t*	new_plane = visplanes[numvisplanes];
+    numvisplanes++;
 
     new_plane->height = height;
     new_plane->picnum = pic;
@@ -94,6 +167,11 @@ static visplane_t* R_NewVisplane(fixed_t height, int pic, int light) {
     new_plane->maxx = -1;
     memset(new_plane->top, 0xff, sizeof(new_plane->top));
 
+    // Newer planes go first in the chain.
+    unsigned hash = R_VisplaneHash(height, pic, light);
+    new_plane->next = visplanehash[hash];
+    visplanehash[hash] = new_plane;
+
     return new_plane;
 }
 
@@ -102,12 +180,16 @@ static visplane_t* R_NewVisplane(fixed_t height, int pic, int light) {
 // given height, texture and light level.
 //
 static visplane_t* R_FindCompatiblePlane(fixed_t height, int picnum, int lightlevel) {
-    for (visplane_t* pl = visplanes; pl < lastvisplane; pl++) {
+    visplane_t* oldest = NULL;
+
+    // The chain is newest first, so the last match is the oldest.
+    unsigned hash = R_VisplaneHash(height, picnum, lightlevel);
+    for (visplane_t* pl = visplanehash[hash]; pl != NULL; pl = pl->next) {
         if (height == pl->height && picnum == pl->picnum && lightlevel == pl->lightlevel) {
-            return pl;
+            oldest = pl;
         }
     }
-    return NULL;
+    return oldest;
 }
 
 //
@@ -313,11 +395,19 @@ static void R_DrawFlat(visplane_t* pl) {
 }
 
 static void R_CheckOverflow() {
+    R_CountLimit(&renderlimits.drawsegs, ds_p - drawsegs, MAXDRAWSEGS);
+    R_CountLimit(&renderlimits.visplanes, numvisplanes, MAXVISPLANES);
+    R_CountLimit(&renderlimits.openings, lastopening - openings, MAXOPENINGS);
+
+    if (!vanillalimits) {
+        // The pools grow as needed.
+        return;
+    }
     if (ds_p - drawsegs > MAXDRAWSEGS) {
         I_Error("R_CheckOverflow: drawsegs overflow (%td)", ds_p - drawsegs);
     }
-    if (lastvisplane - visplanes > MAXVISPLANES) {
-        I_Error("R_CheckOverflow: visplane overflow (%td)", lastvisplane - visplanes);
+    if (numvisplanes > MAXVISPLANES) {
+        I_Error("R_CheckOverflow: visplane overflow (%d)", numvisplanes);
     }
     if (lastopening - openings > MAXOPENINGS) {
         I_Error("R_CheckOverflow: opening overflow (%td)", lastopening - openings);
@@ -331,7 +421,8 @@ static void R_CheckOverflow() {
 void R_DrawPlanes() {
     R_CheckOverflow();
 
-    for (visplane_t* pl = visplanes; pl < lastvisplane; pl++) {
+    for (int i = 0; i < numvisplanes; i++) {
+        visplane_t* pl = visplanes[i];
 	if (pl->minx > pl->maxx) {
             continue;
         }
@@ -31,6 +31,7 @@ extern short floorclip[SCREENWIDTH];
 extern short ceilingclip[SCREENWIDTH];
 
 void R_ClearPlanes(void);
+void R_CheckOpenings(int count);
 void R_DrawPlanes(void);
 visplane_t* R_FindPlane(fixed_t height, int picnum, int lightlevel);
 visplane_t* R_GetPlane(visplane_t* pl, int start, int stop);
@@ -27,7 +27,7 @@
 #include "r_local.h"
 
 byte* translationtables;
-byte* dc_translation;
+THREAD_LOCAL byte* dc_translation;
 
 
 void R_DrawTranslatedColumn() {
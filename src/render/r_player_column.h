@@ -21,7 +21,7 @@
 #define __R_PLAYER_COLUMN__
 
 extern byte* translationtables;
-extern byte* dc_translation;
+extern THREAD_LOCAL byte* dc_translation;
 
 // Draw with color translation tables,
 // for player sprite rendering, Green/Red/Blue/Indigo shirts.
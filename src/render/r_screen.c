@@ -15,10 +15,11 @@
 // DESCRIPTION:
 //     The actual span/column drawing functions. Here find the main potential
 //     for optimization, e.g. inline assembly, different algorithms. All drawing
-//     to the view buffer is accomplished through R_DrawPixel. The other refresh
-//     files only know about coordinates, not the architecture of the frame
-//     buffer. Conveniently, the frame buffer is a linear one, and we need only
-//     the base address, and the total size == width*height*depth/8.
+//     to the view buffer is accomplished through R_DrawPixel, or through a
+//     pointer obtained from R_ScreenPointer. The other refresh files only know
+//     about coordinates, not the architecture of the frame buffer.
+//     Conveniently, the frame buffer is a linear one, and we need only the
+//     base address, and the total size == width*height*depth/8.
 //
 
 
@@ -49,6 +50,15 @@ pixel_t R_GetPixel(int x, int y) {
     return I_VideoBuffer[screen_spot];
 }
 
+//
+// Returns the address of pixel (x, y) in the view buffer. Moving one pixel
+// right is a step of 1, moving one pixel down is a step of SCREENWIDTH.
+//
+pixel_t* R_ScreenPointer(int x, int y) {
+    int screen_spot = R_ScreenCoordinate(x, y);
+    return &I_VideoBuffer[screen_spot];
+}
+
 //
 // R_UpdateViewWindow
 // Init viewport correction to handle screen resize.
@@ -25,6 +25,7 @@
 
 void R_DrawPixel(int x, int y, pixel_t color);
 pixel_t R_GetPixel(int x, int y);
+pixel_t* R_ScreenPointer(int x, int y);
 void R_UpdateViewWindow(int width, int height);
 
 #endif
@@ -829,7 +829,7 @@ static void R_PrepareSegmentRender(int start, int stop) {
 // A wall segment will be drawn between start and stop pixels (inclusive).
 //
 void R_RenderWallRange(int start, int stop) {
-    if (ds_p == &drawsegs[MAXDRAWSEGS]) {
+    if (vanillalimits && ds_p - drawsegs == MAXDRAWSEGS) {
         // Can't save more sprite clipping info.
         // Don't overflow and crash.
         return;
@@ -837,6 +837,10 @@ void R_RenderWallRange(int start, int stop) {
     if (start >= viewwidth || start > stop) {
         I_Error("Bad R_RenderWallRange: %i to %i", start , stop);
     }
+    R_CheckDrawSegs();
+
+    // Masked texture columns, and top and bottom sprite clips.
+    R_CheckOpenings(3 * (stop - start + 1));
 
     R_PrepareSegmentRender(start, stop);
     R_RenderSegment();
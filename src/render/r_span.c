@@ -33,19 +33,19 @@
 #define FLAT_WIDTH 64
 #define FLAT_HEIGHT 64
 
-int ds_y;
-int ds_x1;
-int ds_x2;
+THREAD_LOCAL int ds_y;
+THREAD_LOCAL int ds_x1;
+THREAD_LOCAL int ds_x2;
 
-lighttable_t *ds_colormap;
+THREAD_LOCAL lighttable_t *ds_colormap;
 
-fixed_t ds_xfrac;
-fixed_t ds_yfrac;
-fixed_t ds_xstep;
-fixed_t ds_ystep;
+THREAD_LOCAL fixed_t ds_xfrac;
+THREAD_LOCAL fixed_t ds_yfrac;
+THREAD_LOCAL fixed_t ds_xstep;
+THREAD_LOCAL fixed_t ds_ystep;
 
 // start of a 64*64 tile image
-byte* ds_source;
+THREAD_LOCAL byte* ds_source;
 
 
 static int R_RemEuclid(int a, int b) {
@@ -132,3 +132,61 @@ void R_DrawSpanLow() {
         R_DrawPixel(x + 1, ds_y, color);
     }
 }
+
+//
+// R_DrawSpanFast
+// Same output as R_DrawSpan. The destination address is computed once per
+// span and the texture coordinates are stepped and wrapped with a mask,
+// which matches R_RemEuclid for a power of two flat size.
+//
+void R_DrawSpanFast() {
+    if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
+        || (unsigned)ds_y > SCREENHEIGHT)
+    {
+        I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
+    }
+
+    pixel_t* dest = R_ScreenPointer(ds_x1, ds_y);
+    fixed_t xfrac = ds_xfrac;
+    fixed_t yfrac = ds_yfrac;
+    int count = ds_x2 - ds_x1;
+
+    do {
+        int texture_x = (xfrac >> FRACBITS) & (FLAT_WIDTH - 1);
+        int texture_y = (yfrac >> FRACBITS) & (FLAT_HEIGHT - 1);
+        int texture_spot = texture_x + (texture_y * FLAT_WIDTH);
+
+        *dest++ = ds_colormap[ds_source[texture_spot]];
+
+        xfrac += ds_xstep;
+        yfrac += ds_ystep;
+    } while (count--);
+}
+
+void R_DrawSpanLowFast() {
+    if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH ||
+        (unsigned) ds_y > SCREENHEIGHT)
+    {
+        I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
+    }
+
+    // Blocky mode, need to multiply by 2.
+    pixel_t* dest = R_ScreenPointer(ds_x1 << 1, ds_y);
+    fixed_t xfrac = ds_xfrac;
+    fixed_t yfrac = ds_yfrac;
+    int count = ds_x2 - ds_x1;
+
+    do {
+        int texture_x = (xfrac >> FRACBITS) & (FLAT_WIDTH - 1);
+        int texture_y = (yfrac >> FRACBITS) & (FLAT_HEIGHT - 1);
+        int texture_spot = texture_x + (texture_y * FLAT_WIDTH);
+
+        pixel_t color = ds_colormap[ds_source[texture_spot]];
+        dest[0] = color;
+        dest[1] = color;
+        dest += 2;
+
+        xfrac += ds_xstep;
+        yfrac += ds_ystep;
+    } while (count--);
+}
@@ -20,19 +20,20 @@
 #ifndef __R_SPAN__
 #define __R_SPAN__
 
-extern int ds_y;
-extern int ds_x1;
-extern int ds_x2;
+// Drawer inputs are per thread, see r_threads.c.
+extern THREAD_LOCAL int ds_y;
+extern THREAD_LOCAL int ds_x1;
+extern THREAD_LOCAL int ds_x2;
 
-extern lighttable_t *ds_colormap;
+extern THREAD_LOCAL lighttable_t *ds_colormap;
 
-extern fixed_t ds_xfrac;
-extern fixed_t ds_yfrac;
-extern fixed_t ds_xstep;
-extern fixed_t ds_ystep;
+extern THREAD_LOCAL fixed_t ds_xfrac;
+extern THREAD_LOCAL fixed_t ds_yfrac;
+extern THREAD_LOCAL fixed_t ds_xstep;
+extern THREAD_LOCAL fixed_t ds_ystep;
 
 // start of a 64*64 tile image
-extern byte *ds_source;
+extern THREAD_LOCAL byte *ds_source;
 
 
 // Span blitting for rows, floor/ceiling.
@@ -42,4 +43,8 @@ void R_DrawSpan();
 // Low resolution mode, 160x200?
 void R_DrawSpanLow();
 
+// Pixel-identical to the above, using direct pointer stepping.
+void R_DrawSpanFast();
+void R_DrawSpanLowFast();
+
 #endif
@@ -0,0 +1,350 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Vectorized span drawers. The texture coordinates of a block of 4 or 8
+//     pixels are stepped at once, and the texels are then looked up in the
+//     flat and remapped through the colormap. The output is bit-exact with
+//     R_DrawSpan, which remains the reference implementation.
+//
+
+
+#include <stdint.h>
+#include <SDL_cpuinfo.h>
+
+#include "doomdef.h"
+#include "i_system.h"
+#include "r_local.h"
+#include "r_span_simd.h"
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SPAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define HAVE_SPAN_AVX2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_SPAN_NEON
+#include <arm_neon.h>
+#endif
+
+
+// Every flat must be 64x64
+#define FLAT_WIDTH 64
+#define FLAT_HEIGHT 64
+
+// Mask of the V coordinate once shifted into place (texture_y * FLAT_WIDTH).
+#define FLAT_V_MASK ((FLAT_HEIGHT - 1) * FLAT_WIDTH)
+
+
+void (*simdspanfunc)(void);
+void (*simdspanlowfunc)(void);
+
+
+static void R_CheckSpan() {
+    if (ds_x2 < ds_x1 || ds_x1 < 0 || ds_x2 >= SCREENWIDTH
+        || (unsigned)ds_y > SCREENHEIGHT)
+    {
+        I_Error("R_DrawSpan: %i to %i at %i", ds_x1, ds_x2, ds_y);
+    }
+}
+
+//
+// Texture coordinate of the given pixel of the span. Stepping is done with
+// unsigned arithmetic so that it wraps exactly like the scalar drawers do.
+//
+static inline uint32_t R_SpanFrac(fixed_t frac, fixed_t step, int dx) {
+    return (uint32_t) frac + ((uint32_t) dx * (uint32_t) step);
+}
+
+static inline int R_SpanSpot(uint32_t xfrac, uint32_t yfrac) {
+    int texture_x = (xfrac >> FRACBITS) & (FLAT_WIDTH - 1);
+    int texture_y = (yfrac >> FRACBITS) & (FLAT_HEIGHT - 1);
+    return texture_x + (texture_y * FLAT_WIDTH);
+}
+
+//
+// Draws the pixels [dx, count) of the current span one at a time. Used for
+// the pixels left over after the last full vector block.
+//
+static void R_DrawSpanTail(pixel_t* dest, int dx, int count, bool low) {
+    uint32_t xfrac = R_SpanFrac(ds_xfrac, ds_xstep, dx);
+    uint32_t yfrac = R_SpanFrac(ds_yfrac, ds_ystep, dx);
+
+    for (; dx < count; dx++) {
+        pixel_t color = ds_colormap[ds_source[R_SpanSpot(xfrac, yfrac)]];
+        if (low) {
+            dest[dx * 2] = color;
+            dest[dx * 2 + 1] = color;
+        } else {
+            dest[dx] = color;
+        }
+        xfrac += ds_xstep;
+        yfrac += ds_ystep;
+    }
+}
+
+
+#ifdef HAVE_SPAN_SSE2
+
+//
+// SSE2: 4 pixels per step. The flat offsets are computed in vector
+// registers, the lookups themselves are scalar.
+//
+static void R_DrawSpanSSE2Common(bool low) {
+    R_CheckSpan();
+
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t* dest = R_ScreenPointer(low ? ds_x1 << 1 : ds_x1, ds_y);
+
+    __m128i xfrac = _mm_setr_epi32(
+        (int) R_SpanFrac(ds_xfrac, ds_xstep, 0),
+        (int) R_SpanFrac(ds_xfrac, ds_xstep, 1),
+        (int) R_SpanFrac(ds_xfrac, ds_xstep, 2),
+        (int) R_SpanFrac(ds_xfrac, ds_xstep, 3));
+    __m128i yfrac = _mm_setr_epi32(
+        (int) R_SpanFrac(ds_yfrac, ds_ystep, 0),
+        (int) R_SpanFrac(ds_yfrac, ds_ystep, 1),
+        (int) R_SpanFrac(ds_yfrac, ds_ystep, 2),
+        (int) R_SpanFrac(ds_yfrac, ds_ystep, 3));
+    __m128i xstep = _mm_set1_epi32((int) ((uint32_t) ds_xstep * 4));
+    __m128i ystep = _mm_set1_epi32((int) ((uint32_t) ds_ystep * 4));
+    __m128i umask = _mm_set1_epi32(FLAT_WIDTH - 1);
+    __m128i vmask = _mm_set1_epi32(FLAT_V_MASK);
+
+    int dx = 0;
+    for (; dx + 4 <= count; dx += 4) {
+        // u = (xfrac >> 16) & 63, v * 64 = (yfrac >> 10) & (63 * 64)
+        __m128i u = _mm_and_si128(_mm_srli_epi32(xfrac, FRACBITS), umask);
+        __m128i v = _mm_and_si128(_mm_srli_epi32(yfrac, FRACBITS - 6), vmask);
+        int32_t spot[4];
+        _mm_storeu_si128((__m128i*) spot, _mm_or_si128(u, v));
+
+        for (int i = 0; i < 4; i++) {
+            pixel_t color = ds_colormap[ds_source[spot[i]]];
+            if (low) {
+                dest[(dx + i) * 2] = color;
+                dest[(dx + i) * 2 + 1] = color;
+            } else {
+                dest[dx + i] = color;
+            }
+        }
+
+        xfrac = _mm_add_epi32(xfrac, xstep);
+        yfrac = _mm_add_epi32(yfrac, ystep);
+    }
+
+    R_DrawSpanTail(dest, dx, count, low);
+}
+
+static void R_DrawSpanSSE2() {
+    R_DrawSpanSSE2Common(false);
+}
+
+static void R_DrawSpanLowSSE2() {
+    R_DrawSpanSSE2Common(true);
+}
+
+#endif // HAVE_SPAN_SSE2
+
+
+#ifdef HAVE_SPAN_AVX2
+
+//
+// Looks up 8 bytes of "table" at once. The gather reads the aligned dword
+// containing each byte, so nothing past the end of the table is touched,
+// provided "table" itself is dword aligned.
+//
+TARGET_AVX2
+static inline __m256i R_GatherBytesAVX2(const byte* table, __m256i index) {
+    __m256i dword = _mm256_srli_epi32(index, 2);
+    __m256i shift = _mm256_slli_epi32(
+        _mm256_and_si256(index, _mm256_set1_epi32(3)), 3);
+    __m256i value = _mm256_i32gather_epi32((const int*) table, dword, 4);
+    return _mm256_and_si256(_mm256_srlv_epi32(value, shift),
+                            _mm256_set1_epi32(0xff));
+}
+
+//
+// AVX2: 8 pixels per step, with both the flat and the colormap lookups
+// done through gathers.
+//
+TARGET_AVX2
+static void R_DrawSpanAVX2Common(bool low) {
+    R_CheckSpan();
+
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t* dest = R_ScreenPointer(low ? ds_x1 << 1 : ds_x1, ds_y);
+
+    // Gathers need dword aligned tables; the tail handles everything else.
+    int dx = 0;
+    if ((((uintptr_t) ds_source) | ((uintptr_t) ds_colormap)) & 3) {
+        R_DrawSpanTail(dest, dx, count, low);
+        return;
+    }
+
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i xfrac = _mm256_add_epi32(
+        _mm256_set1_epi32(ds_xfrac),
+        _mm256_mullo_epi32(lanes, _mm256_set1_epi32(ds_xstep)));
+    __m256i yfrac = _mm256_add_epi32(
+        _mm256_set1_epi32(ds_yfrac),
+        _mm256_mullo_epi32(lanes, _mm256_set1_epi32(ds_ystep)));
+    __m256i xstep = _mm256_set1_epi32((int) ((uint32_t) ds_xstep * 8));
+    __m256i ystep = _mm256_set1_epi32((int) ((uint32_t) ds_ystep * 8));
+    __m256i umask = _mm256_set1_epi32(FLAT_WIDTH - 1);
+    __m256i vmask = _mm256_set1_epi32(FLAT_V_MASK);
+
+    // Picks the low byte of every dword of each 128-bit lane.
+    __m256i pack = _mm256_setr_epi8(
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    for (; dx + 8 <= count; dx += 8) {
+        __m256i u = _mm256_and_si256(_mm256_srli_epi32(xfrac, FRACBITS), umask);
+        __m256i v =
+            _mm256_and_si256(_mm256_srli_epi32(yfrac, FRACBITS - 6), vmask);
+        __m256i spot = _mm256_or_si256(u, v);
+
+        __m256i texel = R_GatherBytesAVX2(ds_source, spot);
+        __m256i color = R_GatherBytesAVX2(ds_colormap, texel);
+
+        color = _mm256_shuffle_epi8(color, pack);
+        __m128i pixels = _mm_unpacklo_epi32(
+            _mm256_castsi256_si128(color), _mm256_extracti128_si256(color, 1));
+
+        if (low) {
+            pixels = _mm_unpacklo_epi8(pixels, pixels);
+            _mm_storeu_si128((__m128i*) &dest[dx * 2], pixels);
+        } else {
+            _mm_storel_epi64((__m128i*) &dest[dx], pixels);
+        }
+
+        xfrac = _mm256_add_epi32(xfrac, xstep);
+        yfrac = _mm256_add_epi32(yfrac, ystep);
+    }
+
+    R_DrawSpanTail(dest, dx, count, low);
+}
+
+static void R_DrawSpanAVX2() {
+    R_DrawSpanAVX2Common(false);
+}
+
+static void R_DrawSpanLowAVX2() {
+    R_DrawSpanAVX2Common(true);
+}
+
+#endif // HAVE_SPAN_AVX2
+
+
+#ifdef HAVE_SPAN_NEON
+
+//
+// NEON: 4 pixels per step, same scheme as the SSE2 version.
+//
+static void R_DrawSpanNEONCommon(bool low) {
+    R_CheckSpan();
+
+    int count = ds_x2 - ds_x1 + 1;
+    pixel_t* dest = R_ScreenPointer(low ? ds_x1 << 1 : ds_x1, ds_y);
+
+    uint32_t xinit[4];
+    uint32_t yinit[4];
+    for (int i = 0; i < 4; i++) {
+        xinit[i] = R_SpanFrac(ds_xfrac, ds_xstep, i);
+        yinit[i] = R_SpanFrac(ds_yfrac, ds_ystep, i);
+    }
+    uint32x4_t xfrac = vld1q_u32(xinit);
+    uint32x4_t yfrac = vld1q_u32(yinit);
+    uint32x4_t xstep = vdupq_n_u32((uint32_t) ds_xstep * 4);
+    uint32x4_t ystep = vdupq_n_u32((uint32_t) ds_ystep * 4);
+    uint32x4_t umask = vdupq_n_u32(FLAT_WIDTH - 1);
+    uint32x4_t vmask = vdupq_n_u32(FLAT_V_MASK);
+
+    int dx = 0;
+    for (; dx + 4 <= count; dx += 4) {
+        uint32x4_t u = vandq_u32(vshrq_n_u32(xfrac, FRACBITS), umask);
+        uint32x4_t v = vandq_u32(vshrq_n_u32(yfrac, FRACBITS - 6), vmask);
+        uint32_t spot[4];
+        vst1q_u32(spot, vorrq_u32(u, v));
+
+        for (int i = 0; i < 4; i++) {
+            pixel_t color = ds_colormap[ds_source[spot[i]]];
+            if (low) {
+                dest[(dx + i) * 2] = color;
+                dest[(dx + i) * 2 + 1] = color;
+            } else {
+                dest[dx + i] = color;
+            }
+        }
+
+        xfrac = vaddq_u32(xfrac, xstep);
+        yfrac = vaddq_u32(yfrac, ystep);
+    }
+
+    R_DrawSpanTail(dest, dx, count, low);
+}
+
+static void R_DrawSpanNEON() {
+    R_DrawSpanNEONCommon(false);
+}
+
+static void R_DrawSpanLowNEON() {
+    R_DrawSpanNEONCommon(true);
+}
+
+#endif // HAVE_SPAN_NEON
+
+
+//
+// R_InitSpanSIMD
+// Pick the widest span drawer the CPU supports.
+//
+void R_InitSpanSIMD(void) {
+    simdspanfunc = NULL;
+    simdspanlowfunc = NULL;
+
+#ifdef HAVE_SPAN_AVX2
+    if (SDL_HasAVX2()) {
+        simdspanfunc = &R_DrawSpanAVX2;
+        simdspanlowfunc = &R_DrawSpanLowAVX2;
+        return;
+    }
+#endif
+#ifdef HAVE_SPAN_SSE2
+    if (SDL_HasSSE2()) {
+        simdspanfunc = &R_DrawSpanSSE2;
+        simdspanlowfunc = &R_DrawSpanLowSSE2;
+        return;
+    }
+#endif
+#ifdef HAVE_SPAN_NEON
+    if (SDL_HasNEON()) {
+        simdspanfunc = &R_DrawSpanNEON;
+        simdspanlowfunc = &R_DrawSpanLowNEON;
+        return;
+    }
+#endif
+}
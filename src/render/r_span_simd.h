@@ -13,24 +13,19 @@
 // GNU General Public License for more details.
 //
 // DESCRIPTION:
-//	Fixed point implementation.
+//	Vectorized span drawers.
 //
 
 
-#include "stdlib.h"
-#include "doomtype.h"
-#include "m_fixed.h"
+#ifndef __R_SPAN_SIMD__
+#define __R_SPAN_SIMD__
 
+// Vectorized drop-in replacements for R_DrawSpan and R_DrawSpanLow.
+// NULL if the CPU has no supported vector extension.
+extern void (*simdspanfunc)(void);
+extern void (*simdspanlowfunc)(void);
 
-fixed_t FixedMul(fixed_t a, fixed_t b) {
-    int64_t result = ((int64_t) a * (int64_t) b) >> FRACBITS;
-    return (fixed_t) result;
-}
+// Select the span drawers for the running CPU. Called once at startup.
+void R_InitSpanSIMD(void);
 
-fixed_t FixedDiv(fixed_t a, fixed_t b) {
-    if ((abs(a) >> 14) >= abs(b)) {
-        return (a ^ b) < 0 ? INT_MIN : INT_MAX;
-    }
-    int64_t result = ((int64_t) a << FRACBITS) / b;
-    return (fixed_t) result;
-}
+#endif
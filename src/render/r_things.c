@@ -253,9 +253,17 @@ static void R_InitSpriteDefs(const char **namelist) {
 //
 // GAME FUNCTIONS
 //
+
+// Vanilla limit, and initial size of the vissprite array.
 #define MAXVISSPRITES 128
-static vissprite_t vissprites[MAXVISSPRITES];
+static vissprite_t* vissprites;
 static vissprite_t* vissprite_p;
+static int numvissprites;
+
+// Scratch space for sorting the vissprites.
+static vissprite_t** vsprsortbuf;
+static vissprite_t** vsprmergebuf;
+static int numvsprsortbuf;
 
 
 //
@@ -267,6 +275,10 @@ void R_InitSprites(const char** namelist) {
 	negonearray[i] = -1;
     }
     R_InitSpriteDefs(namelist);
+
+    numvissprites = MAXVISSPRITES;
+    vissprites = I_Realloc(NULL, numvissprites * sizeof(*vissprites));
+    vissprite_p = vissprites;
 }
 
 
@@ -285,10 +297,23 @@ void R_ClearSprites(void) {
 //
 vissprite_t overflowsprite;
 
+static void R_GrowVisSprites(void) {
+    int count = vissprite_p - vissprites;
+
+    numvissprites *= 2;
+    vissprites = I_Realloc(vissprites, numvissprites * sizeof(*vissprites));
+    vissprite_p = vissprites + count;
+}
+
 static vissprite_t* R_PushVisSprite(void) {
-    if (vissprite_p == &vissprites[MAXVISSPRITES]) {
+    int count = vissprite_p - vissprites;
+
+    if (vanillalimits && count == MAXVISSPRITES) {
         return &overflowsprite;
     }
+    if (count == numvissprites) {
+        R_GrowVisSprites();
+    }
     vissprite_t* new_sprite = vissprite_p;
     vissprite_p++;
 
@@ -922,64 +947,77 @@ static void R_DrawRemainingMaskedTextures() {
 // R_SortThingsSprites
 //
 static vissprite_t vsprsortedhead;
-static vissprite_t unsorted;
 
-static vissprite_t* R_FindSpriteWithSmallestScale() {
-    vissprite_t* best = unsorted.next;
-
-    fixed_t bestscale = INT_MAX;
-    vissprite_t* ds = best;
-    while (ds != &unsorted) {
-        if (ds->scale < bestscale) {
-            bestscale = ds->scale;
-            best = ds;
-        }
-        ds = ds->next;
+static void R_GrowSortBuffers(int count) {
+    if (count <= numvsprsortbuf) {
+        return;
     }
-
-    return best;
+    numvsprsortbuf = numvissprites;
+    vsprsortbuf = I_Realloc(vsprsortbuf, numvsprsortbuf * sizeof(*vsprsortbuf));
+    vsprmergebuf =
+        I_Realloc(vsprmergebuf, numvsprsortbuf * sizeof(*vsprmergebuf));
 }
 
-static void R_InitSortedList() {
-    vsprsortedhead.next = &vsprsortedhead;
-    vsprsortedhead.prev = &vsprsortedhead;
+//
+// Merge the sorted runs src[lo, mid) and src[mid, hi) into dst. On equal
+// scales the sprite from the left run goes first, which keeps the sort stable.
+//
+static void R_MergeSpriteRuns(vissprite_t** dst, vissprite_t** src, int lo,
+                              int mid, int hi) {
+    int i = lo;
+    int j = mid;
+
+    for (int k = lo; k < hi; k++) {
+        if (j >= hi || (i < mid && src[i]->scale <= src[j]->scale)) {
+            dst[k] = src[i++];
+        } else {
+            dst[k] = src[j++];
+        }
+    }
 }
 
-static void R_InitUnsortedList() {
-    unsorted.next = &unsorted;
-    unsorted.prev = &unsorted;
+//
+// Bottom-up merge sort of the vissprites by increasing scale. Sprites with
+// the same scale stay in projection order, which is the order the original
+// selection sort used to pick them in, so the draw order is unchanged.
+//
+static vissprite_t** R_MergeSortSprites(int count) {
+    vissprite_t** src = vsprsortbuf;
+    vissprite_t** dst = vsprmergebuf;
 
-    for (vissprite_t* ds = vissprites; ds < vissprite_p; ds++) {
-        ds->next = ds + 1;
-        ds->prev = ds - 1;
+    for (int width = 1; width < count; width *= 2) {
+        for (int lo = 0; lo < count; lo += 2 * width) {
+            int mid = (lo + width < count) ? lo + width : count;
+            int hi = (lo + 2 * width < count) ? lo + 2 * width : count;
+            R_MergeSpriteRuns(dst, src, lo, mid, hi);
+        }
+        vissprite_t** tmp = src;
+        src = dst;
+        dst = tmp;
     }
 
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p - 1)->next = &unsorted;
-    unsorted.prev = vissprite_p - 1;
+    return src;
 }
 
 static void R_SortThingsSprites(void) {
     int count = vissprite_p - vissprites;
 
-    R_InitUnsortedList();
-    R_InitSortedList();
-
+    R_CountLimit(&renderlimits.vissprites, count, MAXVISSPRITES);
+    R_GrowSortBuffers(count);
     for (int i = 0; i < count; i++) {
-        // pull the vissprites out by scale
-        vissprite_t* best = R_FindSpriteWithSmallestScale();
-
-        // Remove from unsorted list
-        best->next->prev = best->prev;
-        best->prev->next = best->next;
+        vsprsortbuf[i] = &vissprites[i];
+    }
+    vissprite_t** sorted = R_MergeSortSprites(count);
 
-        // Push in sorted list
-        best->next = &vsprsortedhead;
-        best->prev = vsprsortedhead.prev;
-        vsprsortedhead.prev->next = best;
-        vsprsortedhead.prev = best;
+    // Link them back to front, in the order they will be drawn.
+    vissprite_t* prev = &vsprsortedhead;
+    for (int i = 0; i < count; i++) {
+        prev->next = sorted[i];
+        sorted[i]->prev = prev;
+        prev = sorted[i];
     }
+    prev->next = &vsprsortedhead;
+    vsprsortedhead.prev = prev;
 }
 
 //
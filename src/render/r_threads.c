@@ -0,0 +1,373 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Multithreaded drawing. The BSP traversal, clipping, visplane and
+//     sprite setup still run once, on the main thread, but instead of
+//     drawing, every column and span is appended to a draw queue. At the end
+//     of the frame the view is split into vertical strips, and each strip
+//     replays the queue in order, drawing only the pixels inside it.
+//
+//     A column belongs to exactly one strip, and spans are clipped to the
+//     strip with their texture coordinates advanced by whole steps, so every
+//     pixel is computed exactly as the single-threaded renderer would, and
+//     pixels sharing a column are still written in the original order.
+//
+
+
+#include <SDL.h>
+
+#include "doomdef.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "z_zone.h"
+#include "r_local.h"
+#include "r_threads.h"
+
+
+#define MAXRTHREADS 16
+
+
+typedef struct {
+    int x;
+    int yl;
+    int yh;
+    fixed_t iscale;
+    fixed_t texturemid;
+    const byte* source;
+    byte* translation;
+    int fuzzpos;
+} columncmd_t;
+
+typedef struct {
+    int y;
+    int x1;
+    int x2;
+    fixed_t xfrac;
+    fixed_t yfrac;
+    fixed_t xstep;
+    fixed_t ystep;
+    byte* source;
+} spancmd_t;
+
+typedef struct {
+    void (*drawer)(void);
+    lighttable_t* colormap;
+    bool is_span;
+    bool is_fuzz;
+    union {
+        columncmd_t column;
+        spancmd_t span;
+    };
+} drawcmd_t;
+
+typedef struct {
+    SDL_Thread* thread;
+    SDL_sem* start;
+    int x1;
+    int x2;
+} drawworker_t;
+
+
+static int numrthreads = 1;
+
+static drawworker_t workers[MAXRTHREADS];
+static SDL_sem* workersdone;
+
+static drawcmd_t* drawcmds = NULL;
+static int numdrawcmds = 0;
+static int maxdrawcmds = 0;
+
+// The real drawers, called when the queue is replayed.
+static void (*drawcolfunc)(void);
+static void (*drawfuzzcolfunc)(void);
+static void (*drawtranscolfunc)(void);
+static void (*drawspanfunc)(void);
+
+
+static drawcmd_t* R_NewDrawCommand(void (*drawer)(void)) {
+    if (numdrawcmds == maxdrawcmds) {
+        maxdrawcmds = maxdrawcmds ? maxdrawcmds * 2 : 4096;
+        drawcmds = I_Realloc(drawcmds, maxdrawcmds * sizeof(*drawcmds));
+    }
+    drawcmd_t* cmd = &drawcmds[numdrawcmds];
+    numdrawcmds++;
+
+    cmd->drawer = drawer;
+    cmd->is_span = false;
+    cmd->is_fuzz = false;
+    return cmd;
+}
+
+//
+// Copy the drawer inputs into a command, and back.
+//
+static void R_SaveColumn(drawcmd_t* cmd) {
+    cmd->colormap = dc_colormap;
+    cmd->column.x = dc_x;
+    cmd->column.yl = dc_yl;
+    cmd->column.yh = dc_yh;
+    cmd->column.iscale = dc_iscale;
+    cmd->column.texturemid = dc_texturemid;
+    cmd->column.source = dc_source;
+    cmd->column.translation = dc_translation;
+}
+
+static void R_RestoreColumn(const drawcmd_t* cmd) {
+    dc_colormap = cmd->colormap;
+    dc_x = cmd->column.x;
+    dc_yl = cmd->column.yl;
+    dc_yh = cmd->column.yh;
+    dc_iscale = cmd->column.iscale;
+    dc_texturemid = cmd->column.texturemid;
+    dc_source = cmd->column.source;
+    dc_translation = cmd->column.translation;
+}
+
+static void R_SaveSpan(drawcmd_t* cmd) {
+    cmd->colormap = ds_colormap;
+    cmd->span.y = ds_y;
+    cmd->span.x1 = ds_x1;
+    cmd->span.x2 = ds_x2;
+    cmd->span.xfrac = ds_xfrac;
+    cmd->span.yfrac = ds_yfrac;
+    cmd->span.xstep = ds_xstep;
+    cmd->span.ystep = ds_ystep;
+    cmd->span.source = ds_source;
+}
+
+static void R_RestoreSpan(const drawcmd_t* cmd) {
+    ds_colormap = cmd->colormap;
+    ds_y = cmd->span.y;
+    ds_x1 = cmd->span.x1;
+    ds_x2 = cmd->span.x2;
+    ds_xfrac = cmd->span.xfrac;
+    ds_yfrac = cmd->span.yfrac;
+    ds_xstep = cmd->span.xstep;
+    ds_ystep = cmd->span.ystep;
+    ds_source = cmd->span.source;
+}
+
+static drawcmd_t* R_QueueColumnCommand(void (*drawer)(void)) {
+    drawcmd_t* cmd = R_NewDrawCommand(drawer);
+    R_SaveColumn(cmd);
+    return cmd;
+}
+
+static void R_QueueColumn() {
+    R_QueueColumnCommand(drawcolfunc);
+}
+
+static void R_QueueTranslatedColumn() {
+    R_QueueColumnCommand(drawtranscolfunc);
+}
+
+static void R_QueueFuzzColumn() {
+    drawcmd_t* cmd = R_QueueColumnCommand(drawfuzzcolfunc);
+    cmd->is_fuzz = true;
+
+    // The fuzz table position depends on every fuzz pixel drawn before, in
+    // any strip, so remember where this column starts and move on.
+    cmd->column.fuzzpos = R_GetFuzzPos();
+    R_SkipFuzzColumn();
+}
+
+static void R_QueueSpan() {
+    drawcmd_t* cmd = R_NewDrawCommand(drawspanfunc);
+    cmd->is_span = true;
+    R_SaveSpan(cmd);
+}
+
+
+static void R_ReplayColumn(const drawcmd_t* cmd, int x1, int x2) {
+    const columncmd_t* column = &cmd->column;
+    if (column->x < x1 || column->x > x2) {
+        return;
+    }
+
+    R_RestoreColumn(cmd);
+    if (cmd->is_fuzz) {
+        R_SetFuzzPos(column->fuzzpos);
+    }
+
+    cmd->drawer();
+}
+
+static void R_ReplaySpan(const drawcmd_t* cmd, int x1, int x2) {
+    const spancmd_t* span = &cmd->span;
+    int start = (span->x1 > x1) ? span->x1 : x1;
+    int stop = (span->x2 < x2) ? span->x2 : x2;
+    if (start > stop) {
+        return;
+    }
+
+    // Step the texture coordinates up to the first pixel of the strip, the
+    // same way the drawers step them from pixel to pixel.
+    unsigned skip = (unsigned) (start - span->x1);
+
+    ds_colormap = cmd->colormap;
+    ds_y = span->y;
+    ds_x1 = start;
+    ds_x2 = stop;
+    ds_xfrac = (fixed_t) ((unsigned) span->xfrac + skip * span->xstep);
+    ds_yfrac = (fixed_t) ((unsigned) span->yfrac + skip * span->ystep);
+    ds_xstep = span->xstep;
+    ds_ystep = span->ystep;
+    ds_source = span->source;
+
+    cmd->drawer();
+}
+
+//
+// Draw the part of the queued commands that falls in columns [x1, x2].
+//
+static void R_ReplayDrawQueue(int x1, int x2) {
+    for (int i = 0; i < numdrawcmds; i++) {
+        const drawcmd_t* cmd = &drawcmds[i];
+        if (cmd->is_span) {
+            R_ReplaySpan(cmd, x1, x2);
+        } else {
+            R_ReplayColumn(cmd, x1, x2);
+        }
+    }
+}
+
+static int R_DrawWorker(void* data) {
+    drawworker_t* worker = data;
+
+    while (true) {
+        SDL_SemWait(worker->start);
+        R_ReplayDrawQueue(worker->x1, worker->x2);
+        SDL_SemPost(workersdone);
+    }
+
+    return 0;
+}
+
+//
+// Draw everything queued so far, split across the worker threads, and empty
+// the queue. The main thread takes the first strip.
+//
+static void R_FlushDrawQueue() {
+    if (numdrawcmds == 0) {
+        return;
+    }
+
+    for (int i = 1; i < numrthreads; i++) {
+        workers[i].x1 = viewwidth * i / numrthreads;
+        workers[i].x2 = viewwidth * (i + 1) / numrthreads - 1;
+        SDL_SemPost(workers[i].start);
+    }
+
+    // The zone can call this in the middle of setting up a column or span,
+    // so the drawer inputs of the main thread have to survive the replay.
+    // Replaying fuzz columns also moves the fuzz table position, which has
+    // already been advanced past the whole queue.
+    drawcmd_t column, span;
+    R_SaveColumn(&column);
+    R_SaveSpan(&span);
+    int fuzzpos = R_GetFuzzPos();
+
+    R_ReplayDrawQueue(0, viewwidth / numrthreads - 1);
+
+    R_RestoreColumn(&column);
+    R_RestoreSpan(&span);
+    R_SetFuzzPos(fuzzpos);
+
+    for (int i = 1; i < numrthreads; i++) {
+        SDL_SemWait(workersdone);
+    }
+
+    numdrawcmds = 0;
+}
+
+
+//
+// R_InitThreads
+//
+void R_InitThreads(void) {
+    //!
+    // @category video
+    // @arg <n>
+    //
+    // Draw the view with n threads, each drawing a vertical strip of the
+    // screen. The output is identical to the single-threaded renderer.
+    //
+    int p = M_CheckParmWithArgs("-rthreads", 1);
+    if (p == 0) {
+        return;
+    }
+
+    int n;
+    if (!M_StrToInt(myargv[p + 1], &n) || n < 1) {
+        I_Error("R_InitThreads: Invalid thread count '%s'", myargv[p + 1]);
+    }
+    if (n > MAXRTHREADS) {
+        n = MAXRTHREADS;
+    }
+
+    workersdone = SDL_CreateSemaphore(0);
+    if (workersdone == NULL) {
+        I_Error("R_InitThreads: %s", SDL_GetError());
+    }
+
+    // Worker 0 is the main thread itself.
+    for (int i = 1; i < n; i++) {
+        drawworker_t* worker = &workers[i];
+        worker->start = SDL_CreateSemaphore(0);
+        worker->thread = SDL_CreateThread(R_DrawWorker, "R_DrawWorker", worker);
+        if (worker->start == NULL || worker->thread == NULL) {
+            I_Error("R_InitThreads: %s", SDL_GetError());
+        }
+        SDL_DetachThread(worker->thread);
+    }
+
+    numrthreads = n;
+}
+
+bool R_ThreadsEnabled(void) {
+    return numrthreads > 1;
+}
+
+//
+// R_QueueDrawFuncs
+// Put the queueing functions in place of the drawers just selected by
+// R_ExecuteSetViewSize.
+//
+void R_QueueDrawFuncs(void) {
+    drawcolfunc = basecolfunc;
+    drawfuzzcolfunc = fuzzcolfunc;
+    drawtranscolfunc = transcolfunc;
+    drawspanfunc = spanfunc;
+
+    colfunc = &R_QueueColumn;
+    basecolfunc = &R_QueueColumn;
+    fuzzcolfunc = &R_QueueFuzzColumn;
+    transcolfunc = &R_QueueTranslatedColumn;
+    spanfunc = &R_QueueSpan;
+}
+
+void R_BeginThreadedFrame(void) {
+    numdrawcmds = 0;
+
+    // Queued columns may point into cached lumps, which have to be drawn
+    // before the zone is allowed to reuse them.
+    Z_SetPurgeCallback(R_FlushDrawQueue);
+}
+
+void R_FinishThreadedFrame(void) {
+    R_FlushDrawQueue();
+    Z_SetPurgeCallback(NULL);
+}
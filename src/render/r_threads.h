@@ -0,0 +1,36 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Multithreaded drawing.
+//
+
+
+#ifndef __R_THREADS__
+#define __R_THREADS__
+
+// Start the worker threads requested with -rthreads. Called by R_Init.
+void R_InitThreads(void);
+
+// True if the view is drawn by more than one thread.
+bool R_ThreadsEnabled(void);
+
+// Wrap colfunc/spanfunc and friends so that they queue their work.
+void R_QueueDrawFuncs(void);
+
+// Called around the rendering of a frame; drawing happens in the latter.
+void R_BeginThreadedFrame(void);
+void R_FinishThreadedFrame(void);
+
+#endif
@@ -20,9 +20,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <SDL.h>
+
 #include "dstrings.h"
 #include "deh_str.h"
 #include "i_system.h"
+#include "memio.h"
 #include "z_zone.h"
 #include "p_local.h"
 #include "p_saveg.h"
@@ -38,9 +47,24 @@
 #include "m_misc.h"
 #include "r_state.h"
 
-FILE* save_stream;
+MEMFILE* save_stream;
 bool savegame_error;
 
+// The whole savegame file, while it is being loaded.
+static byte* save_buffer;
+
+// A savegame being written by a background thread.
+typedef struct {
+    SDL_Thread* thread;
+    SDL_atomic_t done;
+    bool succeeded;
+    char* temp_filename;
+    char* filename;
+    savegame_status_t callback;
+} savegamewrite_t;
+
+static savegamewrite_t savewrite;
+
 // Get the filename of a temporary file to write the savegame to.  After
 // the file has been successfully saved, it will be renamed to the
 // real file.
@@ -73,12 +97,199 @@ char* P_SaveGameFile(int slot) {
     return filename;
 }
 
-// Endian-safe integer read/write functions
+//
+// Savegames are built up in memory and written out with a single fwrite,
+// and loaded by reading the whole file at once.
+//
 
-static byte saveg_read8() {
-    byte result = -1;
+void P_OpenSaveGameWrite() {
+    save_stream = mem_fopen_write();
+    savegame_error = false;
+}
+
+long P_SaveGameLength() {
+    return mem_ftell(save_stream);
+}
+
+//
+// Write the serialized savegame to a file. If durable is set, do not
+// return until the operating system has the data on disk.
+//
+static bool P_WriteSaveGameBuffer(const char* filename, bool durable) {
+    void* buf;
+    size_t length;
+    mem_get_buf(save_stream, &buf, &length);
+
+    FILE* file = M_fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t count = fwrite(buf, 1, length, file);
+
+    // Only report success once the data has reached the file.
+    bool flushed = fflush(file) == 0;
+    if (flushed && durable) {
+#ifdef _WIN32
+        flushed = _commit(_fileno(file)) == 0;
+#else
+        flushed = fsync(fileno(file)) == 0;
+#endif
+    }
+    bool closed = fclose(file) == 0;
+    return count == length && flushed && closed;
+}
+
+static bool P_CommitSaveGame(const char* temp_filename, const char* filename, bool durable) {
+    if (!P_WriteSaveGameBuffer(temp_filename, durable)) {
+        M_remove(temp_filename);
+        return false;
+    }
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows.
+    M_remove(filename);
+#endif
+    return M_rename(temp_filename, filename) == 0;
+}
+
+//
+// Write the savegame to the temporary file, and only then rename it over
+// the real file, so that an existing savegame is never replaced by a
+// partly written one.
+//
+bool P_WriteSaveGameFile(const char* temp_filename, const char* filename) {
+    return P_CommitSaveGame(temp_filename, filename, false);
+}
+
+//
+// Write the savegame somewhere else, when it could not be written to
+// the savegame directory.
+//
+bool P_WriteSaveGameRecovery(const char* filename) {
+    return P_WriteSaveGameBuffer(filename, false);
+}
+
+//
+// Background savegame writes. The game is serialized into save_stream
+// during the tic, which is fast, and a thread does the file I/O. Until the
+// write has finished, save_stream belongs to that thread and is only read
+// by it; any other savegame operation waits for it first.
+//
+
+static int P_SaveGameWriter(void* data) {
+    savegamewrite_t* write = data;
+
+    write->succeeded = P_CommitSaveGame(write->temp_filename, write->filename, true);
+    SDL_AtomicSet(&write->done, 1);
 
-    if (fread(&result, 1, 1, save_stream) < 1) {
+    return 0;
+}
+
+//
+// Wait for the thread, without telling anyone. Used at exit, so that a
+// savegame being written when the game quits is not lost.
+//
+static void P_JoinSaveGameWriter() {
+    if (savewrite.thread != NULL) {
+        SDL_WaitThread(savewrite.thread, NULL);
+        savewrite.thread = NULL;
+    }
+}
+
+//
+// Report the result of a finished write through its callback, which may
+// still use save_stream, e.g. to write a recovery file, and release it.
+//
+static void P_FinishSaveGameWrite() {
+    P_JoinSaveGameWriter();
+
+    savegame_status_t callback = savewrite.callback;
+    savewrite.callback = NULL;
+    callback(savewrite.filename, savewrite.succeeded);
+
+    P_CloseSaveGame();
+    free(savewrite.temp_filename);
+    free(savewrite.filename);
+    savewrite.temp_filename = NULL;
+    savewrite.filename = NULL;
+}
+
+//
+// Start writing the serialized savegame in the background. callback is
+// called from P_UpdateSaveGameWrite, on the main thread, once the file
+// is safely on disk or the write has failed.
+//
+void P_WriteSaveGameInBackground(const char* temp_filename, const char* filename,
+                                 savegame_status_t callback) {
+    static bool registered = false;
+    if (!registered) {
+        I_AtExit(P_JoinSaveGameWriter, false);
+        registered = true;
+    }
+
+    savewrite.temp_filename = M_StringDuplicate(temp_filename);
+    savewrite.filename = M_StringDuplicate(filename);
+    savewrite.callback = callback;
+    savewrite.succeeded = false;
+    SDL_AtomicSet(&savewrite.done, 0);
+
+    savewrite.thread = SDL_CreateThread(P_SaveGameWriter, "P_SaveGameWriter", &savewrite);
+    if (savewrite.thread == NULL) {
+        // No thread, so write it now.
+        P_SaveGameWriter(&savewrite);
+    }
+}
+
+bool P_SaveGameWritePending(void) {
+    return savewrite.callback != NULL;
+}
+
+//
+// Called every tic. Never blocks.
+//
+void P_UpdateSaveGameWrite(void) {
+    if (P_SaveGameWritePending() && SDL_AtomicGet(&savewrite.done)) {
+        P_FinishSaveGameWrite();
+    }
+}
+
+//
+// Block until a background write, if there is one, has finished.
+//
+void P_WaitSaveGameWrite(void) {
+    if (P_SaveGameWritePending()) {
+        P_FinishSaveGameWrite();
+    }
+}
+
+bool P_OpenSaveGameRead(const char* filename) {
+    FILE* file = M_fopen(filename, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    long length = M_FileLength(file);
+    save_buffer = Z_Malloc(length, PU_STATIC, NULL);
+    size_t count = fread(save_buffer, 1, length, file);
+    fclose(file);
+
+    // A short read shows up as an unexpected end of file while loading.
+    save_stream = mem_fopen_read(save_buffer, count);
+    savegame_error = false;
+    return true;
+}
+
+void P_CloseSaveGame() {
+    mem_fclose(save_stream);
+    save_stream = NULL;
+    if (save_buffer != NULL) {
+        Z_Free(save_buffer);
+        save_buffer = NULL;
+    }
+}
+
+// Endian-safe integer read/write functions
+
+static void saveg_read_bytes(byte* bytes, int count) {
+    if (mem_fread(bytes, 1, count, save_stream) < (size_t) count) {
         if (!savegame_error) {
             fprintf(stderr, "saveg_read8: Unexpected end of file while "
                             "reading save game\n");
@@ -86,12 +297,10 @@ static byte saveg_read8() {
             savegame_error = true;
         }
     }
-
-    return result;
 }
 
-static void saveg_write8(byte value) {
-    if (fwrite(&value, 1, 1, save_stream) < 1) {
+static void saveg_write_bytes(const byte* bytes, int count) {
+    if (mem_fwrite(bytes, 1, count, save_stream) < (size_t) count) {
         if (!savegame_error) {
             fprintf(stderr, "saveg_write8: Error while writing save game\n");
             savegame_error = true;
@@ -99,48 +308,54 @@ static void saveg_write8(byte value) {
     }
 }
 
-static short saveg_read16() {
-    int result = saveg_read8();
-    result |= saveg_read8() << 8;
+static byte saveg_read8() {
+    byte result = -1;
+    saveg_read_bytes(&result, 1);
     return result;
 }
 
+static void saveg_write8(byte value) {
+    saveg_write_bytes(&value, 1);
+}
+
+static short saveg_read16() {
+    byte bytes[2] = {0xff, 0xff};
+    saveg_read_bytes(bytes, 2);
+    return bytes[0] | (bytes[1] << 8);
+}
+
 static void saveg_write16(short value) {
-    saveg_write8(value & 0xff);
-    saveg_write8((value >> 8) & 0xff);
+    byte bytes[2] = {value & 0xff, (value >> 8) & 0xff};
+    saveg_write_bytes(bytes, 2);
 }
 
 static int saveg_read32() {
-    int result = saveg_read8();
-    result |= saveg_read8() << 8;
-    result |= saveg_read8() << 16;
-    result |= saveg_read8() << 24;
-    return result;
+    byte bytes[4] = {0xff, 0xff, 0xff, 0xff};
+    saveg_read_bytes(bytes, 4);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned) bytes[3] << 24);
 }
 
 static void saveg_write32(int value) {
-    saveg_write8(value & 0xff);
-    saveg_write8((value >> 8) & 0xff);
-    saveg_write8((value >> 16) & 0xff);
-    saveg_write8((value >> 24) & 0xff);
+    byte bytes[4] = {
+        value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff
+    };
+    saveg_write_bytes(bytes, 4);
 }
 
 // Pad to 4-byte boundaries
 
 static void saveg_read_pad(void) {
-    unsigned long pos = ftell(save_stream);
+    unsigned long pos = mem_ftell(save_stream);
     int padding = (4 - (pos & 3)) & 3;
-    for (int i = 0; i < padding; ++i) {
-        saveg_read8();
-    }
+    byte bytes[3];
+    saveg_read_bytes(bytes, padding);
 }
 
 static void saveg_write_pad(void) {
-    unsigned long pos = ftell(save_stream);
+    unsigned long pos = mem_ftell(save_stream);
     int padding = (4 - (pos & 3)) & 3;
-    for (int i = 0; i < padding; ++i) {
-        saveg_write8(0);
-    }
+    static const byte zeros[3] = {0, 0, 0};
+    saveg_write_bytes(zeros, padding);
 }
 
 
@@ -1487,7 +1702,7 @@ void P_ArchiveThinkers() {
 static void P_UnArchiveMobj() {
     saveg_read_pad();
 
-    mobj_t* mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
+    mobj_t* mobj = P_AllocThinker(tp_mobj, sizeof(*mobj));
     saveg_read_mobj_t(mobj);
 
     mobj->target = NULL;
@@ -1511,7 +1726,7 @@ static void P_ResetThinkers() {
         if (curr_thinker->function.acp1 == (actionf_p1) P_MobjThinker) {
             P_RemoveMobj((mobj_t*) curr_thinker);
         } else {
-            Z_Free(curr_thinker);
+            P_FreeThinkerMemory(curr_thinker);
         }
         curr_thinker = next;
     }
@@ -1644,7 +1859,7 @@ void P_ArchiveSpecials(void) {
 
 static void P_UnArchiveGlowLight() {
     saveg_read_pad();
-    glow_t* glow = Z_Malloc(sizeof(*glow), PU_LEVEL, NULL);
+    glow_t* glow = P_AllocThinker(tp_glow, sizeof(*glow));
     saveg_read_glow_t(glow);
     glow->thinker.function.acp1 = (actionf_p1) T_Glow;
     P_AddThinker(&glow->thinker);
@@ -1652,7 +1867,7 @@ static void P_UnArchiveGlowLight() {
 
 static void P_UnArchiveStrobeLight() {
     saveg_read_pad();
-    strobe_t* strobe = Z_Malloc(sizeof(*strobe), PU_LEVEL, NULL);
+    strobe_t* strobe = P_AllocThinker(tp_strobe, sizeof(*strobe));
     saveg_read_strobe_t(strobe);
     strobe->thinker.function.acp1 = (actionf_p1) T_StrobeFlash;
     P_AddThinker(&strobe->thinker);
@@ -1660,7 +1875,7 @@ static void P_UnArchiveStrobeLight() {
 
 static void P_UnArchiveFlashLight() {
     saveg_read_pad();
-    lightflash_t* flash = Z_Malloc(sizeof(*flash), PU_LEVEL, NULL);
+    lightflash_t* flash = P_AllocThinker(tp_lightflash, sizeof(*flash));
     saveg_read_lightflash_t(flash);
     flash->thinker.function.acp1 = (actionf_p1) T_LightFlash;
     P_AddThinker(&flash->thinker);
@@ -1668,7 +1883,7 @@ static void P_UnArchiveFlashLight() {
 
 static void P_UnArchivePlatform() {
     saveg_read_pad();
-    plat_t* plat = Z_Malloc(sizeof(*plat), PU_LEVEL, NULL);
+    plat_t* plat = P_AllocThinker(tp_plat, sizeof(*plat));
     saveg_read_plat_t(plat);
     plat->sector->specialdata = plat;
     if (plat->thinker.function.acp1) {
@@ -1680,7 +1895,7 @@ static void P_UnArchivePlatform() {
 
 static void P_UnArchiveFloor() {
     saveg_read_pad();
-    floormove_t* floor = Z_Malloc(sizeof(*floor), PU_LEVEL, NULL);
+    floormove_t* floor = P_AllocThinker(tp_floor, sizeof(*floor));
     saveg_read_floormove_t(floor);
     floor->sector->specialdata = floor;
     floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -1689,7 +1904,7 @@ static void P_UnArchiveFloor() {
 
 static void P_UnArchiveDoor() {
     saveg_read_pad();
-    vldoor_t* door = Z_Malloc(sizeof(*door), PU_LEVEL, NULL);
+    vldoor_t* door = P_AllocThinker(tp_door, sizeof(*door));
     saveg_read_vldoor_t(door);
     door->sector->specialdata = door;
     door->thinker.function.acp1 = (actionf_p1) T_VerticalDoor;
@@ -1698,7 +1913,7 @@ static void P_UnArchiveDoor() {
 
 static void P_UnArchiveCeiling() {
     saveg_read_pad();
-    ceiling_t* ceiling = Z_Malloc(sizeof(*ceiling), PU_LEVEL, NULL);
+    ceiling_t* ceiling = P_AllocThinker(tp_ceiling, sizeof(*ceiling));
     saveg_read_ceiling_t(ceiling);
     ceiling->sector->specialdata = ceiling;
     if (ceiling->thinker.function.acp1) {
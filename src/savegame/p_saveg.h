@@ -20,7 +20,7 @@
 #ifndef __P_SAVEG__
 #define __P_SAVEG__
 
-#include <stdio.h>
+#include "memio.h"
 
 #define SAVEGAME_EOF 0x1d
 #define VERSIONSIZE 16
@@ -37,6 +37,29 @@ char *P_TempSaveGameFile(void);
 
 char *P_SaveGameFile(int slot);
 
+// Savegames are serialized to and from memory. Reading loads the whole
+// file up front; writing goes to the temporary file, which is then
+// renamed over the savegame.
+
+bool P_OpenSaveGameRead(const char *filename);
+void P_OpenSaveGameWrite(void);
+long P_SaveGameLength(void);
+bool P_WriteSaveGameFile(const char *temp_filename, const char *filename);
+bool P_WriteSaveGameRecovery(const char *filename);
+void P_CloseSaveGame(void);
+
+// Background savegame writes. The status callback is called on the main
+// thread, from P_UpdateSaveGameWrite, once the savegame is durable on
+// disk or has failed to be written.
+
+typedef void (*savegame_status_t)(const char *filename, bool succeeded);
+
+void P_WriteSaveGameInBackground(const char *temp_filename, const char *filename,
+                                 savegame_status_t callback);
+bool P_SaveGameWritePending(void);
+void P_UpdateSaveGameWrite(void);
+void P_WaitSaveGameWrite(void);
+
 // Savegame file header read/write functions
 
 bool P_ReadSaveGameHeader(void);
@@ -58,7 +81,7 @@ void P_UnArchiveThinkers (void);
 void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 
-extern FILE *save_stream;
+extern MEMFILE *save_stream;
 extern bool savegame_error;
 
 
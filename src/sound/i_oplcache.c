@@ -0,0 +1,767 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Cache of pre-rendered OPL music.
+//
+//      With opl_rendercache, each looping song is emulated once, on a
+//      thread of its own, from a capture of the register writes that
+//      i_oplmusic.c makes.  The samples are saved as IMA ADPCM, one
+//      file per song, and later played from the file in place of the
+//      emulator.  Songs are keyed by a SHA-1 of everything that decides
+//      how they sound; a file is only valid for the sample rate it was
+//      rendered at.  It is only ever used by the machine that wrote it,
+//      so it is in native byte order.
+//
+
+#include "config.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "SDL.h"
+
+#include "i_oplcache.h"
+#include "m_argv.h"
+#include "m_config.h"
+#include "m_misc.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+#define OPLCACHE_MAGIC "BRMOPLC"
+#define OPLCACHE_VERSION 1
+#define OPLCACHE_BYTEORDER 0x01020304
+
+// Samples per block.  Every block starts with the decoder state of each
+// channel, so playback can start in any block.
+
+#define OPLCACHE_BLOCK_SAMPLES 1024
+
+// Seconds of music to keep read ahead of the playback position.
+
+#define OPLCACHE_PREFETCH_TIME 4
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    sha1_digest_t key;
+    uint32_t samplerate;
+    uint32_t channels;
+
+    // Samples rendered.  Playback loops back from the end to loop_start.
+    uint32_t length;
+    uint32_t loop_start;
+
+    uint32_t filelength;
+} oplcacheheader_t;
+
+typedef struct
+{
+    int16_t predictor;
+    uint8_t index;
+    uint8_t unused;
+} adpcmheader_t;
+
+typedef struct
+{
+    int predictor;
+    int index;
+} adpcmstate_t;
+
+struct oplcache_s
+{
+    wad_file_t *file;
+    byte *data;
+
+    const oplcacheheader_t *header;
+    const byte *blocks;
+    unsigned int block_size;
+    unsigned int num_blocks;
+
+    // Playback position, in samples.  Only the audio thread writes it.
+    SDL_atomic_t position;
+
+    // The block decoded last, as stereo samples.
+    unsigned int decoded;
+    int16_t samples[OPLCACHE_BLOCK_SAMPLES * 2];
+
+    // Blocks read ahead by I_OPL_PrefetchCache.
+    unsigned int prefetch_start;
+    unsigned int prefetch_end;
+};
+
+// A song being rendered.  Until done is set, everything else belongs to
+// the render thread.
+
+typedef struct
+{
+    SDL_Thread *thread;
+    SDL_atomic_t done;
+    SDL_atomic_t cancel;
+
+    opl_capture_t capture;
+    sha1_digest_t key;
+    char *path;
+    unsigned int rate;
+    int channels;
+    uint32_t length;
+    uint32_t loop_start;
+} oplrender_t;
+
+static oplrender_t render;
+
+static SDL_atomic_t stream_gain;
+
+//
+// IMA ADPCM.
+//
+
+static const int adpcm_steps[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int adpcm_index_steps[8] =
+{
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+// Apply a code to the decoder state; the encoder does the same, so both
+// always agree on the prediction.
+
+static int DecodeNibble(adpcmstate_t *state, int nibble)
+{
+    int step = adpcm_steps[state->index];
+    int delta = step >> 3;
+
+    if (nibble & 4)
+    {
+        delta += step;
+    }
+    if (nibble & 2)
+    {
+        delta += step >> 1;
+    }
+    if (nibble & 1)
+    {
+        delta += step >> 2;
+    }
+
+    if (nibble & 8)
+    {
+        state->predictor -= delta;
+    }
+    else
+    {
+        state->predictor += delta;
+    }
+
+    if (state->predictor < -32768)
+    {
+        state->predictor = -32768;
+    }
+    else if (state->predictor > 32767)
+    {
+        state->predictor = 32767;
+    }
+
+    state->index += adpcm_index_steps[nibble & 7];
+
+    if (state->index < 0)
+    {
+        state->index = 0;
+    }
+    else if (state->index > 88)
+    {
+        state->index = 88;
+    }
+
+    return state->predictor;
+}
+
+static int EncodeSample(adpcmstate_t *state, int sample)
+{
+    int step = adpcm_steps[state->index];
+    int diff = sample - state->predictor;
+    int nibble = 0;
+
+    if (diff < 0)
+    {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    if (diff >= step)
+    {
+        nibble |= 4;
+        diff -= step;
+    }
+    if (diff >= step >> 1)
+    {
+        nibble |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= step >> 2)
+    {
+        nibble |= 1;
+    }
+
+    DecodeNibble(state, nibble);
+
+    return nibble;
+}
+
+// Encode a block of stereo samples.  Mono blocks take the average of the
+// two channels: without OPL3 mode they differ only by rounding.
+
+static void EncodeBlock(byte *out, const int16_t *samples, int channels,
+                        adpcmstate_t *states)
+{
+    adpcmheader_t *header = (adpcmheader_t *) out;
+    byte *codes = out + channels * sizeof(adpcmheader_t);
+    int i, c;
+
+    memset(codes, 0, OPLCACHE_BLOCK_SAMPLES * channels / 2);
+
+    for (c = 0; c < channels; ++c)
+    {
+        header[c].predictor = states[c].predictor;
+        header[c].index = states[c].index;
+        header[c].unused = 0;
+    }
+
+    for (i = 0; i < OPLCACHE_BLOCK_SAMPLES; ++i)
+    {
+        for (c = 0; c < channels; ++c)
+        {
+            int n = i * channels + c;
+            int sample;
+
+            if (channels == 1)
+            {
+                sample = (samples[i * 2] + samples[i * 2 + 1]) >> 1;
+            }
+            else
+            {
+                sample = samples[i * 2 + c];
+            }
+
+            codes[n / 2] |= EncodeSample(&states[c], sample) << ((n & 1) * 4);
+        }
+    }
+}
+
+static void DecodeBlock(oplcache_t *cache, unsigned int block)
+{
+    const byte *data = cache->blocks + (size_t) block * cache->block_size;
+    const adpcmheader_t *header = (const adpcmheader_t *) data;
+    int channels = cache->header->channels;
+    const byte *codes = data + channels * sizeof(adpcmheader_t);
+    adpcmstate_t states[2];
+    int i, c;
+
+    for (c = 0; c < channels; ++c)
+    {
+        states[c].predictor = header[c].predictor;
+        states[c].index = header[c].index <= 88 ? header[c].index : 88;
+    }
+
+    for (i = 0; i < OPLCACHE_BLOCK_SAMPLES; ++i)
+    {
+        for (c = 0; c < channels; ++c)
+        {
+            int n = i * channels + c;
+            int nibble = (codes[n / 2] >> ((n & 1) * 4)) & 0xf;
+
+            cache->samples[i * 2 + c] = DecodeNibble(&states[c], nibble);
+        }
+
+        if (channels == 1)
+        {
+            cache->samples[i * 2 + 1] = cache->samples[i * 2];
+        }
+    }
+
+    cache->decoded = block;
+}
+
+//
+// Cache files.
+//
+
+static unsigned int BlockSize(int channels)
+{
+    return channels * sizeof(adpcmheader_t)
+         + OPLCACHE_BLOCK_SAMPLES * channels / 2;
+}
+
+static unsigned int NumBlocks(uint32_t length)
+{
+    return (length + OPLCACHE_BLOCK_SAMPLES - 1) / OPLCACHE_BLOCK_SAMPLES;
+}
+
+static char *CacheDirectory(void)
+{
+    //!
+    // @category sound
+    // @arg <directory>
+    //
+    // Keep pre-rendered OPL music (see opl_rendercache) in the given
+    // directory.  The default is oplcache in the configuration
+    // directory.
+    //
+
+    int p = M_CheckParmWithArgs("-oplcache", 1);
+
+    if (p > 0)
+    {
+        return M_StringDuplicate(myargv[p + 1]);
+    }
+
+    return M_StringJoin(configdir, "oplcache", NULL);
+}
+
+static char *CachePath(sha1_digest_t key)
+{
+    char name[sizeof(sha1_digest_t) * 2 + 5];
+    char *dir, *path;
+    int i;
+
+    for (i = 0; i < sizeof(sha1_digest_t); ++i)
+    {
+        M_snprintf(name + i * 2, sizeof(name) - i * 2, "%02x", key[i]);
+    }
+
+    M_StringConcat(name, ".opl", sizeof(name));
+
+    dir = CacheDirectory();
+    path = M_StringJoin(dir, DIR_SEPARATOR_S, name, NULL);
+    free(dir);
+
+    return path;
+}
+
+static bool CacheHeaderValid(const oplcacheheader_t *header,
+                             uint32_t length, sha1_digest_t key,
+                             unsigned int rate)
+{
+    return length >= sizeof(*header)
+        && memcmp(header->magic, OPLCACHE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == OPLCACHE_VERSION
+        && header->byteorder == OPLCACHE_BYTEORDER
+        && memcmp(header->key, key, sizeof(sha1_digest_t)) == 0
+        && header->samplerate == rate
+        && (header->channels == 1 || header->channels == 2)
+        && header->loop_start < header->length
+        && header->filelength == length
+        && (length - sizeof(*header)) / BlockSize(header->channels)
+               == NumBlocks(header->length);
+}
+
+oplcache_t *I_OPL_OpenCache(sha1_digest_t key, unsigned int rate)
+{
+    oplcache_t *cache;
+    wad_file_t *file;
+    char *path;
+    byte *data;
+
+    path = CachePath(key);
+    file = M_FileExists(path) ? W_OpenFile(path) : NULL;
+    free(path);
+
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    // Without a mapping, read the whole file into the zone.
+
+    data = file->mapped;
+
+    if (data == NULL)
+    {
+        data = Z_Malloc(file->length, PU_STATIC, NULL);
+
+        if (W_Read(file, 0, data, file->length) < file->length)
+        {
+            Z_Free(data);
+            W_CloseFile(file);
+            return NULL;
+        }
+    }
+
+    if (!CacheHeaderValid((const oplcacheheader_t *) data, file->length,
+                          key, rate))
+    {
+        if (file->mapped == NULL)
+        {
+            Z_Free(data);
+        }
+
+        W_CloseFile(file);
+        return NULL;
+    }
+
+    cache = Z_Malloc(sizeof(oplcache_t), PU_STATIC, NULL);
+    cache->file = file;
+    cache->data = data;
+    cache->header = (const oplcacheheader_t *) data;
+    cache->blocks = data + sizeof(oplcacheheader_t);
+    cache->block_size = BlockSize(cache->header->channels);
+    cache->num_blocks = NumBlocks(cache->header->length);
+    cache->decoded = UINT_MAX;
+    cache->prefetch_start = 0;
+    cache->prefetch_end = 0;
+    SDL_AtomicSet(&cache->position, 0);
+
+    return cache;
+}
+
+void I_OPL_CloseCache(oplcache_t *cache)
+{
+    if (cache->file->mapped == NULL)
+    {
+        Z_Free(cache->data);
+    }
+
+    W_CloseFile(cache->file);
+    Z_Free(cache);
+}
+
+//
+// Streaming.
+//
+
+static void StreamCallback(int16_t *buffer, unsigned int nsamples, void *data)
+{
+    oplcache_t *cache = data;
+    uint32_t position = SDL_AtomicGet(&cache->position);
+    int gain = SDL_AtomicGet(&stream_gain);
+
+    while (nsamples > 0)
+    {
+        unsigned int block = position / OPLCACHE_BLOCK_SAMPLES;
+        unsigned int offset = position % OPLCACHE_BLOCK_SAMPLES;
+        unsigned int count = OPLCACHE_BLOCK_SAMPLES - offset;
+        const int16_t *samples;
+        unsigned int i;
+
+        if (count > cache->header->length - position)
+        {
+            count = cache->header->length - position;
+        }
+        if (count > nsamples)
+        {
+            count = nsamples;
+        }
+
+        if (block != cache->decoded)
+        {
+            DecodeBlock(cache, block);
+        }
+
+        samples = cache->samples + offset * 2;
+
+        for (i = 0; i < count * 2; ++i)
+        {
+            buffer[i] = (samples[i] * gain) >> 16;
+        }
+
+        buffer += count * 2;
+        nsamples -= count;
+        position += count;
+
+        if (position >= cache->header->length)
+        {
+            position = cache->header->loop_start;
+        }
+    }
+
+    SDL_AtomicSet(&cache->position, position);
+}
+
+void I_OPL_StreamCache(oplcache_t *cache, bool from_loop)
+{
+    uint32_t position = from_loop ? cache->header->loop_start : 0;
+
+    cache->decoded = UINT_MAX;
+    SDL_AtomicSet(&cache->position, position);
+
+    OPL_SetStream(StreamCallback, cache);
+}
+
+void I_OPL_SetCacheGain(int gain)
+{
+    SDL_AtomicSet(&stream_gain, gain);
+}
+
+void I_OPL_PrefetchCache(oplcache_t *cache)
+{
+    unsigned int block, ahead, loop_block, wrapped;
+
+    block = SDL_AtomicGet(&cache->position) / OPLCACHE_BLOCK_SAMPLES;
+    ahead = cache->header->samplerate * OPLCACHE_PREFETCH_TIME
+          / OPLCACHE_BLOCK_SAMPLES + 1;
+
+    // Only read ahead again when half the window has been played.
+
+    if (block >= cache->prefetch_start
+     && block + ahead / 2 < cache->prefetch_end)
+    {
+        return;
+    }
+
+    cache->prefetch_start = block;
+    cache->prefetch_end = block + ahead;
+
+    if (cache->prefetch_end <= cache->num_blocks)
+    {
+        W_Prefetch(cache->file, cache->blocks - cache->data
+                                + block * cache->block_size,
+                   ahead * cache->block_size);
+        return;
+    }
+
+    // The window wraps around to the loop point.
+
+    loop_block = cache->header->loop_start / OPLCACHE_BLOCK_SAMPLES;
+
+    W_Prefetch(cache->file, cache->blocks - cache->data
+                            + block * cache->block_size,
+               (cache->num_blocks - block) * cache->block_size);
+    wrapped = cache->prefetch_end - cache->num_blocks;
+
+    if (wrapped > cache->num_blocks - loop_block)
+    {
+        wrapped = cache->num_blocks - loop_block;
+    }
+
+    W_Prefetch(cache->file, cache->blocks - cache->data
+                            + loop_block * cache->block_size,
+               wrapped * cache->block_size);
+}
+
+//
+// Rendering.
+//
+
+// Render the song to a temporary file and rename it into place, so a
+// cache is never seen half written.
+
+static bool RenderSong(oplrender_t *job, const char *temp)
+{
+    oplcacheheader_t header;
+    adpcmstate_t states[2];
+    opl_render_t *opl_render;
+    int16_t *samples;
+    byte *block;
+    unsigned int block_size, num_blocks, i;
+    bool result = true;
+    FILE *stream;
+
+    block_size = BlockSize(job->channels);
+    num_blocks = NumBlocks(job->length);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OPLCACHE_MAGIC, sizeof(header.magic));
+    header.version = OPLCACHE_VERSION;
+    header.byteorder = OPLCACHE_BYTEORDER;
+    memcpy(header.key, job->key, sizeof(sha1_digest_t));
+    header.samplerate = job->rate;
+    header.channels = job->channels;
+    header.length = job->length;
+    header.loop_start = job->loop_start;
+    header.filelength = sizeof(header) + num_blocks * block_size;
+
+    stream = M_fopen(temp, "wb");
+
+    if (stream == NULL)
+    {
+        return false;
+    }
+
+    opl_render = OPL_StartRender(&job->capture, job->rate);
+    samples = malloc(OPLCACHE_BLOCK_SAMPLES * 2 * sizeof(int16_t));
+    block = malloc(block_size);
+
+    if (opl_render == NULL || samples == NULL || block == NULL
+     || fwrite(&header, sizeof(header), 1, stream) != 1)
+    {
+        result = false;
+    }
+
+    memset(states, 0, sizeof(states));
+
+    for (i = 0; result && i < num_blocks; ++i)
+    {
+        if (SDL_AtomicGet(&job->cancel))
+        {
+            result = false;
+            break;
+        }
+
+        // The last block runs on past the end of the song; it is never
+        // played.
+
+        OPL_Render(opl_render, samples, OPLCACHE_BLOCK_SAMPLES);
+        EncodeBlock(block, samples, job->channels, states);
+
+        if (fwrite(block, block_size, 1, stream) != 1)
+        {
+            result = false;
+        }
+    }
+
+    if (fclose(stream) != 0)
+    {
+        result = false;
+    }
+
+    if (opl_render != NULL)
+    {
+        OPL_FinishRender(opl_render);
+    }
+
+    free(samples);
+    free(block);
+
+    return result;
+}
+
+static int RenderThread(void *data)
+{
+    oplrender_t *job = data;
+    char suffix[32];
+    char *temp;
+
+    M_snprintf(suffix, sizeof(suffix), ".%lx.tmp",
+               (unsigned long) ((uintptr_t) job ^ (uintptr_t) time(NULL)));
+    temp = M_StringJoin(job->path, suffix, NULL);
+
+    if (RenderSong(job, temp))
+    {
+#ifdef _WIN32
+        M_remove(job->path);
+#endif
+        if (M_rename(temp, job->path) != 0)
+        {
+            M_remove(temp);
+        }
+    }
+    else
+    {
+        M_remove(temp);
+    }
+
+    free(temp);
+
+    SDL_AtomicSet(&job->done, 1);
+
+    return 0;
+}
+
+bool I_OPL_RenderCache(sha1_digest_t key, opl_capture_t *capture,
+                       uint64_t loop_start, uint64_t loop_end,
+                       unsigned int rate, int channels)
+{
+    char *dir;
+
+    if (render.thread != NULL)
+    {
+        return false;
+    }
+
+    dir = CacheDirectory();
+    M_MakeDirectory(dir);
+    free(dir);
+
+    // Times are rounded up to samples the same way OPL_Render does.
+
+    render.capture = *capture;
+    memcpy(render.key, key, sizeof(sha1_digest_t));
+    render.path = CachePath(key);
+    render.rate = rate;
+    render.channels = channels;
+    render.length = (loop_end * rate + OPL_SECOND - 1) / OPL_SECOND;
+    render.loop_start = (loop_start * rate + OPL_SECOND - 1) / OPL_SECOND;
+    SDL_AtomicSet(&render.done, 0);
+    SDL_AtomicSet(&render.cancel, 0);
+
+    capture->writes = NULL;
+    capture->num_writes = 0;
+    capture->max_writes = 0;
+
+    render.thread = SDL_CreateThread(RenderThread, "OPL render", &render);
+
+    if (render.thread == NULL)
+    {
+        // Rendering here would stall the game for seconds.
+
+        OPL_FreeCapture(&render.capture);
+        free(render.path);
+        render.path = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+bool I_OPL_RenderingCache(void)
+{
+    return render.thread != NULL;
+}
+
+static void FinishRender(void)
+{
+    SDL_WaitThread(render.thread, NULL);
+    render.thread = NULL;
+
+    OPL_FreeCapture(&render.capture);
+    free(render.path);
+    render.path = NULL;
+}
+
+bool I_OPL_RenderFinished(sha1_digest_t key)
+{
+    if (render.thread == NULL || !SDL_AtomicGet(&render.done))
+    {
+        return false;
+    }
+
+    FinishRender();
+    memcpy(key, render.key, sizeof(sha1_digest_t));
+
+    return true;
+}
+
+void I_OPL_ShutdownCache(void)
+{
+    if (render.thread != NULL)
+    {
+        SDL_AtomicSet(&render.cancel, 1);
+        FinishRender();
+    }
+}
@@ -0,0 +1,69 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Cache of pre-rendered OPL music.
+//
+
+#ifndef I_OPLCACHE_H
+#define I_OPLCACHE_H
+
+#include "doomtype.h"
+#include "opl.h"
+#include "sha1.h"
+
+typedef struct oplcache_s oplcache_t;
+
+// Open the rendering of the song with the given key, or return NULL if
+// it has not been rendered at this rate yet.
+
+oplcache_t *I_OPL_OpenCache(sha1_digest_t key, unsigned int rate);
+
+void I_OPL_CloseCache(oplcache_t *cache);
+
+// Play a cached song in place of the emulator, from the start or from
+// its loop point.  It loops until OPL_SetStream(NULL, NULL).
+
+void I_OPL_StreamCache(oplcache_t *cache, bool from_loop);
+
+// Gain applied to streamed music, in 16.16 fixed point.
+
+void I_OPL_SetCacheGain(int gain);
+
+// Read ahead of the playback position of a streaming cache.
+
+void I_OPL_PrefetchCache(oplcache_t *cache);
+
+// Render a capture of a song on a thread of its own and save it under
+// key.  The song is rendered up to loop_end, and loops back to
+// loop_start, both in microseconds.  Takes over the capture, unless
+// another song is still being rendered, when it returns false.
+
+bool I_OPL_RenderCache(sha1_digest_t key, opl_capture_t *capture,
+                       uint64_t loop_start, uint64_t loop_end,
+                       unsigned int rate, int channels);
+
+// Is a song being rendered?
+
+bool I_OPL_RenderingCache(void);
+
+// If a render has finished since the last call, return true and the
+// key of the song.  Its cache can be opened now, if it succeeded.
+
+bool I_OPL_RenderFinished(sha1_digest_t key);
+
+// Abandon any render in progress.
+
+void I_OPL_ShutdownCache(void);
+
+#endif // I_OPLCACHE_H
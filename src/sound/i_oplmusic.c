@@ -25,9 +25,11 @@
 #include "mus2mid.h"
 
 #include "deh_str.h"
+#include "i_oplcache.h"
 #include "i_sound.h"
 #include "i_swap.h"
 #include "m_misc.h"
+#include "sha1.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -46,6 +48,10 @@
 
 #define PERCUSSION_LOG_LEN 16
 
+// Longest a song is played through for, when capturing it to render.
+
+#define MAX_CAPTURE_TIME (30 * 60 * OPL_SECOND)
+
 typedef PACKED_STRUCT (
 {
     byte tremolo;
@@ -106,6 +112,15 @@ typedef struct
     midi_track_iter_t *iter;
 } opl_track_data_t;
 
+// A registered song, and its pre-rendered music if it has any.
+
+typedef struct
+{
+    midi_file_t *file;
+    sha1_digest_t key;
+    oplcache_t *cache;
+} opl_song_t;
+
 typedef struct opl_voice_s opl_voice_t;
 
 struct opl_voice_s
@@ -155,6 +170,17 @@ struct opl_voice_s
     unsigned int priority;
 };
 
+// Voice state, put aside while a song is captured.
+
+typedef struct
+{
+    opl_voice_t voices[OPL_NUM_VOICES * 2];
+    opl_voice_t *free_list[OPL_NUM_VOICES * 2];
+    opl_voice_t *alloced_list[OPL_NUM_VOICES * 2];
+    int free_num;
+    int alloced_num;
+} opl_voice_state_t;
+
 // Operators used by the different voices.
 
 static const int voice_operators[2][OPL_NUM_VOICES] = {
@@ -335,6 +361,15 @@ static opl_track_data_t *tracks;
 static unsigned int num_tracks = 0;
 static unsigned int running_tracks = 0;
 static bool song_looping;
+static unsigned int song_restarts;
+
+// Song being played, and whether it is played from its cache.  When the
+// cache of a song only becomes ready while it plays, it takes over at the
+// next loop point.
+
+static opl_song_t *playing_song = NULL;
+static bool song_streaming = false;
+static bool stream_at_restart = false;
 
 // Tempo control variables
 
@@ -352,12 +387,20 @@ static unsigned int last_perc_count;
 char *snd_dmxoption = "";
 int opl_io_port = 0x388;
 
+// If non-zero, render looping songs once and play them from the cache.
+
+int opl_rendercache = 0;
+
 // If true, OPL sound channels are reversed to their correct arrangement
 // (as intended by the MIDI standard) rather than the backwards one
 // used by DMX due to a bug.
 
 static bool opl_stereo_correct = false;
 
+// SHA-1 of the GENMIDI lump, part of the key of every cached song.
+
+static sha1_digest_t genmidi_digest;
+
 // Load instrument table from GENMIDI lump:
 
 static bool LoadInstrumentTable(void)
@@ -366,6 +409,16 @@ static bool LoadInstrumentTable(void)
 
     lump = W_CacheLumpName(DEH_String("genmidi"), PU_STATIC);
 
+    if (opl_rendercache)
+    {
+        sha1_context_t context;
+
+        SHA1_Init(&context);
+        SHA1_Update(&context, lump,
+                    W_LumpLength(W_GetNumForName(DEH_String("genmidi"))));
+        SHA1_Final(genmidi_digest, &context);
+    }
+
     // DMX does not check header
 
     main_instrs = (genmidi_instr_t *) (lump + strlen(GENMIDI_HEADER));
@@ -632,6 +685,38 @@ static void InitVoices(void)
 static void SetChannelVolume(opl_channel_data_t *channel, unsigned int volume,
                              bool clip_start);
 
+// Songs are rendered at full music volume.  The music volume caps the
+// volume of every channel, which turns the level register down; a
+// streamed song is turned down as far as a note at full volume would
+// be, in 0.75 dB steps.
+
+static int StreamGain(int volume)
+{
+    unsigned int full_level, level, i;
+    float gain = 65536.0f;
+
+    if (volume <= 0)
+    {
+        return 0;
+    }
+    else if (volume > 127)
+    {
+        volume = 127;
+    }
+
+    full_level = (volume_mapping_table[127] * 2
+                  * (volume_mapping_table[127] + 1)) >> 9;
+    level = (volume_mapping_table[127] * 2
+             * (volume_mapping_table[volume] + 1)) >> 9;
+
+    for (i = level; i < full_level; ++i)
+    {
+        gain *= 0.91728f;
+    }
+
+    return (int) gain;
+}
+
 // Set music volume (0 - 127)
 
 static void I_OPL_SetMusicVolume(int volume)
@@ -647,6 +732,8 @@ static void I_OPL_SetMusicVolume(int volume)
 
     current_music_volume = volume;
 
+    I_OPL_SetCacheGain(StreamGain(volume));
+
     // Update the volume of all voices.
 
     for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
@@ -1358,12 +1445,38 @@ static void ProcessEvent(opl_track_data_t *track, midi_event_t *event)
 static void ScheduleTrack(opl_track_data_t *track);
 static void InitChannel(opl_channel_data_t *channel);
 
+// Play the rest of the song from its cache.
+
+static void StartStream(bool from_loop)
+{
+    unsigned int i;
+
+    for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
+    {
+        AllNotesOff(&channels[i], 0);
+    }
+
+    song_streaming = true;
+    I_OPL_StreamCache(playing_song->cache, from_loop);
+}
+
 // Restart a song from the beginning.
 
 static void RestartSong(void *unused)
 {
     unsigned int i;
 
+    ++song_restarts;
+
+    // The restart is where the cache loops back to.
+
+    if (stream_at_restart)
+    {
+        stream_at_restart = false;
+        StartStream(true);
+        return;
+    }
+
     running_tracks = num_tracks;
 
     start_music_volume = current_music_volume;
@@ -1471,20 +1584,12 @@ static void StartTrack(midi_file_t *file, unsigned int track_num)
     ScheduleTrack(track);
 }
 
-// Start playing a mid
+// Start the tracks of a song.
 
-static void I_OPL_PlaySong(void *handle, bool looping)
+static void StartSong(midi_file_t *file, bool looping)
 {
-    midi_file_t *file;
     unsigned int i;
 
-    if (!music_initialized || handle == NULL)
-    {
-        return;
-    }
-
-    file = handle;
-
     // Allocate track data.
 
     tracks = malloc(MIDI_NumTracks(file) * sizeof(opl_track_data_t));
@@ -1511,6 +1616,169 @@ static void I_OPL_PlaySong(void *handle, bool looping)
     {
         InitChannel(&channels[i]);
     }
+}
+
+// Stop all tracks and free their data.
+
+static void StopTracks(void)
+{
+    unsigned int i;
+
+    OPL_ClearCallbacks();
+
+    // Free all voices.
+
+    for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
+    {
+        AllNotesOff(&channels[i], 0);
+    }
+
+    // Free all track data.
+
+    for (i = 0; i < num_tracks; ++i)
+    {
+        MIDI_FreeIterator(tracks[i].iter);
+    }
+
+    free(tracks);
+
+    tracks = NULL;
+    num_tracks = 0;
+}
+
+// Play a song through in virtual time, recording its register writes,
+// until it has restarted twice.  From the first restart on, the song
+// sounds the same every time round, with the notes at its end ringing
+// on into its start; that is the loop point.
+
+static bool CaptureSong(midi_file_t *file, opl_capture_t *capture,
+                        uint64_t *loop_start, uint64_t *loop_end)
+{
+    opl_voice_state_t *saved_voices;
+    uint64_t restart_times[2];
+    int music_volume;
+
+    // The capture starts with fresh voices.  Put the real ones aside,
+    // as they say which instruments are loaded into the chip.
+
+    saved_voices = malloc(sizeof(opl_voice_state_t));
+
+    if (saved_voices == NULL)
+    {
+        return false;
+    }
+
+    memcpy(saved_voices->voices, voices, sizeof(voices));
+    memcpy(saved_voices->free_list, voice_free_list, sizeof(voice_free_list));
+    memcpy(saved_voices->alloced_list, voice_alloced_list,
+           sizeof(voice_alloced_list));
+    saved_voices->free_num = voice_free_num;
+    saved_voices->alloced_num = voice_alloced_num;
+
+    music_volume = current_music_volume;
+    current_music_volume = 127;
+    song_restarts = 0;
+
+    OPL_Lock();
+    OPL_StartCapture(capture);
+
+    InitVoices();
+    OPL_InitRegisters(opl_opl3mode);
+    StartSong(file, true);
+
+    while (song_restarts < 2 && OPL_CaptureTime() < MAX_CAPTURE_TIME)
+    {
+        unsigned int restarts = song_restarts;
+
+        if (!OPL_CaptureStep())
+        {
+            break;
+        }
+
+        if (song_restarts > restarts)
+        {
+            restart_times[song_restarts - 1] = OPL_CaptureTime();
+        }
+    }
+
+    StopTracks();
+    OPL_StopCapture();
+
+    memcpy(voices, saved_voices->voices, sizeof(voices));
+    memcpy(voice_free_list, saved_voices->free_list, sizeof(voice_free_list));
+    memcpy(voice_alloced_list, saved_voices->alloced_list,
+           sizeof(voice_alloced_list));
+    voice_free_num = saved_voices->free_num;
+    voice_alloced_num = saved_voices->alloced_num;
+    free(saved_voices);
+
+    OPL_Unlock();
+
+    current_music_volume = music_volume;
+
+    if (song_restarts < 2)
+    {
+        OPL_FreeCapture(capture);
+        return false;
+    }
+
+    *loop_start = restart_times[0];
+    *loop_end = restart_times[1];
+
+    return true;
+}
+
+// Capture a song and render it in the background.
+
+static void RenderSong(opl_song_t *song)
+{
+    opl_capture_t capture;
+    uint64_t loop_start, loop_end;
+
+    if (!CaptureSong(song->file, &capture, &loop_start, &loop_end))
+    {
+        return;
+    }
+
+    if (!I_OPL_RenderCache(song->key, &capture, loop_start, loop_end,
+                           OPL_StreamRate(), opl_opl3mode ? 2 : 1))
+    {
+        OPL_FreeCapture(&capture);
+    }
+}
+
+// Start playing a mid
+
+static void I_OPL_PlaySong(void *handle, bool looping)
+{
+    opl_song_t *song;
+
+    if (!music_initialized || handle == NULL)
+    {
+        return;
+    }
+
+    song = handle;
+    playing_song = song;
+
+    // Only looping songs are rendered, so every cached song loops.
+
+    if (looping && opl_rendercache && song->cache == NULL
+     && OPL_StreamRate() != 0 && !I_OPL_RenderingCache())
+    {
+        RenderSong(song);
+    }
+
+    if (looping && song->cache != NULL)
+    {
+        OPL_Lock();
+        StartStream(false);
+        OPL_Unlock();
+    }
+    else
+    {
+        StartSong(song->file, looping);
+    }
 
     // If the music was previously paused, it needs to be unpaused; playing
     // a new song implies that we turn off pause. This matches vanilla
@@ -1557,8 +1825,6 @@ static void I_OPL_ResumeSong(void)
 
 static void I_OPL_StopSong(void)
 {
-    unsigned int i;
-
     if (!music_initialized)
     {
         return;
@@ -1568,40 +1834,34 @@ static void I_OPL_StopSong(void)
 
     // Stop all playback.
 
-    OPL_ClearCallbacks();
-
-    // Free all voices.
-
-    for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
-    {
-        AllNotesOff(&channels[i], 0);
-    }
-
-    // Free all track data.
-
-    for (i = 0; i < num_tracks; ++i)
-    {
-        MIDI_FreeIterator(tracks[i].iter);
-    }
+    OPL_SetStream(NULL, NULL);
+    song_streaming = false;
+    stream_at_restart = false;
+    playing_song = NULL;
 
-    free(tracks);
-
-    tracks = NULL;
-    num_tracks = 0;
+    StopTracks();
 
     OPL_Unlock();
 }
 
 static void I_OPL_UnRegisterSong(void *handle)
 {
+    opl_song_t *song = handle;
+
     if (!music_initialized)
     {
         return;
     }
 
-    if (handle != NULL)
+    if (song != NULL)
     {
-        MIDI_FreeFile(handle);
+        if (song->cache != NULL)
+        {
+            I_OPL_CloseCache(song->cache);
+        }
+
+        MIDI_FreeFile(song->file);
+        free(song);
     }
 }
 
@@ -1612,36 +1872,62 @@ static bool IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static bool ConvertMus(byte *musdata, int len, char *filename)
+// Parse a MIDI, or a MUS converted to MIDI, without touching the
+// filesystem.
+
+static midi_file_t *LoadMidi(void *data, int len)
 {
     MEMFILE *instream;
     MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
-
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
+    midi_file_t *result = NULL;
 
-    result = mus2mid(instream, outstream);
+    instream = mem_fopen_read(data, len);
 
-    if (result == 0)
+    if (IsMid(data, len) && len < MAXMIDLENGTH)
+    {
+        result = MIDI_LoadMemory(instream);
+    }
+    else
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
+        // Assume a MUS file and try to convert
+
+        outstream = mem_fopen_write();
+
+        if (mus2mid(instream, outstream) == 0)
+        {
+            result = MIDI_LoadMemory(outstream);
+        }
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+        mem_fclose(outstream);
     }
 
     mem_fclose(instream);
-    mem_fclose(outstream);
 
     return result;
 }
 
+// Key a song by everything that decides how it sounds when rendered.
+
+static void SongCacheKey(sha1_digest_t key, void *data, int len,
+                         unsigned int rate)
+{
+    sha1_context_t context;
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, data, len);
+    SHA1_Update(&context, genmidi_digest, sizeof(sha1_digest_t));
+    SHA1_UpdateInt32(&context, opl_drv_ver);
+    SHA1_UpdateInt32(&context, opl_opl3mode);
+    SHA1_UpdateInt32(&context, opl_stereo_correct);
+    SHA1_UpdateInt32(&context, rate);
+    SHA1_Final(key, &context);
+}
+
 static void *I_OPL_RegisterSong(void *data, int len)
 {
-    midi_file_t *result;
-    char *filename;
+    midi_file_t *file;
+    opl_song_t *song;
+    unsigned int rate;
 
     if (!music_initialized)
     {
@@ -1651,32 +1937,26 @@ static void *I_OPL_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
+    file = LoadMidi(data, len);
 
-    if (IsMid(data, len) && len < MAXMIDLENGTH)
+    if (file == NULL)
     {
-        M_WriteFile(filename, data, len);
+        fprintf(stderr, "I_OPL_RegisterSong: Failed to load MID.\n");
+        return NULL;
     }
-    else
-    {
-        // Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
-    }
+    song = calloc(1, sizeof(opl_song_t));
+    song->file = file;
 
-    result = MIDI_LoadFile(filename);
+    rate = OPL_StreamRate();
 
-    if (result == NULL)
+    if (opl_rendercache && rate != 0)
     {
-        fprintf(stderr, "I_OPL_RegisterSong: Failed to load MID.\n");
+        SongCacheKey(song->key, data, len, rate);
+        song->cache = I_OPL_OpenCache(song->key, rate);
     }
 
-    // remove file now
-
-    M_remove(filename);
-    free(filename);
-
-    return result;
+    return song;
 }
 
 // Is the song playing?
@@ -1688,7 +1968,37 @@ static bool I_OPL_MusicIsPlaying(void)
         return false;
     }
 
-    return num_tracks > 0;
+    return num_tracks > 0 || song_streaming;
+}
+
+// Pick up songs that have finished rendering, and read ahead of the one
+// being streamed.
+
+static void I_OPL_Poll(void)
+{
+    sha1_digest_t key;
+
+    if (!music_initialized)
+    {
+        return;
+    }
+
+    if (I_OPL_RenderFinished(key)
+     && playing_song != NULL && playing_song->cache == NULL
+     && memcmp(playing_song->key, key, sizeof(sha1_digest_t)) == 0)
+    {
+        OPL_Lock();
+
+        playing_song->cache = I_OPL_OpenCache(key, OPL_StreamRate());
+        stream_at_restart = playing_song->cache != NULL && song_looping;
+
+        OPL_Unlock();
+    }
+
+    if (playing_song != NULL && playing_song->cache != NULL)
+    {
+        I_OPL_PrefetchCache(playing_song->cache);
+    }
 }
 
 // Shutdown music
@@ -1701,6 +2011,8 @@ static void I_OPL_ShutdownMusic(void)
 
         I_OPL_StopSong();
 
+        I_OPL_ShutdownCache();
+
         OPL_Shutdown();
 
         // Release GENMIDI lump
@@ -1791,7 +2103,7 @@ const music_module_t music_opl_module =
     I_OPL_PlaySong,
     I_OPL_StopSong,
     I_OPL_MusicIsPlaying,
-    NULL,  // Poll
+    I_OPL_Poll,
 };
 
 void I_SetOPLDriverVer(opl_driver_ver_t ver)
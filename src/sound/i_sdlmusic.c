@@ -120,6 +120,15 @@ void I_InitTimidityConfig(void)
 
 #define MAXMIDLENGTH (96 * 1024)
 
+// A registered song.  data is the MIDI that music reads from, or NULL if
+// it was loaded from a file.
+
+typedef struct
+{
+    Mix_Music *music;
+    void *data;
+} sdl_song_t;
+
 static bool music_initialized = false;
 
 // If this is true, this module initialized SDL sound and has the
@@ -274,7 +283,7 @@ static void I_SDL_PlaySong(void *handle, bool looping)
         loops = 1;
     }
 
-    Mix_PlayMusic((Mix_Music *) handle, loops);
+    Mix_PlayMusic(((sdl_song_t *) handle)->music, loops);
 }
 
 static void I_SDL_PauseSong(void)
@@ -313,16 +322,18 @@ static void I_SDL_StopSong(void)
 
 static void I_SDL_UnRegisterSong(void *handle)
 {
-    Mix_Music *music = (Mix_Music *) handle;
+    sdl_song_t *song = (sdl_song_t *) handle;
 
     if (!music_initialized)
     {
         return;
     }
 
-    if (handle != NULL)
+    if (song != NULL)
     {
-        Mix_FreeMusic(music);
+        Mix_FreeMusic(song->music);
+        free(song->data);
+        free(song);
     }
 }
 
@@ -333,36 +344,70 @@ static bool IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static bool ConvertMus(byte *musdata, int len, const char *filename)
+// Load a MIDI for SDL_mixer.  The MIDI is read through an SDL_RWops
+// over a copy of it, which SDL_mixer may keep reading from for as long
+// as the song exists.
+
+static sdl_song_t *LoadSong(void *mid, size_t mid_len)
 {
-    MEMFILE *instream;
-    MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
+    sdl_song_t *song;
+    char *filename;
 
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
+    song = malloc(sizeof(sdl_song_t));
 
-    result = mus2mid(instream, outstream);
+    if (song == NULL)
+    {
+        return NULL;
+    }
+
+    song->data = NULL;
 
-    if (result == 0)
+    if (strlen(snd_musiccmd) > 0)
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
+        // Mix_SetMusicCMD() only works with Mix_LoadMUS(), so the
+        // external program still needs a temporary file.  We can't
+        // delete the file, otherwise the program won't find it to
+        // play.  This means we leave a mess on disk :(
+
+        filename = M_TempFile("doom.mid");
+        M_WriteFile(filename, mid, mid_len);
+        song->music = Mix_LoadMUS(filename);
+        free(filename);
+    }
+    else
+    {
+        song->data = malloc(mid_len);
+
+        if (song->data == NULL)
+        {
+            free(song);
+            return NULL;
+        }
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+        memcpy(song->data, mid, mid_len);
+        song->music = Mix_LoadMUS_RW(SDL_RWFromConstMem(song->data, mid_len),
+                                     SDL_TRUE);
     }
 
-    mem_fclose(instream);
-    mem_fclose(outstream);
+    if (song->music == NULL)
+    {
+        // Failed to load
+        fprintf(stderr, "Error loading midi: %s\n", Mix_GetError());
+        free(song->data);
+        free(song);
+        return NULL;
+    }
 
-    return result;
+    return song;
 }
 
 static void *I_SDL_RegisterSong(void *data, int len)
 {
-    char *filename;
-    Mix_Music *music;
+    MEMFILE *instream;
+    MEMFILE *outstream;
+    sdl_song_t *song = NULL;
+    void *outbuf;
+    size_t outbuf_len;
 
     if (!music_initialized)
     {
@@ -372,43 +417,30 @@ static void *I_SDL_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     if (IsMid(data, len) && len < MAXMIDLENGTH)
     {
-        M_WriteFile(filename, data, len);
+        return LoadSong(data, len);
     }
-    else
-    {
-	// Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
-    }
+    // Assume a MUS file and try to convert
 
-    // Load the MIDI. In an ideal world we'd be using Mix_LoadMUS_RW()
-    // by now, but Mix_SetMusicCMD() only works with Mix_LoadMUS(), so
-    // we have to generate a temporary file.
+    instream = mem_fopen_read(data, len);
+    outstream = mem_fopen_write();
 
-    music = Mix_LoadMUS(filename);
-    if (music == NULL)
+    if (mus2mid(instream, outstream) == 0)
     {
-        // Failed to load
-        fprintf(stderr, "Error loading midi: %s\n", Mix_GetError());
+        mem_get_buf(outstream, &outbuf, &outbuf_len);
+        song = LoadSong(outbuf, outbuf_len);
     }
-
-    // Remove the temporary MIDI file; however, when using an external
-    // MIDI program we can't delete the file. Otherwise, the program
-    // won't find the file to play. This means we leave a mess on
-    // disk :(
-
-    if (strlen(snd_musiccmd) == 0)
+    else
     {
-        M_remove(filename);
+        fprintf(stderr, "Error loading midi: failed to convert MUS\n");
     }
 
-    free(filename);
+    mem_fclose(instream);
+    mem_fclose(outstream);
 
-    return music;
+    return song;
 }
 
 // Is the song playing?
@@ -16,12 +16,21 @@
 // DESCRIPTION:
 //	System interface for sound.
 //
+//	Sound effects are mixed by our own mixer, which runs as an
+//	SDL_mixer postmix effect.  It plays the 8-bit samples straight
+//	from the sound lumps, resampling and pitch-shifting them as it
+//	goes.  The game thread never touches the mixer state: it sends
+//	start, stop and volume/separation changes through a lock-free
+//	single producer, single consumer command ring, and the audio
+//	callback reports back when a sound has finished.
+//
 
 #include "config.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include "SDL.h"
 #include "SDL_mixer.h"
@@ -31,11 +40,16 @@
 #endif
 
 #include "deh_str.h"
+#include "dsp.h"
+#include "i_parallel.h"
 #include "i_sound.h"
 #include "i_system.h"
 #include "i_swap.h"
 #include "m_argv.h"
+#include "m_config.h"
 #include "m_misc.h"
+#include "s_sound.h"
+#include "sha1.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -52,319 +66,122 @@ int use_libsamplerate = 0;
 
 float libsamplerate_scale = 0.65f;
 
+// If non-zero, convert every sound effect with libsamplerate at startup
+// and keep the results in the resample cache file.
 
-#ifndef DISABLE_SDL2MIXER
-
-
-#define LOW_PASS_FILTER
-//#define DEBUG_DUMP_WAVS
-#define NUM_CHANNELS 16
-
-typedef struct allocated_sound_s allocated_sound_t;
-
-struct allocated_sound_s
-{
-    sfxinfo_t *sfxinfo;
-    Mix_Chunk chunk;
-    int use_count;
-    int pitch;
-    allocated_sound_t *prev, *next;
-};
-
-static bool sound_initialized = false;
-
-static allocated_sound_t *channels_playing[NUM_CHANNELS];
-
-static int mixer_freq;
-static Uint16 mixer_format;
-static int mixer_channels;
-static bool use_sfx_prefix;
-static bool (*ExpandSoundData)(sfxinfo_t *sfxinfo,
-                                  byte *data,
-                                  int samplerate,
-                                  int length) = NULL;
-
-// Doubly-linked list of allocated sounds.
-// When a sound is played, it is moved to the head, so that the oldest
-// sounds not used recently are at the tail.
-
-static allocated_sound_t *allocated_sounds_head = NULL;
-static allocated_sound_t *allocated_sounds_tail = NULL;
-static int allocated_sounds_size = 0;
-
-
-// Hook a sound into the linked list at the head.
-
-static void AllocatedSoundLink(allocated_sound_t *snd)
-{
-    snd->prev = NULL;
-
-    snd->next = allocated_sounds_head;
-    allocated_sounds_head = snd;
-
-    if (allocated_sounds_tail == NULL)
-    {
-        allocated_sounds_tail = snd;
-    }
-    else
-    {
-        snd->next->prev = snd;
-    }
-}
-
-// Unlink a sound from the linked list.
-
-static void AllocatedSoundUnlink(allocated_sound_t *snd)
-{
-    if (snd->prev == NULL)
-    {
-        allocated_sounds_head = snd->next;
-    }
-    else
-    {
-        snd->prev->next = snd->next;
-    }
-
-    if (snd->next == NULL)
-    {
-        allocated_sounds_tail = snd->prev;
-    }
-    else
-    {
-        snd->next->prev = snd->prev;
-    }
-}
-
-static void FreeAllocatedSound(allocated_sound_t *snd)
-{
-    // Unlink from linked list.
-
-    AllocatedSoundUnlink(snd);
-
-    // Keep track of the amount of allocated sound data:
-
-    allocated_sounds_size -= snd->chunk.alen;
+int snd_resamplecache = 0;
 
-    free(snd);
-}
 
-// Search from the tail backwards along the allocated sounds list, find
-// and free a sound that is not in use, to free up memory.  Return true
-// for success.
+#ifndef DISABLE_SDL2MIXER
 
-static bool FindAndFreeSound(void)
-{
-    allocated_sound_t *snd;
 
-    snd = allocated_sounds_tail;
+#define LOW_PASS_FILTER
 
-    while (snd != NULL)
-    {
-        if (snd->use_count == 0)
-        {
-            FreeAllocatedSound(snd);
-            return true;
-        }
+// Number of frames mixed at a time by the audio callback.
 
-        snd = snd->prev;
-    }
+#define MIX_BLOCK_FRAMES 512
 
-    // No available sounds to free...
+// Sample frames of a voice converted to 16-bit at a time, enough for a
+// whole block unless the sound is pitched well above the mixer rate.
 
-    return false;
-}
+#define VOICE_SAMPLES (MIX_BLOCK_FRAMES * 2 + 2)
 
-// Enforce SFX cache size limit.  We are just about to allocate "len"
-// bytes on the heap for a new sound effect, so free up some space
-// so that we keep allocated_sounds_size < snd_cachesize
+// A sound effect ready to be mixed.  Either data8 points at the unsigned
+// 8-bit samples in the sound lump, or in copy, or data16 holds signed
+// 16-bit samples already converted to the mixer rate by libsamplerate.
 
-static void ReserveCacheSpace(size_t len)
+typedef struct
 {
-    if (snd_cachesize <= 0)
-    {
-        return;
-    }
-
-    // Keep freeing sound effects that aren't currently being played,
-    // until there is enough space for the new sound.
-
-    while (allocated_sounds_size + len > snd_cachesize)
-    {
-        // Free a sound.  If there is nothing more to free, stop.
-
-        if (!FindAndFreeSound())
-        {
-            break;
-        }
-    }
-}
-
-// Allocate a block for a new sound effect.
+    const byte *data8;
+    byte *copy;
+    int16_t *data16;
+    uint32_t length;
+    int samplerate;
+} sfxsample_t;
 
-static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, size_t len)
+typedef enum
 {
-    allocated_sound_t *snd;
-
-    // Keep allocated sounds within the cache size.
-
-    ReserveCacheSpace(len);
-
-    // Allocate the sound structure and data.  The data will immediately
-    // follow the structure, which acts as a header.
-
-    do
-    {
-        snd = malloc(sizeof(allocated_sound_t) + len);
-
-        // Out of memory?  Try to free an old sound, then loop round
-        // and try again.
+    MIXCMD_START,
+    MIXCMD_STOP,
+    MIXCMD_PARAMS,
+} mixcmdtype_t;
 
-        if (snd == NULL && !FindAndFreeSound())
-        {
-            return NULL;
-        }
-
-    } while (snd == NULL);
-
-    // Skip past the chunk structure for the audio buffer
-
-    snd->chunk.abuf = (byte *) (snd + 1);
-    snd->chunk.alen = len;
-    snd->chunk.allocated = 1;
-    snd->chunk.volume = MIX_MAX_VOLUME;
-    snd->pitch = NORM_PITCH;
-
-    snd->sfxinfo = sfxinfo;
-    snd->use_count = 0;
-
-    // Keep track of how much memory all these cached sounds are using...
+// A command from the game thread to the audio callback.
 
-    allocated_sounds_size += len;
-
-    AllocatedSoundLink(snd);
-
-    return snd;
-}
-
-// Lock a sound, to indicate that it may not be freed.
-
-static void LockAllocatedSound(allocated_sound_t *snd)
+typedef struct
 {
-    // Increase use count, to stop the sound being freed.
-
-    ++snd->use_count;
-
-    //printf("++ %s: Use count=%i\n", snd->sfxinfo->name, snd->use_count);
-
-    // When we use a sound, re-link it into the list at the head, so
-    // that the oldest sounds fall to the end of the list for freeing.
-
-    AllocatedSoundUnlink(snd);
-    AllocatedSoundLink(snd);
-}
+    mixcmdtype_t type;
+    int channel;
+    int seq;
+    const sfxsample_t *sample;
+    uint32_t step;
+    int alpha;
+    int left, right;
+} mixcmd_t;
 
-// Unlock a sound to indicate that it may now be freed.
+// Channel state owned by the audio callback.
 
-static void UnlockAllocatedSound(allocated_sound_t *snd)
+typedef struct
 {
-    if (snd->use_count <= 0)
-    {
-        I_Error("Sound effect released more times than it was locked...");
-    }
-
-    --snd->use_count;
-
-    //printf("-- %s: Use count=%i\n", snd->sfxinfo->name, snd->use_count);
-}
+    const sfxsample_t *sample;
 
-// Search through the list of allocated sounds and return the one that matches
-// the supplied sfxinfo entry and pitch level.
+    // Position in the sample as 48.16 fixed point, and the number of
+    // sample frames to advance per output frame as 16.16 fixed point.
+    uint64_t pos;
+    uint32_t step;
 
-static allocated_sound_t * GetAllocatedSoundBySfxInfoAndPitch(sfxinfo_t *sfxinfo, int pitch)
-{
-    allocated_sound_t * p = allocated_sounds_head;
+    // Volume of each side, 0-255.
+    int left, right;
 
-    while (p != NULL)
-    {
-        if (p->sfxinfo == sfxinfo && p->pitch == pitch)
-        {
-            return p;
-        }
-        p = p->next;
-    }
+    // Low pass filter coefficient (1.15 fixed point) and output.
+    int alpha;
+    int filtered;
 
-    return NULL;
-}
+    int seq;
+} mixvoice_t;
 
-// Allocate a new sound chunk and pitch-shift an existing sound up-or-down
-// into it.
+// Channel state seen by the game thread.  Every sound started gets a
+// new sequence number; the audio callback stores the number of each
+// sound it finishes in done.
 
-static allocated_sound_t * PitchShift(allocated_sound_t *insnd, int pitch)
+typedef struct
 {
-    allocated_sound_t * outsnd;
-    Sint16 *inp, *outp;
-    Sint16 *srcbuf, *dstbuf;
-    Uint32 srclen, dstlen;
-
-    srcbuf = (Sint16 *)insnd->chunk.abuf;
-    srclen = insnd->chunk.alen;
+    int seq;
+    bool active;
+    SDL_atomic_t done;
+} mixchannel_t;
 
-    // determine ratio pitch:NORM_PITCH and apply to srclen, then invert.
-    // This is an approximation of vanilla behaviour based on measurements
-    dstlen = (int)((1 + (1 - (float)pitch / NORM_PITCH)) * srclen);
-
-    // ensure that the new buffer is an even length
-    if ((dstlen % 2) == 0)
-    {
-        dstlen++;
-    }
-
-    outsnd = AllocateSound(insnd->sfxinfo, dstlen);
-
-    if (!outsnd)
-    {
-        return NULL;
-    }
-
-    outsnd->pitch = pitch;
-    dstbuf = (Sint16 *)outsnd->chunk.abuf;
+static bool sound_initialized = false;
 
-    // loop over output buffer. find corresponding input cell, copy over
-    for (outp = dstbuf; outp < dstbuf + dstlen/2; ++outp)
-    {
-        inp = srcbuf + (int)((float)(outp - dstbuf) / dstlen * srclen);
-        *outp = *inp;
-    }
+static int num_channels;
+static mixchannel_t *channels;
+static mixvoice_t *voices;
 
-    return outsnd;
-}
+// Command ring.  Only the game thread writes command_head and only the
+// audio callback writes command_tail.
 
-// When a sound stops, check if it is still playing.  If it is not,
-// we can mark the sound data as CACHE to be freed back for other
-// means.
+static mixcmd_t *commands;
+static unsigned int command_mask;
+static SDL_atomic_t command_head;
+static SDL_atomic_t command_tail;
 
-static void ReleaseSoundOnChannel(int channel)
-{
-    allocated_sound_t *snd = channels_playing[channel];
+static int32_t mix_buffer[MIX_BLOCK_FRAMES * 2];
 
-    Mix_HaltChannel(channel);
+// A voice resampled to the mixer rate, and the signed 16-bit sample frames
+// it is resampled from.
 
-    if (snd == NULL)
-    {
-        return;
-    }
+static int16_t voice_block[MIX_BLOCK_FRAMES];
+static int16_t voice_samples[VOICE_SAMPLES];
 
-    channels_playing[channel] = NULL;
+static int mixer_freq;
+static Uint16 mixer_format;
+static int mixer_channels;
+static bool use_sfx_prefix;
 
-    UnlockAllocatedSound(snd);
+// Bytes of sound data converted by libsamplerate, kept below
+// snd_cachesize.
 
-    // if the sound is a pitch-shift and it's not in use, immediately
-    // free it
-    if (snd->pitch != NORM_PITCH && snd->use_count <= 0)
-    {
-        FreeAllocatedSound(snd);
-    }
-}
+static int converted_sounds_size = 0;
 
 #ifdef HAVE_LIBSAMPLERATE
 
@@ -397,44 +214,42 @@ static int SRC_ConversionMode(void)
 
 // libsamplerate-based generic sound expansion function for any sample rate
 //   unsigned 8 bits --> signed 16 bits
-//   mono --> stereo
 //   samplerate --> mixer_freq
-// Returns number of clipped samples.
+// Only uses malloc, so it can run on worker threads.  Returns NULL if
+// memory runs out.
 // DWF 2008-02-10 with cleanups by Simon Howard.
 
-static bool ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
-                                   byte *data,
-                                   int samplerate,
-                                   int length)
+static int16_t *ConvertSound_SRC(const sfxsample_t *sample,
+                                 uint32_t *length, uint32_t *clipped)
 {
     SRC_DATA src_data;
     float *data_in;
-    uint32_t i, abuf_index=0, clipped=0;
-//    uint32_t alen;
+    uint32_t i;
     int retn;
     int16_t *expanded;
-    allocated_sound_t *snd;
-    Mix_Chunk *chunk;
 
-    src_data.input_frames = length;
-    data_in = malloc(length * sizeof(float));
+    *clipped = 0;
+
+    src_data.input_frames = sample->length;
+    data_in = malloc(sample->length * sizeof(float));
     src_data.data_in = data_in;
-    src_data.src_ratio = (double)mixer_freq / samplerate;
+    src_data.src_ratio = (double)mixer_freq / sample->samplerate;
 
     // We include some extra space here in case of rounding-up.
-    src_data.output_frames = src_data.src_ratio * length + (mixer_freq / 4);
+    src_data.output_frames = src_data.src_ratio * sample->length
+                           + (mixer_freq / 4);
     src_data.data_out = malloc(src_data.output_frames * sizeof(float));
 
     assert(src_data.data_in != NULL && src_data.data_out != NULL);
 
     // Convert input data to floats
 
-    for (i=0; i<length; ++i)
+    for (i=0; i<sample->length; ++i)
     {
         // Unclear whether 128 should be interpreted as "zero" or whether a
         // symmetrical range should be assumed.  The following assumes a
         // symmetrical range.
-        data_in[i] = data[i] / 127.5 - 1;
+        data_in[i] = sample->data8[i] / 127.5 - 1;
     }
 
     // Do the sound conversion
@@ -442,20 +257,15 @@ static bool ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
     retn = src_simple(&src_data, SRC_ConversionMode(), 1);
     assert(retn == 0);
 
-    // Allocate the new chunk.
-
-//    alen = src_data.output_frames_gen * 4;
+    expanded = malloc(src_data.output_frames_gen * sizeof(int16_t));
 
-    snd = AllocateSound(sfxinfo, src_data.output_frames_gen * 4);
-
-    if (snd == NULL)
+    if (expanded == NULL)
     {
-        return false;
+        free(data_in);
+        free(src_data.data_out);
+        return NULL;
     }
 
-    chunk = &snd->chunk;
-    expanded = (int16_t *) chunk->abuf;
-
     // Convert the result back into 16-bit integers.
 
     for (i=0; i<src_data.output_frames_gen; ++i)
@@ -489,236 +299,94 @@ static bool ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
         if (cvtval_i < -INT16_MAX)
         {
             cvtval_i = -INT16_MAX;
-            ++clipped;
+            ++*clipped;
         }
         else if (cvtval_i > INT16_MAX)
         {
             cvtval_i = INT16_MAX;
-            ++clipped;
+            ++*clipped;
         }
 
-        // Left and right channels
-
-        expanded[abuf_index++] = cvtval_i;
-        expanded[abuf_index++] = cvtval_i;
+        expanded[i] = cvtval_i;
     }
 
     free(data_in);
     free(src_data.data_out);
 
-    if (clipped > 0)
-    {
-        fprintf(stderr, "Sound '%s': clipped %u samples (%0.2f %%)\n", 
-                        sfxinfo->name, clipped,
-                        400.0 * clipped / chunk->alen);
-    }
+    *length = src_data.output_frames_gen;
 
-    return true;
+    return expanded;
 }
 
-#endif
+// Make a sample play the converted data, if it fits in snd_cachesize.
+// Returns false if it does not, in which case the sound is played from
+// the lump and resampled by the mixer.
 
-static bool ConvertibleRatio(int freq1, int freq2)
+static bool UseConvertedSound(sfxinfo_t *sfxinfo, sfxsample_t *sample,
+                              int16_t *data, uint32_t length)
 {
-    int ratio;
+    size_t expanded_size = length * sizeof(int16_t);
 
-    if (freq1 > freq2)
+    if (snd_cachesize > 0
+     && converted_sounds_size + expanded_size > snd_cachesize)
     {
-        return ConvertibleRatio(freq2, freq1);
-    }
-    else if ((freq2 % freq1) != 0)
-    {
-        // Not in a direct ratio
-
         return false;
     }
-    else
-    {
-        // Check the ratio is a power of 2
-
-        ratio = freq2 / freq1;
 
-        while ((ratio & 1) == 0)
-        {
-            ratio = ratio >> 1;
-        }
+    sample->data16 = data;
+    sample->data8 = NULL;
+    free(sample->copy);
+    sample->copy = NULL;
+    sample->length = length;
+    sample->samplerate = mixer_freq;
 
-        return ratio == 1;
-    }
-}
+    converted_sounds_size += expanded_size;
 
-#ifdef DEBUG_DUMP_WAVS
+    // don't need the original lump any more
 
-// Debug code to dump resampled sound effects to WAV files for analysis.
+    W_ReleaseLumpNum(sfxinfo->lumpnum);
 
-static void WriteWAV(char *filename, byte *data,
-                     uint32_t length, int samplerate)
-{
-    FILE *wav;
-    unsigned int i;
-    unsigned short s;
-
-    wav = M_fopen(filename, "wb");
-
-    // Header
-
-    fwrite("RIFF", 1, 4, wav);
-    i = LONG(36 + samplerate);
-    fwrite(&i, 4, 1, wav);
-    fwrite("WAVE", 1, 4, wav);
-
-    // Subchunk 1
-
-    fwrite("fmt ", 1, 4, wav);
-    i = LONG(16);
-    fwrite(&i, 4, 1, wav);           // Length
-    s = SHORT(1);
-    fwrite(&s, 2, 1, wav);           // Format (PCM)
-    s = SHORT(2);
-    fwrite(&s, 2, 1, wav);           // Channels (2=stereo)
-    i = LONG(samplerate);
-    fwrite(&i, 4, 1, wav);           // Sample rate
-    i = LONG(samplerate * 2 * 2);
-    fwrite(&i, 4, 1, wav);           // Byte rate (samplerate * stereo * 16 bit)
-    s = SHORT(2 * 2);
-    fwrite(&s, 2, 1, wav);           // Block align (stereo * 16 bit)
-    s = SHORT(16);
-    fwrite(&s, 2, 1, wav);           // Bits per sample (16 bit)
-
-    // Data subchunk
-
-    fwrite("data", 1, 4, wav);
-    i = LONG(length);
-    fwrite(&i, 4, 1, wav);           // Data length
-    fwrite(data, 1, length, wav);    // Data
-
-    fclose(wav);
+    return true;
 }
 
-#endif
-
-// Generic sound expansion function for any sample rate.
-// Returns number of clipped samples (always 0).
-
-static bool ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
-                                   byte *data,
-                                   int samplerate,
-                                   int length)
+static void ReportClipped(sfxinfo_t *sfxinfo, uint32_t clipped,
+                          uint32_t length)
 {
-    SDL_AudioCVT convertor;
-    allocated_sound_t *snd;
-    Mix_Chunk *chunk;
-    uint32_t expanded_length;
-
-    // Calculate the length of the expanded version of the sample.
-
-    expanded_length = (uint32_t) ((((uint64_t) length) * mixer_freq) / samplerate);
-
-    // Double up twice: 8 -> 16 bit and mono -> stereo
-
-    expanded_length *= 4;
-
-    // Allocate a chunk in which to expand the sound
-
-    snd = AllocateSound(sfxinfo, expanded_length);
-
-    if (snd == NULL)
+    if (clipped > 0)
     {
-        return false;
+        fprintf(stderr, "Sound '%s': clipped %u samples (%0.2f %%)\n",
+                        sfxinfo->name, clipped, 100.0 * clipped / length);
     }
+}
 
-    chunk = &snd->chunk;
+static void ExpandSoundData_SRC(sfxinfo_t *sfxinfo, sfxsample_t *sample)
+{
+    int16_t *expanded;
+    uint32_t length, clipped;
 
-    // If we can, use the standard / optimized SDL conversion routines.
+    expanded = ConvertSound_SRC(sample, &length, &clipped);
 
-    if (samplerate <= mixer_freq
-     && ConvertibleRatio(samplerate, mixer_freq)
-     && SDL_BuildAudioCVT(&convertor,
-                          AUDIO_U8, 1, samplerate,
-                          mixer_format, mixer_channels, mixer_freq))
+    if (expanded == NULL)
     {
-        convertor.len = length;
-        convertor.buf = malloc(convertor.len * convertor.len_mult);
-        assert(convertor.buf != NULL);
-        memcpy(convertor.buf, data, length);
-
-        SDL_ConvertAudio(&convertor);
-
-        memcpy(chunk->abuf, convertor.buf, chunk->alen);
-        free(convertor.buf);
+        return;
     }
-    else
-    {
-        Sint16 *expanded = (Sint16 *) chunk->abuf;
-        int expanded_length;
-        int expand_ratio;
-        int i;
-
-        // Generic expansion if conversion does not work:
-        //
-        // SDL's audio conversion only works for rate conversions that are
-        // powers of 2; if the two formats are not in a direct power of 2
-        // ratio, do this naive conversion instead.
-
-        // number of samples in the converted sound
-
-        expanded_length = ((uint64_t) length * mixer_freq) / samplerate;
-        expand_ratio = (length << 8) / expanded_length;
-
-        for (i=0; i<expanded_length; ++i)
-        {
-            Sint16 sample;
-            int src;
-
-            src = (i * expand_ratio) >> 8;
-
-            sample = data[src] | (data[src] << 8);
-            sample -= 32768;
-
-            // expand 8->16 bits, mono->stereo
-
-            expanded[i * 2] = expanded[i * 2 + 1] = sample;
-        }
 
-#ifdef LOW_PASS_FILTER
-        // Perform a low-pass filter on the upscaled sound to filter
-        // out high-frequency noise from the conversion process.
-
-        {
-            float rc, dt, alpha;
-
-            // Low-pass filter for cutoff frequency f:
-            //
-            // For sampling rate r, dt = 1 / r
-            // rc = 1 / 2*pi*f
-            // alpha = dt / (rc + dt)
+    ReportClipped(sfxinfo, clipped, length);
 
-            // Filter to the half sample rate of the original sound effect
-            // (maximum frequency, by nyquist)
-
-            dt = 1.0f / mixer_freq;
-            rc = 1.0f / (3.14f * samplerate);
-            alpha = dt / (rc + dt);
-
-            // Both channels are processed in parallel, hence [i-2]:
-
-            for (i=2; i<expanded_length * 2; ++i)
-            {
-                expanded[i] = (Sint16) (alpha * expanded[i]
-                                      + (1 - alpha) * expanded[i-2]);
-            }
-        }
-#endif /* #ifdef LOW_PASS_FILTER */
+    if (!UseConvertedSound(sfxinfo, sample, expanded, length))
+    {
+        free(expanded);
     }
-
-    return true;
 }
 
-// Load and convert a sound effect
-// Returns true if successful
+#endif
+
+// Load a sound effect and point a sample at the data in its lump.
+// Returns NULL if the lump is not a valid sound.
 
-static bool CacheSFX(sfxinfo_t *sfxinfo)
+static sfxsample_t *LoadSFX(sfxinfo_t *sfxinfo)
 {
+    sfxsample_t *sample;
     int lumpnum;
     unsigned int lumplen;
     int samplerate;
@@ -738,7 +406,8 @@ static bool CacheSFX(sfxinfo_t *sfxinfo)
     {
         // Invalid sound
 
-        return false;
+        W_ReleaseLumpNum(lumpnum);
+        return NULL;
     }
 
     // 16 bit sample rate field, 32 bit length field
@@ -755,41 +424,86 @@ static bool CacheSFX(sfxinfo_t *sfxinfo)
     // further investigation to better understand the correct
     // behavior.
 
-    if (length > lumplen - 8 || length <= 48)
+    if (length > lumplen - 8 || length <= 48 || samplerate == 0)
     {
-        return false;
+        W_ReleaseLumpNum(lumpnum);
+        return NULL;
+    }
+
+    sample = malloc(sizeof(sfxsample_t));
+
+    if (sample == NULL)
+    {
+        W_ReleaseLumpNum(lumpnum);
+        return NULL;
     }
 
     // The DMX sound library seems to skip the first 16 and last 16
     // bytes of the lump - reason unknown.
 
-    data += 16;
-    length -= 32;
+    sample->data8 = data + 8 + 16;
+    sample->copy = NULL;
+    sample->data16 = NULL;
+    sample->length = length - 32;
+    sample->samplerate = samplerate;
 
-    // Sample rate conversion
+    // The samples stay in the lump, which stays locked for as long as
+    // the mixer might be playing it: that is, until we exit.  W_Reload
+    // frees the lumps of a '~' WAD regardless, so play a copy of those.
 
-    if (!ExpandSoundData(sfxinfo, data + 8, samplerate, length))
+    if (W_IsReloadLump(lumpnum))
     {
-        return false;
+        sample->copy = malloc(sample->length);
+
+        if (sample->copy == NULL)
+        {
+            W_ReleaseLumpNum(lumpnum);
+            free(sample);
+            return NULL;
+        }
+
+        memcpy(sample->copy, sample->data8, sample->length);
+        sample->data8 = sample->copy;
     }
 
-#ifdef DEBUG_DUMP_WAVS
-    {
-        char filename[16];
-        allocated_sound_t * snd;
+    return sample;
+}
 
-        M_snprintf(filename, sizeof(filename), "%s.wav",
-                   DEH_String(sfxinfo->name));
-        snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
-        WriteWAV(filename, snd->chunk.abuf, snd->chunk.alen,mixer_freq);
+// Load a sound effect and get it ready for the mixer.
+
+static sfxsample_t *CacheSFX(sfxinfo_t *sfxinfo)
+{
+    sfxsample_t *sample = LoadSFX(sfxinfo);
+
+#ifdef HAVE_LIBSAMPLERATE
+    if (sample != NULL && use_libsamplerate != 0)
+    {
+        ExpandSoundData_SRC(sfxinfo, sample);
     }
 #endif
 
-    // don't need the original lump any more
-  
-    W_ReleaseLumpNum(lumpnum);
+    return sample;
+}
 
-    return true;
+// Linked sound effects share the lump, and the sample, of the sound they
+// link to.
+
+static sfxinfo_t *SampleOwner(sfxinfo_t *sfxinfo)
+{
+    return sfxinfo->link != NULL ? sfxinfo->link : sfxinfo;
+}
+
+static sfxsample_t *GetSample(sfxinfo_t *sfxinfo)
+{
+    sfxinfo_t *owner = SampleOwner(sfxinfo);
+
+    if (owner->driver_data == NULL)
+    {
+        owner->lumpnum = sfxinfo->lumpnum;
+        owner->driver_data = CacheSFX(owner);
+    }
+
+    return owner->driver_data;
 }
 
 static void GetSfxLumpName(sfxinfo_t *sfx, char *buf, size_t buf_len)
@@ -814,52 +528,402 @@ static void GetSfxLumpName(sfxinfo_t *sfx, char *buf, size_t buf_len)
     }
 }
 
-// Preload all the sound effects - stops nasty ingame freezes
+#ifdef HAVE_LIBSAMPLERATE
 
-static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
+//
+// Resample cache.  With snd_resamplecache, every sound effect is
+// converted at startup on all CPUs, and the results are saved to a file
+// for the next start.  Sounds are keyed by a SHA-1 of their lump; the
+// file as a whole is only valid for the mixer rate, conversion mode and
+// scale it was written with.  It is only ever used by the machine that
+// wrote it, so it is in native byte order.
+//
+
+#define SFXCACHE_MAGIC "BRMSFXC"
+#define SFXCACHE_VERSION 1
+#define SFXCACHE_BYTEORDER 0x01020304
+
+typedef struct
 {
-    char namebuf[9];
-    int i;
+    char magic[8];
+    uint32_t version;
+    uint32_t byteorder;
+    int32_t samplerate;
+    int32_t mode;
+    float scale;
+    int32_t numsounds;
+    uint32_t length;
+} sfxcacheheader_t;
+
+// The samples are at offset, from the start of the file.
+
+typedef struct
+{
+    sha1_digest_t key;
+    uint32_t offset;
+    uint32_t length;
+} sfxcacheentry_t;
 
-    printf("I_SDL_PrecacheSounds: Precaching all sound effects..");
+// A sound to precache.  data is either converted by a worker, or points
+// into the cache file.
 
-    for (i=0; i<num_sounds; ++i)
-    {
-        if ((i % 6) == 0)
-        {
-            printf(".");
-            fflush(stdout);
+typedef struct
+{
+    sfxinfo_t *sfxinfo;
+    sfxsample_t *sample;
+    sha1_digest_t key;
+    int16_t *data;
+    uint32_t length;
+    uint32_t clipped;
+    bool cached;
+} sfxprecache_t;
+
+static char *SFXCachePath(void)
+{
+    //!
+    // @category sound
+    // @arg <file>
+    //
+    // Keep the resample cache (see snd_resamplecache) in the given file.
+    // The default is sfx.cache in the configuration directory.
+    //
+
+    int p = M_CheckParmWithArgs("-sfxcache", 1);
+
+    if (p > 0)
+    {
+        return M_StringDuplicate(myargv[p + 1]);
+    }
+
+    return M_StringJoin(configdir, "sfx.cache", NULL);
+}
+
+static bool SFXCacheHeaderValid(const sfxcacheheader_t *header,
+                                uint32_t length)
+{
+    return length >= sizeof(*header)
+        && memcmp(header->magic, SFXCACHE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SFXCACHE_VERSION
+        && header->byteorder == SFXCACHE_BYTEORDER
+        && header->samplerate == mixer_freq
+        && header->mode == SRC_ConversionMode()
+        && header->scale == libsamplerate_scale
+        && header->numsounds >= 0
+        && header->length == length
+        && (length - sizeof(*header)) / sizeof(sfxcacheentry_t)
+               >= (uint32_t) header->numsounds;
+}
+
+// Point every sound found in the cache file at its samples.  The file
+// stays open, or in the zone, for as long as any sound uses it.
+
+static void LoadSFXCache(const char *path, sfxprecache_t *sounds,
+                         int num_sounds)
+{
+    const sfxcacheheader_t *header;
+    const sfxcacheentry_t *entries;
+    wad_file_t *file;
+    byte *data;
+    bool used = false;
+    int num_entries;
+    int i, j;
+
+    if (!M_FileExists(path) || (file = W_OpenFile(path)) == NULL)
+    {
+        return;
+    }
+
+    // Without a mapping, read the whole file into the zone.
+
+    data = file->mapped;
+
+    if (data == NULL)
+    {
+        data = Z_Malloc(file->length, PU_STATIC, NULL);
+
+        if (W_Read(file, 0, data, file->length) < file->length)
+        {
+            Z_Free(data);
+            W_CloseFile(file);
+            return;
         }
+    }
 
-        GetSfxLumpName(&sounds[i], namebuf, sizeof(namebuf));
+    header = (const sfxcacheheader_t *) data;
+    entries = (const sfxcacheentry_t *) (header + 1);
+    num_entries = 0;
 
-        sounds[i].lumpnum = W_CheckNumForName(namebuf);
+    if (SFXCacheHeaderValid(header, file->length))
+    {
+        num_entries = header->numsounds;
+    }
 
-        if (sounds[i].lumpnum != -1)
+    for (i=0; i<num_entries; ++i)
+    {
+        const sfxcacheentry_t *entry = &entries[i];
+
+        if (entry->offset % sizeof(int16_t) != 0
+         || entry->offset > file->length
+         || entry->length > (file->length - entry->offset) / sizeof(int16_t))
+        {
+            continue;
+        }
+
+        for (j=0; j<num_sounds; ++j)
         {
-            CacheSFX(&sounds[i]);
+            if (memcmp(sounds[j].key, entry->key, sizeof(sha1_digest_t)) == 0)
+            {
+                sounds[j].data = (int16_t *) (data + entry->offset);
+                sounds[j].length = entry->length;
+                sounds[j].cached = true;
+                used = true;
+            }
         }
     }
 
-    printf("\n");
+    if (used)
+    {
+        return;
+    }
+
+    if (file->mapped == NULL)
+    {
+        Z_Free(data);
+    }
+
+    W_CloseFile(file);
 }
 
-// Load a SFX chunk into memory and ensure that it is locked.
+// Write all the converted sounds to the cache file.  Written to a
+// temporary file and renamed, so other instances starting at the same
+// time never see a partial file.
 
-static bool LockSound(sfxinfo_t *sfxinfo)
+static void SaveSFXCache(const char *path, const sfxprecache_t *sounds,
+                         int num_sounds)
 {
-    // If the sound isn't loaded, load it now
-    if (GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH) == NULL)
+    sfxcacheheader_t *header;
+    sfxcacheentry_t *entries;
+    uint32_t length;
+    byte *data;
+    char suffix[32];
+    char *temp;
+    int count = 0;
+    int i;
+
+    length = sizeof(*header);
+
+    for (i=0; i<num_sounds; ++i)
     {
-        if (!CacheSFX(sfxinfo))
+        if (sounds[i].data != NULL)
         {
-            return false;
+            length += sizeof(*entries) + sounds[i].length * sizeof(int16_t);
+            ++count;
         }
     }
 
-    LockAllocatedSound(GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH));
+    data = calloc(1, length);
 
-    return true;
+    if (data == NULL)
+    {
+        return;
+    }
+
+    header = (sfxcacheheader_t *) data;
+    memcpy(header->magic, SFXCACHE_MAGIC, sizeof(header->magic));
+    header->version = SFXCACHE_VERSION;
+    header->byteorder = SFXCACHE_BYTEORDER;
+    header->samplerate = mixer_freq;
+    header->mode = SRC_ConversionMode();
+    header->scale = libsamplerate_scale;
+    header->numsounds = count;
+    header->length = length;
+
+    entries = (sfxcacheentry_t *) (header + 1);
+    length = sizeof(*header) + count * sizeof(*entries);
+
+    for (i=0; i<num_sounds; ++i)
+    {
+        if (sounds[i].data != NULL)
+        {
+            memcpy(entries->key, sounds[i].key, sizeof(sha1_digest_t));
+            entries->offset = length;
+            entries->length = sounds[i].length;
+            memcpy(data + length, sounds[i].data,
+                   sounds[i].length * sizeof(int16_t));
+            length += sounds[i].length * sizeof(int16_t);
+            ++entries;
+        }
+    }
+
+    M_snprintf(suffix, sizeof(suffix), ".%lx.tmp",
+               (unsigned long) ((uintptr_t) data ^ (uintptr_t) time(NULL)));
+    temp = M_StringJoin(path, suffix, NULL);
+
+    if (M_WriteFile(temp, data, length))
+    {
+#ifdef _WIN32
+        M_remove(path);
+#endif
+        if (M_rename(temp, path) != 0)
+        {
+            M_remove(temp);
+        }
+    }
+
+    free(temp);
+    free(data);
+}
+
+static void ConvertSoundJob(void *data, int index)
+{
+    sfxprecache_t **sounds = data;
+    sfxprecache_t *sound = sounds[index];
+
+    sound->data = ConvertSound_SRC(sound->sample, &sound->length,
+                                   &sound->clipped);
+}
+
+// Convert every loaded sound, from the cache file where possible and on
+// all CPUs otherwise.
+
+static void PrecacheConvertedSounds(sfxinfo_t *sounds, int num_sounds)
+{
+    sfxprecache_t *precache;
+    sfxprecache_t **convert;
+    int num_precache = 0;
+    int num_convert = 0;
+    char *path;
+    int i;
+
+    precache = calloc(num_sounds, sizeof(*precache));
+    convert = calloc(num_sounds, sizeof(*convert));
+
+    if (precache == NULL || convert == NULL)
+    {
+        free(precache);
+        free(convert);
+        return;
+    }
+
+    // The lumps are read on this thread, since the zone is not thread
+    // safe.
+
+    for (i=0; i<num_sounds; ++i)
+    {
+        sfxinfo_t *owner = SampleOwner(&sounds[i]);
+        sfxprecache_t *sound;
+        sha1_context_t context;
+
+        if (sounds[i].lumpnum == -1 || owner->driver_data != NULL)
+        {
+            continue;
+        }
+
+        owner->lumpnum = sounds[i].lumpnum;
+        owner->driver_data = LoadSFX(owner);
+
+        if (owner->driver_data == NULL)
+        {
+            continue;
+        }
+
+        sound = &precache[num_precache++];
+        sound->sfxinfo = owner;
+        sound->sample = owner->driver_data;
+
+        // LoadSFX has already locked the lump.
+
+        SHA1_Init(&context);
+        SHA1_Update(&context, W_CacheLumpNum(owner->lumpnum, PU_STATIC),
+                    W_LumpLength(owner->lumpnum));
+        SHA1_Final(sound->key, &context);
+    }
+
+    path = SFXCachePath();
+    LoadSFXCache(path, precache, num_precache);
+
+    for (i=0; i<num_precache; ++i)
+    {
+        if (precache[i].data == NULL)
+        {
+            convert[num_convert++] = &precache[i];
+        }
+    }
+
+    I_ParallelFor(num_convert, I_GetCPUCount(), ConvertSoundJob, convert);
+
+    if (num_convert > 0)
+    {
+        SaveSFXCache(path, precache, num_precache);
+    }
+
+    for (i=0; i<num_precache; ++i)
+    {
+        sfxprecache_t *sound = &precache[i];
+
+        if (sound->data == NULL)
+        {
+            continue;
+        }
+
+        if (!sound->cached)
+        {
+            ReportClipped(sound->sfxinfo, sound->clipped, sound->length);
+        }
+
+        if (!UseConvertedSound(sound->sfxinfo, sound->sample, sound->data,
+                               sound->length)
+         && !sound->cached)
+        {
+            free(sound->data);
+        }
+    }
+
+    free(path);
+    free(precache);
+    free(convert);
+}
+
+#endif
+
+// Preload all the sound effects - stops nasty ingame freezes
+
+static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
+{
+    char namebuf[9];
+    int i;
+
+    printf("I_SDL_PrecacheSounds: Precaching all sound effects..");
+
+    for (i=0; i<num_sounds; ++i)
+    {
+        if ((i % 6) == 0)
+        {
+            printf(".");
+            fflush(stdout);
+        }
+
+        GetSfxLumpName(&sounds[i], namebuf, sizeof(namebuf));
+
+        sounds[i].lumpnum = W_CheckNumForName(namebuf);
+    }
+
+#ifdef HAVE_LIBSAMPLERATE
+    if (use_libsamplerate != 0 && snd_resamplecache)
+    {
+        PrecacheConvertedSounds(sounds, num_sounds);
+    }
+#endif
+
+    for (i=0; i<num_sounds; ++i)
+    {
+        if (sounds[i].lumpnum != -1)
+        {
+            GetSample(&sounds[i]);
+        }
+    }
+
+    printf("\n");
 }
 
 //
@@ -876,125 +940,207 @@ static int I_SDL_GetSfxLumpNum(sfxinfo_t *sfx)
     return W_GetNumForName(namebuf);
 }
 
+// Queue a command for the audio callback.  Returns false if the ring is
+// full, which can only happen if the callback has stopped running.
+
+static bool PushMixCommand(const mixcmd_t *cmd)
+{
+    unsigned int head = SDL_AtomicGet(&command_head);
+    unsigned int tail = SDL_AtomicGet(&command_tail);
+
+    if (head - tail > command_mask)
+    {
+        return false;
+    }
+
+    commands[head & command_mask] = *cmd;
+
+    // The command must be visible before the new head is.
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&command_head, head + 1);
+
+    return true;
+}
+
+// Convert volume and separation into the volume of each side.
+
+static void GetPanning(int vol, int sep, int *left, int *right)
+{
+    *left = ((254 - sep) * vol) / 127;
+    *right = ((sep) * vol) / 127;
+
+    if (*left < 0) *left = 0;
+    else if (*left > 255) *left = 255;
+    if (*right < 0) *right = 0;
+    else if (*right > 255) *right = 255;
+}
+
+// Sample frames to advance per output frame, as 16.16 fixed point.
+// A pitch-shifted sound plays for (2 - pitch / NORM_PITCH) times its
+// normal length.  This is an approximation of vanilla behaviour based
+// on measurements.
+
+static uint32_t GetStep(const sfxsample_t *sample, int pitch)
+{
+    uint32_t step;
+    int span;
+
+    if (!snd_pitchshift)
+    {
+        pitch = NORM_PITCH;
+    }
+
+    span = 2 * NORM_PITCH - pitch;
+
+    if (span < 1)
+    {
+        span = 1;
+    }
+
+    step = (uint32_t) ((((uint64_t) sample->samplerate * NORM_PITCH) << 16)
+                     / ((uint64_t) mixer_freq * span));
+
+    // The mixer divides by the step, so a sound must always advance.
+
+    if (step < 1)
+    {
+        step = 1;
+    }
+
+    return step;
+}
+
+// Low pass filter coefficient for a sample, as 1.15 fixed point.
+
+static int GetLowPassAlpha(const sfxsample_t *sample)
+{
+#ifdef LOW_PASS_FILTER
+    float rc, dt;
+
+    // libsamplerate has already filtered converted sounds.
+
+    if (sample->data16 != NULL || sample->samplerate >= mixer_freq)
+    {
+        return 1 << 15;
+    }
+
+    // Low-pass filter for cutoff frequency f:
+    //
+    // For sampling rate r, dt = 1 / r
+    // rc = 1 / 2*pi*f
+    // alpha = dt / (rc + dt)
+
+    // Filter to the half sample rate of the original sound effect
+    // (maximum frequency, by nyquist)
+
+    dt = 1.0f / mixer_freq;
+    rc = 1.0f / (3.14f * sample->samplerate);
+
+    return (int) ((dt / (rc + dt)) * (1 << 15));
+#else
+    return 1 << 15;
+#endif
+}
+
 static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
 {
-    int left, right;
+    mixcmd_t cmd;
 
-    if (!sound_initialized || handle < 0 || handle >= NUM_CHANNELS)
+    if (!sound_initialized || handle < 0 || handle >= num_channels
+     || !channels[handle].active)
     {
         return;
     }
 
-    left = ((254 - sep) * vol) / 127;
-    right = ((sep) * vol) / 127;
-
-    if (left < 0) left = 0;
-    else if ( left > 255) left = 255;
-    if (right < 0) right = 0;
-    else if (right > 255) right = 255;
+    cmd.type = MIXCMD_PARAMS;
+    cmd.channel = handle;
+    cmd.seq = channels[handle].seq;
+    GetPanning(vol, sep, &cmd.left, &cmd.right);
 
-    Mix_SetPanning(handle, left, right);
+    PushMixCommand(&cmd);
 }
 
 //
 // Starting a sound means adding it
 //  to the current list of active sounds
 //  in the internal channels.
-// As the SFX info struct contains
-//  e.g. a pointer to the raw data,
-//  it is ignored.
 // As our sound handling does not handle
 //  priority, it is ignored.
-// Pitching (that is, increased speed of playback)
-//  is set, but currently not used by mixing.
 //
 
 static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep, int pitch)
 {
-    allocated_sound_t *snd;
+    const sfxsample_t *sample;
+    mixcmd_t cmd;
 
-    if (!sound_initialized || channel < 0 || channel >= NUM_CHANNELS)
+    if (!sound_initialized || channel < 0 || channel >= num_channels)
     {
         return -1;
     }
 
-    // Release a sound effect if there is already one playing
-    // on this channel
-
-    ReleaseSoundOnChannel(channel);
-
     // Get the sound data
 
-    if (!LockSound(sfxinfo))
+    sample = GetSample(sfxinfo);
+
+    if (sample == NULL)
     {
         return -1;
     }
 
-    snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, pitch);
-
-    if (snd == NULL)
-    {
-        allocated_sound_t *newsnd;
-        // fetch the base sound effect, un-pitch-shifted
-        snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
-
-        if (snd == NULL)
-        {
-            return -1;
-        }
+    // Any sound already playing on the channel is replaced.
 
-        if (snd_pitchshift)
-        {
-            newsnd = PitchShift(snd, pitch);
+    cmd.type = MIXCMD_START;
+    cmd.channel = channel;
+    cmd.seq = channels[channel].seq + 1;
+    cmd.sample = sample;
+    cmd.step = GetStep(sample, pitch);
+    cmd.alpha = GetLowPassAlpha(sample);
+    GetPanning(vol, sep, &cmd.left, &cmd.right);
 
-            if (newsnd)
-            {
-                LockAllocatedSound(newsnd);
-                UnlockAllocatedSound(snd);
-                snd = newsnd;
-            }
-        }
-    }
-    else
+    if (!PushMixCommand(&cmd))
     {
-        LockAllocatedSound(snd);
+        return -1;
     }
 
-    // play sound
-
-    Mix_PlayChannel(channel, &snd->chunk, 0);
-
-    channels_playing[channel] = snd;
-
-    // set separation, etc.
-
-    I_SDL_UpdateSoundParams(channel, vol, sep);
+    channels[channel].seq = cmd.seq;
+    channels[channel].active = true;
 
     return channel;
 }
 
 static void I_SDL_StopSound(int handle)
 {
-    if (!sound_initialized || handle < 0 || handle >= NUM_CHANNELS)
+    mixcmd_t cmd;
+
+    if (!sound_initialized || handle < 0 || handle >= num_channels
+     || !channels[handle].active)
     {
         return;
     }
 
-    // Sound data is no longer needed; release the
-    // sound data being used for this channel
+    cmd.type = MIXCMD_STOP;
+    cmd.channel = handle;
+    cmd.seq = channels[handle].seq;
 
-    ReleaseSoundOnChannel(handle);
+    PushMixCommand(&cmd);
+
+    channels[handle].active = false;
 }
 
 
 static bool I_SDL_SoundIsPlaying(int handle)
 {
-    if (!sound_initialized || handle < 0 || handle >= NUM_CHANNELS)
+    mixchannel_t *channel;
+
+    if (!sound_initialized || handle < 0 || handle >= num_channels)
     {
         return false;
     }
 
-    return Mix_Playing(handle);
+    channel = &channels[handle];
+
+    return channel->active && SDL_AtomicGet(&channel->done) != channel->seq;
 }
 
 //
@@ -1003,19 +1149,237 @@ static bool I_SDL_SoundIsPlaying(int handle)
 
 static void I_SDL_UpdateSound(void)
 {
+    // Finished sounds are noticed by I_SDL_SoundIsPlaying, and there is
+    // no sound data to release.
+}
+
+// Audio callback side.  Everything below runs in the audio thread.
+
+static void FinishVoice(int channel)
+{
+    mixvoice_t *voice = &voices[channel];
+
+    if (voice->sample != NULL)
+    {
+        voice->sample = NULL;
+        SDL_AtomicSet(&channels[channel].done, voice->seq);
+    }
+}
+
+// Signed 16-bit value of a sample frame.
+
+static inline int SampleValue(const sfxsample_t *sample, uint32_t index)
+{
+    if (sample->data16 != NULL)
+    {
+        return sample->data16[index];
+    }
+
+    return sample->data8[index] * 257 - 32768;
+}
+
+static void RunMixCommands(void)
+{
+    unsigned int tail = SDL_AtomicGet(&command_tail);
+    unsigned int head = SDL_AtomicGet(&command_head);
+
+    SDL_MemoryBarrierAcquire();
+
+    for (; tail != head; ++tail)
+    {
+        const mixcmd_t *cmd = &commands[tail & command_mask];
+        mixvoice_t *voice = &voices[cmd->channel];
+
+        switch (cmd->type)
+        {
+            case MIXCMD_START:
+                FinishVoice(cmd->channel);
+                voice->sample = cmd->sample;
+                voice->pos = 0;
+                voice->step = cmd->step;
+                voice->alpha = cmd->alpha;
+                voice->filtered = SampleValue(cmd->sample, 0);
+                voice->left = cmd->left;
+                voice->right = cmd->right;
+                voice->seq = cmd->seq;
+                break;
+
+            case MIXCMD_STOP:
+                if (voice->seq == cmd->seq)
+                {
+                    FinishVoice(cmd->channel);
+                }
+                break;
+
+            case MIXCMD_PARAMS:
+                if (voice->seq == cmd->seq)
+                {
+                    voice->left = cmd->left;
+                    voice->right = cmd->right;
+                }
+                break;
+        }
+    }
+
+    // Done reading the commands before the slots can be reused.
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&command_tail, tail);
+}
+
+// Get the sample frames [first, first + count) of a voice as signed 16-bit
+// samples.  Frames past the end repeat the last one, so that interpolating
+// towards the end holds the last value.
+
+static const int16_t *VoiceSamples(const sfxsample_t *sample,
+                                   uint32_t first, int count)
+{
+    int inside = count;
     int i;
 
-    // Check all channels to see if a sound has finished
+    if (first + count > sample->length)
+    {
+        inside = sample->length - first;
+    }
+
+    if (sample->data16 != NULL && inside == count)
+    {
+        return sample->data16 + first;
+    }
+
+    if (sample->data16 != NULL)
+    {
+        memcpy(voice_samples, sample->data16 + first,
+               inside * sizeof(int16_t));
+    }
+    else
+    {
+        dsp.expandu8(voice_samples, sample->data8 + first, inside);
+    }
+
+    for (i=inside; i<count; ++i)
+    {
+        voice_samples[i] = voice_samples[inside - 1];
+    }
+
+    return voice_samples;
+}
+
+// Mix frames of a voice into mix_buffer, with linear interpolation
+// between sample frames.
+
+static void MixVoice(int channel, int frames)
+{
+    mixvoice_t *voice = &voices[channel];
+    const sfxsample_t *sample = voice->sample;
+    uint64_t end = (uint64_t) sample->length << 16;
+    int32_t *out = mix_buffer;
+
+    while (frames > 0)
+    {
+        const int16_t *in;
+        uint32_t first, frac, limit;
+        int count, i;
+
+        if (voice->pos >= end)
+        {
+            FinishVoice(channel);
+            return;
+        }
+
+        // Stop at the end of the sound, and at as many frames as fit in
+        // voice_samples.
+
+        count = frames;
+        limit = (uint32_t) ((end - voice->pos + voice->step - 1) / voice->step);
+
+        if (limit < count)
+        {
+            count = limit;
+        }
+
+        first = (uint32_t) (voice->pos >> 16);
+        frac = (uint32_t) (voice->pos & 0xffff);
+        limit = (((VOICE_SAMPLES - 2) << 16) + 0xffff - frac) / voice->step + 1;
+
+        if (limit < count)
+        {
+            count = limit;
+        }
+
+        in = VoiceSamples(sample, first,
+                          ((frac + (count - 1) * voice->step) >> 16) + 2);
+
+        // Whole sample steps from a whole sample position never fall
+        // between two samples, so holding each sample gives the same
+        // output as interpolating, for less work.  This is the case for
+        // sounds converted by libsamplerate, or already at the mixer
+        // rate, when they are not pitch shifted.
+
+        if ((frac | (voice->step & 0xffff)) == 0)
+        {
+            dsp.resamplezoh(voice_block, in, frac, voice->step, count);
+        }
+        else
+        {
+            dsp.resamplelinear(voice_block, in, frac, voice->step, count);
+        }
+
+        if (voice->alpha < (1 << 15))
+        {
+            for (i=0; i<count; ++i)
+            {
+                voice->filtered += ((voice_block[i] - voice->filtered)
+                                  * voice->alpha) >> 15;
+                voice_block[i] = voice->filtered;
+            }
+        }
+        else
+        {
+            voice->filtered = voice_block[count - 1];
+        }
+
+        dsp.mixpan(out, voice_block, count, voice->left, voice->right);
+
+        out += count * 2;
+        frames -= count;
+        voice->pos += (uint64_t) count * voice->step;
+    }
+}
 
-    for (i=0; i<NUM_CHANNELS; ++i)
+static void SFX_Mix_Callback(int chan, void *stream, int len, void *udata)
+{
+    Sint16 *out = stream;
+    int frames = len / 4;
+
+    RunMixCommands();
+
+    while (frames > 0)
     {
-        if (channels_playing[i] && !I_SDL_SoundIsPlaying(i))
+        int block = frames < MIX_BLOCK_FRAMES ? frames : MIX_BLOCK_FRAMES;
+        bool mixed = false;
+        int i;
+
+        memset(mix_buffer, 0, block * 2 * sizeof(int32_t));
+
+        for (i=0; i<num_channels; ++i)
         {
-            // Sound has finished playing on this channel,
-            // but sound data has not been released to cache
+            if (voices[i].sample != NULL)
+            {
+                MixVoice(i, block);
+                mixed = true;
+            }
+        }
 
-            ReleaseSoundOnChannel(i);
+        if (mixed)
+        {
+            // Add to what SDL_mixer has already mixed, saturating.
+
+            dsp.mixsat32(out, mix_buffer, block * 2);
         }
+
+        out += block * 2;
+        frames -= block;
     }
 }
 
@@ -1026,9 +1390,14 @@ static void I_SDL_ShutdownSound(void)
         return;
     }
 
+    Mix_UnregisterEffect(MIX_CHANNEL_POST, SFX_Mix_Callback);
     Mix_CloseAudio();
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
+    free(channels);
+    free(voices);
+    free(commands);
+
     sound_initialized = false;
 }
 
@@ -1059,18 +1428,43 @@ static int GetSliceSize(void)
     return 1024;
 }
 
-static bool I_SDL_InitSound(bool _use_sfx_prefix)
+static void AllocateMixer(void)
 {
-    int i;
+    unsigned int num_commands;
 
-    use_sfx_prefix = _use_sfx_prefix;
+    // One mixer channel for every game sound channel.
+
+    num_channels = snd_channels > 0 ? snd_channels : 1;
 
-    // No sounds yet
-    for (i=0; i<NUM_CHANNELS; ++i)
+    channels = calloc(num_channels, sizeof(mixchannel_t));
+    voices = calloc(num_channels, sizeof(mixvoice_t));
+
+    // Room for several commands per channel per slice.
+
+    num_commands = 256;
+
+    while (num_commands < num_channels * 8)
     {
-        channels_playing[i] = NULL;
+        num_commands <<= 1;
     }
 
+    commands = calloc(num_commands, sizeof(mixcmd_t));
+    command_mask = num_commands - 1;
+
+    if (channels == NULL || voices == NULL || commands == NULL)
+    {
+        I_Error("AllocateMixer: Failed to allocate %i sound channels",
+                num_channels);
+    }
+
+    SDL_AtomicSet(&command_head, 0);
+    SDL_AtomicSet(&command_tail, 0);
+}
+
+static bool I_SDL_InitSound(bool _use_sfx_prefix)
+{
+    use_sfx_prefix = _use_sfx_prefix;
+
     if (SDL_Init(SDL_INIT_AUDIO) < 0)
     {
         fprintf(stderr, "Unable to set up sound.\n");
@@ -1083,10 +1477,18 @@ static bool I_SDL_InitSound(bool _use_sfx_prefix)
         return false;
     }
 
-    ExpandSoundData = ExpandSoundData_SDL;
-
     Mix_QuerySpec(&mixer_freq, &mixer_format, &mixer_channels);
 
+    // Our mixer only supports AUDIO_S16SYS
+
+    if (mixer_format != AUDIO_S16SYS || mixer_channels != 2)
+    {
+        fprintf(stderr, "I_SDL_InitSound: Only native signed 16-bit, "
+                        "stereo output is supported.\n");
+        Mix_CloseAudio();
+        return false;
+    }
+
 #ifdef HAVE_LIBSAMPLERATE
     if (use_libsamplerate != 0)
     {
@@ -1095,8 +1497,6 @@ static bool I_SDL_InitSound(bool _use_sfx_prefix)
             I_Error("I_SDL_InitSound: Invalid value for use_libsamplerate: %i",
                     use_libsamplerate);
         }
-
-        ExpandSoundData = ExpandSoundData_SRC;
     }
 #else
     if (use_libsamplerate != 0)
@@ -1107,7 +1507,12 @@ static bool I_SDL_InitSound(bool _use_sfx_prefix)
     }
 #endif
 
-    Mix_AllocateChannels(NUM_CHANNELS);
+    AllocateMixer();
+
+    // Sound effects are mixed by SFX_Mix_Callback, not by SDL_mixer
+    // channels.
+
+    Mix_RegisterEffect(MIX_CHANNEL_POST, SFX_Mix_Callback, NULL, NULL);
 
     SDL_PauseAudio(0);
 
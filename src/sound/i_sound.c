@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include "config.h"
 #include "doomtype.h"
+#include "dsp.h"
 
 #include "gusconf.h"
 #include "i_sound.h"
@@ -237,6 +238,13 @@ void I_InitSound(bool use_sfx_prefix)
 
     if (!nosound && !screensaver_mode)
     {
+        // The mixers use the vector kernels too, unless -nosimd.
+
+        if (!M_ParmExists("-nosimd"))
+        {
+            DSP_Init();
+        }
+
         // This is kind of a hack. If native MIDI is enabled, set up
         // the TIMIDITY_CFG environment variable here before SDL_mixer
         // is opened.
@@ -458,6 +466,7 @@ void I_BindSoundVariables(void) {
     M_BindIntVariable("snd_samplerate",          &snd_samplerate);
     M_BindIntVariable("snd_cachesize",           &snd_cachesize);
     M_BindIntVariable("opl_io_port",             &opl_io_port);
+    M_BindIntVariable("opl_rendercache",         &opl_rendercache);
     M_BindIntVariable("snd_pitchshift",          &snd_pitchshift);
     M_BindStringVariable("music_pack_path",      &music_pack_path);
     M_BindStringVariable("timidity_cfg_path",    &timidity_cfg_path);
@@ -465,6 +474,7 @@ void I_BindSoundVariables(void) {
     M_BindIntVariable("gus_ram_kb",              &gus_ram_kb);
     M_BindIntVariable("use_libsamplerate",       &use_libsamplerate);
     M_BindFloatVariable("libsamplerate_scale",   &libsamplerate_scale);
+    M_BindIntVariable("snd_resamplecache",       &snd_resamplecache);
 
 #ifdef _WIN32
     I_BindWinSoundVariables();
@@ -238,6 +238,7 @@ extern int snd_pitchshift;
 extern char *snd_dmxoption;
 extern int use_libsamplerate;
 extern float libsamplerate_scale;
+extern int snd_resamplecache;
 
 void I_BindSoundVariables(void);
 
@@ -265,6 +266,7 @@ extern const music_module_t music_fl_module;
 // For OPL module:
 
 extern int opl_io_port;
+extern int opl_rendercache;
 
 // For native music module:
 
@@ -1541,28 +1541,36 @@ static bool IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static bool ConvertMus(byte *musdata, int len, const char *filename)
+// Parse a MIDI, or a MUS converted to MIDI, without touching the
+// filesystem.
+
+static midi_file_t *LoadMidi(void *data, int len)
 {
     MEMFILE *instream;
     MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
-    int result;
-
-    instream = mem_fopen_read(musdata, len);
-    outstream = mem_fopen_write();
+    midi_file_t *result = NULL;
 
-    result = mus2mid(instream, outstream);
+    instream = mem_fopen_read(data, len);
 
-    if (result == 0)
+    if (IsMid(data, len))
+    {
+        result = MIDI_LoadMemory(instream);
+    }
+    else
     {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
+        // Assume a MUS file and try to convert
+
+        outstream = mem_fopen_write();
+
+        if (mus2mid(instream, outstream) == 0)
+        {
+            result = MIDI_LoadMemory(outstream);
+        }
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+        mem_fclose(outstream);
     }
 
     mem_fclose(instream);
-    mem_fclose(outstream);
 
     return result;
 }
@@ -1570,7 +1578,6 @@ static bool ConvertMus(byte *musdata, int len, const char *filename)
 static void *I_WIN_RegisterSong(void *data, int len)
 {
     unsigned int i;
-    char *filename;
     midi_file_t *file;
 
     MIDIPROPTIMEDIV prop_timediv;
@@ -1585,23 +1592,7 @@ static void *I_WIN_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
-    if (IsMid(data, len))
-    {
-        M_WriteFile(filename, data, len);
-    }
-    else
-    {
-        // Assume a MUS file and try to convert
-
-        ConvertMus(data, len, filename);
-    }
-
-    file = MIDI_LoadFile(filename);
-
-    M_remove(filename);
-    free(filename);
+    file = LoadMidi(data, len);
 
     if (file == NULL)
     {
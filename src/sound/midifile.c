@@ -24,6 +24,7 @@
 #include "i_swap.h"
 #include "i_system.h"
 #include "m_misc.h"
+#include "memio.h"
 #include "midifile.h"
 
 #define HEADER_CHUNK_ID "MThd"
@@ -59,7 +60,7 @@ typedef struct
 
     unsigned int data_len;
 
-    // Events in this track:
+    // Events in this track, part of the events array of the file:
 
     midi_event_t *events;
     int num_events;
@@ -80,11 +81,24 @@ struct midi_file_s
     midi_track_t *tracks;
     unsigned int num_tracks;
 
-    // Data buffer used to store data read for SysEx or meta events:
+    // The events of all tracks, one track after another:
+    midi_event_t *events;
+    unsigned int num_events;
+
+    // The whole file.  SysEx and meta events point into it:
     byte *buffer;
     unsigned int buffer_size;
 };
 
+// Read position in the data of a file being loaded.
+
+typedef struct
+{
+    byte *data;
+    unsigned int length;
+    unsigned int position;
+} midi_stream_t;
+
 // Check the header of a chunk:
 
 static bool CheckChunkHeader(chunk_header_t *chunk,
@@ -106,22 +120,35 @@ static bool CheckChunkHeader(chunk_header_t *chunk,
     return result;
 }
 
-// Read a single byte.  Returns false on error.
+// Read a block of the given size.  Returns NULL on error.
 
-static bool ReadByte(byte *result, FILE *stream)
+static void *ReadBlock(unsigned int size, midi_stream_t *stream)
 {
-    int c;
+    void *result;
 
-    c = fgetc(stream);
+    if (size > stream->length - stream->position)
+    {
+        return NULL;
+    }
+
+    result = stream->data + stream->position;
+    stream->position += size;
 
-    if (c == EOF)
+    return result;
+}
+
+// Read a single byte.  Returns false on error.
+
+static inline bool ReadByte(byte *result, midi_stream_t *stream)
+{
+    if (stream->position >= stream->length)
     {
         fprintf(stderr, "ReadByte: Unexpected end of file\n");
         return false;
     }
     else
     {
-        *result = (byte) c;
+        *result = stream->data[stream->position++];
 
         return true;
     }
@@ -129,7 +156,7 @@ static bool ReadByte(byte *result, FILE *stream)
 
 // Read a variable-length value.
 
-static bool ReadVariableLength(unsigned int *result, FILE *stream)
+static bool ReadVariableLength(unsigned int *result, midi_stream_t *stream)
 {
     int i;
     byte b = 0;
@@ -163,35 +190,18 @@ static bool ReadVariableLength(unsigned int *result, FILE *stream)
     return false;
 }
 
-// Read a byte sequence into the data buffer.
+// Read a byte sequence.  The result points into the file data.
 
-static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
+static void *ReadByteSequence(unsigned int num_bytes, midi_stream_t *stream)
 {
-    unsigned int i;
     byte *result;
 
-    // Allocate a buffer. Allocate one extra byte, as malloc(0) is
-    // non-portable.
-
-    result = malloc(num_bytes + 1);
+    result = ReadBlock(num_bytes, stream);
 
     if (result == NULL)
     {
-        fprintf(stderr, "ReadByteSequence: Failed to allocate buffer\n");
-        return NULL;
-    }
-
-    // Read the data:
-
-    for (i=0; i<num_bytes; ++i)
-    {
-        if (!ReadByte(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
+        fprintf(stderr, "ReadByteSequence: Unexpected end of file reading "
+                        "%u bytes\n", num_bytes);
     }
 
     return result;
@@ -203,7 +213,7 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
 static bool ReadChannelEvent(midi_event_t *event,
                                 byte event_type, bool two_param,
-                                FILE *stream)
+                                midi_stream_t *stream)
 {
     byte b = 0;
 
@@ -243,7 +253,7 @@ static bool ReadChannelEvent(midi_event_t *event,
 // Read sysex event:
 
 static bool ReadSysExEvent(midi_event_t *event, int event_type,
-                              FILE *stream)
+                              midi_stream_t *stream)
 {
     event->event_type = event_type;
 
@@ -269,7 +279,7 @@ static bool ReadSysExEvent(midi_event_t *event, int event_type,
 
 // Read meta event:
 
-static bool ReadMetaEvent(midi_event_t *event, FILE *stream)
+static bool ReadMetaEvent(midi_event_t *event, midi_stream_t *stream)
 {
     byte b = 0;
 
@@ -308,7 +318,7 @@ static bool ReadMetaEvent(midi_event_t *event, FILE *stream)
 }
 
 static bool ReadEvent(midi_event_t *event, unsigned int *last_event_type,
-                         FILE *stream)
+                         midi_stream_t *stream)
 {
     byte event_type = 0;
 
@@ -332,12 +342,7 @@ static bool ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     if ((event_type & 0x80) == 0)
     {
         event_type = *last_event_type;
-
-        if (fseek(stream, -1, SEEK_CUR) < 0)
-        {
-            fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
-            return false;
-        }
+        --stream->position;
     }
     else
     {
@@ -386,44 +391,22 @@ static bool ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     return false;
 }
 
-// Free an event:
-
-static void FreeEvent(midi_event_t *event)
-{
-    // Some event types have dynamically allocated buffers assigned
-    // to them that must be freed.
-
-    switch (event->event_type)
-    {
-        case MIDI_EVENT_SYSEX:
-        case MIDI_EVENT_SYSEX_SPLIT:
-            free(event->data.sysex.data);
-            break;
-
-        case MIDI_EVENT_META:
-            free(event->data.meta.data);
-            break;
-
-        default:
-            // Nothing to do.
-            break;
-    }
-}
-
 // Read and check the track chunk header
 
-static bool ReadTrackHeader(midi_track_t *track, FILE *stream)
+static bool ReadTrackHeader(midi_track_t *track, midi_stream_t *stream)
 {
-    size_t records_read;
     chunk_header_t chunk_header;
+    void *block;
 
-    records_read = fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
+    block = ReadBlock(sizeof(chunk_header_t), stream);
 
-    if (records_read < 1)
+    if (block == NULL)
     {
         return false;
     }
 
+    memcpy(&chunk_header, block, sizeof(chunk_header_t));
+
     if (!CheckChunkHeader(&chunk_header, TRACK_CHUNK_ID))
     {
         return false;
@@ -434,14 +417,14 @@ static bool ReadTrackHeader(midi_track_t *track, FILE *stream)
     return true;
 }
 
-static bool ReadTrack(midi_track_t *track, FILE *stream)
+static bool ReadTrack(midi_file_t *file, midi_track_t *track,
+                      unsigned int max_events, midi_stream_t *stream)
 {
-    midi_event_t *new_events;
     midi_event_t *event;
     unsigned int last_event_type;
 
     track->num_events = 0;
-    track->events = NULL;
+    track->events = file->events + file->num_events;
 
     // Read the header:
 
@@ -456,11 +439,14 @@ static bool ReadTrack(midi_track_t *track, FILE *stream)
 
     for (;;)
     {
-        // Resize the track slightly larger to hold another event:
+        // The events array was sized for the shortest possible events,
+        // so this can only happen with a broken file.
 
-        new_events = I_Realloc(track->events, 
-                             sizeof(midi_event_t) * (track->num_events + 1));
-        track->events = new_events;
+        if (file->num_events >= max_events)
+        {
+            fprintf(stderr, "ReadTrack: Too many events\n");
+            return false;
+        }
 
         // Read the next event:
 
@@ -471,6 +457,7 @@ static bool ReadTrack(midi_track_t *track, FILE *stream)
         }
 
         ++track->num_events;
+        ++file->num_events;
 
         // End of track?
 
@@ -484,22 +471,9 @@ static bool ReadTrack(midi_track_t *track, FILE *stream)
     return true;
 }
 
-// Free a track:
-
-static void FreeTrack(midi_track_t *track)
-{
-    unsigned int i;
-
-    for (i=0; i<track->num_events; ++i)
-    {
-        FreeEvent(&track->events[i]);
-    }
-
-    free(track->events);
-}
-
-static bool ReadAllTracks(midi_file_t *file, FILE *stream)
+static bool ReadAllTracks(midi_file_t *file, midi_stream_t *stream)
 {
+    unsigned int max_events;
     unsigned int i;
 
     // Allocate list of tracks and read each track:
@@ -513,33 +487,61 @@ static bool ReadAllTracks(midi_file_t *file, FILE *stream)
 
     memset(file->tracks, 0, sizeof(midi_track_t) * file->num_tracks);
 
+    // Every event takes at least two bytes (a delta time, and a single
+    // parameter with the running status), so this many events is
+    // enough for any file.
+
+    max_events = (stream->length - stream->position) / 2 + 1;
+    file->events = malloc(sizeof(midi_event_t) * max_events);
+
+    if (file->events == NULL)
+    {
+        return false;
+    }
+
     // Read each track:
 
     for (i=0; i<file->num_tracks; ++i)
     {
-        if (!ReadTrack(&file->tracks[i], stream))
+        if (!ReadTrack(file, &file->tracks[i], max_events, stream))
         {
             return false;
         }
     }
 
+    // Give back what was not needed, and point the tracks at the
+    // events again in case they moved.
+
+    file->events = I_Realloc(file->events,
+                             sizeof(midi_event_t) * (file->num_events + 1));
+
+    file->num_events = 0;
+
+    for (i=0; i<file->num_tracks; ++i)
+    {
+        file->tracks[i].events = file->events + file->num_events;
+        file->num_events += file->tracks[i].num_events;
+    }
+
     return true;
 }
 
 // Read and check the header chunk.
 
-static bool ReadFileHeader(midi_file_t *file, FILE *stream)
+static bool ReadFileHeader(midi_file_t *file, midi_stream_t *stream)
 {
-    size_t records_read;
     unsigned int format_type;
+    void *block;
 
-    records_read = fread(&file->header, sizeof(midi_header_t), 1, stream);
+    block = ReadBlock(sizeof(midi_header_t), stream);
 
-    if (records_read < 1)
+    if (block == NULL)
     {
         return false;
     }
 
+    memcpy(&file->header, block, sizeof(midi_header_t));
+
     if (!CheckChunkHeader(&file->header.chunk_header, HEADER_CHUNK_ID)
      || SDL_SwapBE32(file->header.chunk_header.chunk_size) != 6)
     {
@@ -565,70 +567,113 @@ static bool ReadFileHeader(midi_file_t *file, FILE *stream)
 
 void MIDI_FreeFile(midi_file_t *file)
 {
-    int i;
-
-    if (file->tracks != NULL)
-    {
-        for (i=0; i<file->num_tracks; ++i)
-        {
-            FreeTrack(&file->tracks[i]);
-        }
-
-        free(file->tracks);
-    }
-
+    free(file->tracks);
+    free(file->events);
+    free(file->buffer);
     free(file);
 }
 
-midi_file_t *MIDI_LoadFile(char *filename)
+// Parse a MIDI file from a buffer of buflen + 1 bytes allocated with
+// malloc.  The file takes the buffer over, for the SysEx and meta events
+// to point into, and frees it even on failure.
+
+static midi_file_t *LoadBuffer(byte *buffer, size_t buflen)
 {
     midi_file_t *file;
-    FILE *stream;
+    midi_stream_t data;
 
     file = malloc(sizeof(midi_file_t));
 
     if (file == NULL)
     {
+        free(buffer);
         return NULL;
     }
 
     file->tracks = NULL;
     file->num_tracks = 0;
-    file->buffer = NULL;
-    file->buffer_size = 0;
+    file->events = NULL;
+    file->num_events = 0;
+    file->buffer = buffer;
+    file->buffer_size = buflen;
 
-    // Open file
+    data.data = file->buffer;
+    data.length = file->buffer_size;
+    data.position = 0;
 
-    stream = M_fopen(filename, "rb");
+    // Read MIDI file header
 
-    if (stream == NULL)
+    if (!ReadFileHeader(file, &data))
     {
-        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read MIDI file header
+    // Read all tracks:
 
-    if (!ReadFileHeader(file, stream))
+    if (!ReadAllTracks(file, &data))
     {
-        fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read all tracks:
+    return file;
+}
+
+midi_file_t *MIDI_LoadMemory(MEMFILE *stream)
+{
+    byte *buffer;
+    void *buf;
+    size_t buflen;
+
+    // Keep a copy of the data, since the stream may not outlive the file.
+
+    mem_get_buf(stream, &buf, &buflen);
+
+    buffer = malloc(buflen + 1);
 
-    if (!ReadAllTracks(file, stream))
+    if (buffer == NULL)
     {
-        fclose(stream);
-        MIDI_FreeFile(file);
         return NULL;
     }
 
-    fclose(stream);
+    memcpy(buffer, buf, buflen);
 
-    return file;
+    return LoadBuffer(buffer, buflen);
+}
+
+midi_file_t *MIDI_LoadFile(char *filename)
+{
+    FILE *handle;
+    byte *buf;
+    long length;
+
+    // Open file
+
+    handle = M_fopen(filename, "rb");
+
+    if (handle == NULL)
+    {
+        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        return NULL;
+    }
+
+    // Read it all, and parse it in place
+
+    length = M_FileLength(handle);
+    buf = malloc(length + 1);
+
+    if (buf == NULL || fread(buf, 1, length, handle) < length)
+    {
+        fprintf(stderr, "MIDI_LoadFile: Failed to read '%s'\n", filename);
+        fclose(handle);
+        free(buf);
+        return NULL;
+    }
+
+    fclose(handle);
+
+    return LoadBuffer(buf, length);
 }
 
 // Get the number of tracks in a MIDI file.
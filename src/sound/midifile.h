@@ -18,6 +18,8 @@
 #ifndef MIDIFILE_H
 #define MIDIFILE_H
 
+#include "memio.h"
+
 typedef struct midi_file_s midi_file_t;
 typedef struct midi_track_iter_s midi_track_iter_t;
 
@@ -188,6 +190,12 @@ typedef struct
 
 midi_file_t *MIDI_LoadFile(char *filename);
 
+// Load a MIDI file from the whole buffer of a memory stream, such as the
+// output of mus2mid.  The data is copied, so the stream can be closed
+// afterwards.
+
+midi_file_t *MIDI_LoadMemory(MEMFILE *stream);
+
 // Free a MIDI file.
 
 void MIDI_FreeFile(midi_file_t *file);
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "i_profile.h"
 #include "i_sound.h"
 #include "i_system.h"
 
@@ -514,6 +515,7 @@ static void S_UpdatePlayingSound(const mobj_t* listener, int cnum) {
 // Updates music & sounds
 //
 void S_UpdateSounds(const mobj_t* listener) {
+    PROFILE_BEGIN("S_UpdateSounds");
     I_UpdateSound();
 
     for (int cnum = 0; cnum < snd_channels; cnum++) {
@@ -528,6 +530,7 @@ void S_UpdateSounds(const mobj_t* listener) {
             S_StopChannel(cnum);
         }
     }
+    PROFILE_END("S_UpdateSounds");
 }
 
 void S_SetMusicVolume(int volume) {
@@ -182,14 +182,24 @@ static result_e T_MovePlaneFloor(sector_t* sector, fixed_t speed, fixed_t dest,
 result_e T_MovePlane(sector_t* sector, fixed_t speed, fixed_t dest,
                      bool crush, int floorOrCeiling, int direction)
 {
+    result_e result;
+
+    // Crushing things can run actions between moving the plane and
+    // putting it back, so drop cached sight before and after.
+    P_InvalidateSightCache();
     switch (floorOrCeiling) {
         case 0:
-            return T_MovePlaneFloor(sector, speed, dest, crush, direction);
+            result = T_MovePlaneFloor(sector, speed, dest, crush, direction);
+            break;
         case 1:
-            return T_MoveCeilingPlane(sector, speed, dest, crush, direction);
+            result = T_MoveCeilingPlane(sector, speed, dest, crush, direction);
+            break;
         default:
             return ok;
     }
+    P_InvalidateSightCache();
+
+    return result;
 }
 
 
@@ -267,7 +277,7 @@ EV_DoFloor
 	
 	// new floor thinker
 	rtn = 1;
-	floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	floor = P_AllocThinker(tp_floor, sizeof(*floor));
 	P_AddThinker (&floor->thinker);
 	sec->specialdata = floor;
 	floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -468,7 +478,7 @@ int EV_BuildStairs(const line_t *line, stair_e type) {
 
         // new floor thinker
         rtn = 1;
-        floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+        floor = P_AllocThinker(tp_floor, sizeof(*floor));
         P_AddThinker(&floor->thinker);
         sec->specialdata = floor;
         floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -527,7 +537,7 @@ int EV_BuildStairs(const line_t *line, stair_e type) {
 
                 sec = tsec;
                 secnum = newsecnum;
-                floor = Z_Malloc(sizeof(*floor), PU_LEVSPEC, 0);
+                floor = P_AllocThinker(tp_floor, sizeof(*floor));
 
                 P_AddThinker(&floor->thinker);
 
@@ -58,7 +58,7 @@ void P_SpawnFireFlicker(sector_t* sector) {
     // Nothing special about it during gameplay.
     sector->special = 0;
 
-    fireflicker_t* flick = Z_Malloc(sizeof(*flick), PU_LEVSPEC, NULL);
+    fireflicker_t* flick = P_AllocThinker(tp_fireflicker, sizeof(*flick));
 
     P_AddThinker(&flick->thinker);
 
@@ -104,7 +104,7 @@ void P_SpawnLightFlash(sector_t* sector) {
     // Nothing special about it during gameplay.
     sector->special = 0;
 
-    lightflash_t *flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, NULL);
+    lightflash_t *flash = P_AllocThinker(tp_lightflash, sizeof(*flash));
 
     P_AddThinker(&flash->thinker);
 
@@ -147,7 +147,7 @@ void T_StrobeFlash(strobe_t *flash) {
 // for specials that spawn thinkers
 //
 void P_SpawnStrobeFlash(sector_t* sector, int fastOrSlow, int inSync) {
-    strobe_t* flash = Z_Malloc(sizeof(*flash), PU_LEVSPEC, NULL);
+    strobe_t* flash = P_AllocThinker(tp_strobe, sizeof(*flash));
 
     P_AddThinker(&flash->thinker);
 
@@ -183,10 +183,9 @@ void EV_StartLightStrobing(const line_t* line) {
 
 static void EV_TurnSectorLightsOff(sector_t* sector) {
     short min = sector->lightlevel;
-    for (int i = 0; i < sector->linecount; i++) {
-        line_t* line = sector->lines[i];
-        const sector_t* sec = getNextSector(line, sector);
-        if (sec && sec->lightlevel < min) {
+    for (int i = 0; i < sector->neighbourcount; i++) {
+        const sector_t* sec = sector->neighbours[i];
+        if (sec->lightlevel < min) {
             min = sec->lightlevel;
         }
     }
@@ -197,21 +196,18 @@ static void EV_TurnSectorLightsOff(sector_t* sector) {
 // TURN LINE'S TAG LIGHTS OFF
 //
 void EV_TurnTagLightsOff(const line_t* line) {
-    for (int i = 0; i < numsectors; i++) {
-        sector_t* sector = &sectors[i];
-        if (sector->tag == line->tag) {
-            EV_TurnSectorLightsOff(sector);
-        }
+    int secnum = -1;
+    while ((secnum = P_FindSectorFromLineTag(line, secnum)) >= 0) {
+        EV_TurnSectorLightsOff(&sectors[secnum]);
     }
 }
 
 static void EV_TurnSectorLightsOn(sector_t* sector, int bright) {
     // bright = 0 means to search for highest light level surrounding sector
     if (bright == 0) {
-        for (int i = 0; i < sector->linecount; i++) {
-            line_t* line = sector->lines[i];
-            const sector_t* sec = getNextSector(line, sector);
-            if (sec && sec->lightlevel > bright) {
+        for (int i = 0; i < sector->neighbourcount; i++) {
+            const sector_t* sec = sector->neighbours[i];
+            if (sec->lightlevel > bright) {
                 bright = sec->lightlevel;
             }
         }
@@ -223,11 +219,9 @@ static void EV_TurnSectorLightsOn(sector_t* sector, int bright) {
 // TURN LINE'S TAG LIGHTS ON
 //
 void EV_LightTurnOn(const line_t* line, int bright) {
-    for (int i = 0; i < numsectors; i++) {
-        sector_t* sector = &sectors[i];
-        if (sector->tag == line->tag) {
-            EV_TurnSectorLightsOn(sector, bright);
-        }
+    int secnum = -1;
+    while ((secnum = P_FindSectorFromLineTag(line, secnum)) >= 0) {
+        EV_TurnSectorLightsOn(&sectors[secnum], bright);
     }
 }
 
@@ -261,7 +255,7 @@ void T_Glow(glow_t* g) {
 
 
 void P_SpawnGlowingLight(sector_t* sector) {
-    glow_t* g = Z_Malloc(sizeof(*g), PU_LEVSPEC, NULL);
+    glow_t* g = P_AllocThinker(tp_glow, sizeof(*g));
 
     P_AddThinker(&g->thinker);
 
@@ -250,12 +250,8 @@ sector_t* getNextSector(line_t* line, const sector_t* sec) {
 fixed_t P_FindLowestFloorSurrounding(sector_t* sec) {
     fixed_t floor = sec->floorheight;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        line_t* check = sec->lines[i];
-        sector_t* other = getNextSector(check, sec);
-        if (!other) {
-            continue;
-        }
+    for (int i = 0; i < sec->neighbourcount; i++) {
+        sector_t* other = sec->neighbours[i];
         if (other->floorheight < floor) {
             floor = other->floorheight;
         }
@@ -272,12 +268,8 @@ fixed_t P_FindLowestFloorSurrounding(sector_t* sec) {
 fixed_t P_FindHighestFloorSurrounding(sector_t* sec) {
     fixed_t floor = -500 * FRACUNIT;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        line_t* check = sec->lines[i];
-        sector_t* other = getNextSector(check, sec);
-        if (!other) {
-            continue;
-        }
+    for (int i = 0; i < sec->neighbourcount; i++) {
+        sector_t* other = sec->neighbours[i];
         if (other->floorheight > floor) {
             floor = other->floorheight;
         }
@@ -314,12 +306,8 @@ static int P_AdjoinSectors(const sector_t *sec, int currentheight) {
     int adjoined_secs = 0;
     fixed_t height = currentheight;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        line_t* check = sec->lines[i];
-        const sector_t* other = getNextSector(check, sec);
-        if (other == NULL) {
-            continue;
-        }
+    for (int i = 0; i < sec->neighbourcount; i++) {
+        const sector_t* other = sec->neighbours[i];
         if (other->floorheight <= height) {
             continue;
         }
@@ -356,12 +344,8 @@ fixed_t P_FindNextHighestFloor(const sector_t* sec, int currentheight) {
 fixed_t P_FindLowestCeilingSurrounding(const sector_t* sec) {
     fixed_t height = INT_MAX;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        line_t* check = sec->lines[i];
-        const sector_t* other = getNextSector(check, sec);
-        if (other == NULL) {
-            continue;
-        }
+    for (int i = 0; i < sec->neighbourcount; i++) {
+        const sector_t* other = sec->neighbours[i];
         if (other->ceilingheight < height) {
             height = other->ceilingheight;
         }
@@ -377,13 +361,8 @@ fixed_t P_FindLowestCeilingSurrounding(const sector_t* sec) {
 fixed_t P_FindHighestCeilingSurrounding(const sector_t* sec) {
     fixed_t height = 0;
 
-    for (int i = 0; i < sec->linecount; i++) {
-        line_t* check = sec->lines[i];
-        const sector_t* other = getNextSector(check, sec);
-
-        if (other == NULL) {
-            continue;
-        }
+    for (int i = 0; i < sec->neighbourcount; i++) {
+        const sector_t* other = sec->neighbours[i];
         if (other->ceilingheight > height) {
             height = other->ceilingheight;
         }
@@ -393,16 +372,85 @@ fixed_t P_FindHighestCeilingSurrounding(const sector_t* sec) {
 }
 
 
+//
+// TAG INDEX
+// The numbers of the sectors with each tag, in ascending order, so that
+// finding the sectors a line refers to does not mean looking at every
+// sector in the level.
+//
+
+// tagsectors[tagsectorstart[tag]] up to tagsectors[tagsectorstart[tag + 1]]
+static int* tagsectorstart;
+static int* tagsectors;
+static int numtagslots;
+
+static inline int P_TagSlot(short tag) {
+    return (unsigned short) tag;
+}
+
+//
+// P_BuildTagIndex
+// Called by P_SetupLevel, once the sectors are loaded.
+//
+void P_BuildTagIndex() {
+    numtagslots = 0;
+    for (int i = 0; i < numsectors; i++) {
+        int slot = P_TagSlot(sectors[i].tag);
+        if (slot >= numtagslots) {
+            numtagslots = slot + 1;
+        }
+    }
+
+    tagsectorstart = Z_Malloc((numtagslots + 1) * sizeof(int), PU_LEVEL, NULL);
+    tagsectors = Z_Malloc(numsectors * sizeof(int), PU_LEVEL, NULL);
+    memset(tagsectorstart, 0, (numtagslots + 1) * sizeof(int));
+
+    // Count the sectors with each tag, and from that where each tag's
+    // list starts.
+    for (int i = 0; i < numsectors; i++) {
+        tagsectorstart[P_TagSlot(sectors[i].tag) + 1]++;
+    }
+    for (int slot = 0; slot < numtagslots; slot++) {
+        tagsectorstart[slot + 1] += tagsectorstart[slot];
+    }
+
+    // Fill the lists, which moves each start to the start of the next
+    // tag's list, then move them back.
+    for (int i = 0; i < numsectors; i++) {
+        tagsectors[tagsectorstart[P_TagSlot(sectors[i].tag)]] = i;
+        tagsectorstart[P_TagSlot(sectors[i].tag)]++;
+    }
+    for (int slot = numtagslots; slot > 0; slot--) {
+        tagsectorstart[slot] = tagsectorstart[slot - 1];
+    }
+    tagsectorstart[0] = 0;
+}
+
 //
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
 //
 int P_FindSectorFromLineTag(const line_t* line, int start) {
-    for (int i = start + 1; i < numsectors; i++) {
-        if (sectors[i].tag == line->tag) {
-            return i;
+    int slot = P_TagSlot(line->tag);
+    if (slot >= numtagslots) {
+        return -1;
+    }
+
+    // The first sector with the tag after start. Callers step through the
+    // list in order, so this usually finds it straight away.
+    int low = tagsectorstart[slot];
+    int high = tagsectorstart[slot + 1];
+    if (low < high && tagsectors[low] > start) {
+        return tagsectors[low];
+    }
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (tagsectors[mid] <= start) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
-    return -1;
+    return low < tagsectorstart[slot + 1] ? tagsectors[low] : -1;
 }
 
 
@@ -412,12 +460,8 @@ int P_FindSectorFromLineTag(const line_t* line, int start) {
 int P_FindMinSurroundingLight(const sector_t* sector, int max) {
     int min = max;
 
-    for (int i = 0; i < sector->linecount; i++) {
-        line_t* line = sector->lines[i];
-        const sector_t* check = getNextSector(line, sector);
-        if (check == NULL) {
-            continue;
-        }
+    for (int i = 0; i < sector->neighbourcount; i++) {
+        const sector_t* check = sector->neighbours[i];
         if (check->lightlevel < min) {
             min = check->lightlevel;
         }
@@ -1257,7 +1301,7 @@ int EV_DoDonut(line_t*	line)
             }
 
 	    //	Spawn rising slime
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	    floor = P_AllocThinker(tp_floor, sizeof(*floor));
 	    P_AddThinker (&floor->thinker);
 	    s2->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
@@ -1271,7 +1315,7 @@ int EV_DoDonut(line_t*	line)
 	    floor->floordestheight = s3_floorheight;
 	    
 	    //	Spawn lowering donut-hole
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVSPEC, 0);
+	    floor = P_AllocThinker(tp_floor, sizeof(*floor));
 	    P_AddThinker (&floor->thinker);
 	    s1->specialdata = floor;
 	    floor->thinker.function.acp1 = (actionf_p1) T_MoveFloor;
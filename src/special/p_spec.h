@@ -39,6 +39,7 @@ fixed_t P_FindLowestCeilingSurrounding(const sector_t *sec);
 fixed_t P_FindLowestFloorSurrounding(sector_t *sec);
 int P_FindMinSurroundingLight(const sector_t *sector, int max);
 fixed_t P_FindNextHighestFloor(const sector_t *sec, int currentheight);
+void P_BuildTagIndex(void);
 int P_FindSectorFromLineTag(const line_t *line, int start);
 void P_PlayerInSpecialSector(player_t *player);
 void P_ShootSpecialLine(mobj_t *thing, line_t *line);
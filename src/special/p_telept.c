@@ -134,7 +134,8 @@ void EV_Teleport(const line_t* line, int side, mobj_t* thing) {
         return;
     }
 
-    for (int sec = 0; sec < numsectors; sec++) {
+    int sec = -1;
+    while ((sec = P_FindSectorFromLineTag(line, sec)) >= 0) {
         const mobj_t* teleport = EV_FindTeleportExit(line->tag, sec);
         if (teleport) {
             EV_TryTeleportThing(thing, teleport);
@@ -0,0 +1,317 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Per-phase frame timing for -timedemo. Every frame drawn while the
+//	demo plays records its wall time, and the time spent in each phase,
+//	in microseconds. At the end of the demo min/avg/p99/max are printed
+//	and written to a JSON file.
+//
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "p_local.h"
+#include "z_zone.h"
+
+
+typedef struct {
+    uint32_t* times;
+    uint32_t min;
+    uint32_t max;
+    uint32_t p99;
+    uint64_t total;
+} benchseries_t;
+
+static const char* phasenames[NUMBENCHPHASES] = {
+    "P_Ticker",
+    "R_RenderSectors",
+    "R_DrawPlanes",
+    "R_DrawMasked",
+    "R_FinishThreadedFrame",
+    "HUD",
+    "I_FinishUpdate",
+};
+
+static const char* tagnames[PU_NUM_TAGS] = {
+    NULL,
+    "PU_STATIC",
+    "PU_SOUND",
+    "PU_MUSIC",
+    NULL,
+    "PU_LEVEL",
+    "PU_LEVSPEC",
+    "PU_PURGELEVEL",
+    "PU_CACHE",
+};
+
+bool benchmarking = false;
+
+static const char* benchfile;
+
+// Per frame samples, one series per phase plus the whole frame.
+static benchseries_t phases[NUMBENCHPHASES];
+static benchseries_t frames;
+static int numframes;
+static int maxframes;
+
+static uint64_t framestart;
+static uint64_t phasestart[NUMBENCHPHASES];
+static uint64_t phasetime[NUMBENCHPHASES];
+static bool skipframe;
+
+// Thinker calls and sight cache lookups made before the demo started.
+static uint64_t thinkerstart[NUMTHINKERPOOLS];
+static uint64_t sighthitstart;
+static uint64_t sightmissstart;
+
+
+void BenchInit(void) {
+    //!
+    // @category video
+    // @arg <filename>
+    //
+    // Used with -timedemo. Time every frame, and the playsim, rendering,
+    // HUD and blit phases of it, and write min/avg/p99/max frame times
+    // to the specified file as JSON. Exits normally at the end of the demo.
+    //
+    int p = M_CheckParmWithArgs("-bench", 1);
+    if (p == 0) {
+        return;
+    }
+    benchfile = myargv[p + 1];
+    benchmarking = true;
+}
+
+void BenchStart(void) {
+    if (!benchmarking) {
+        return;
+    }
+    numframes = 0;
+
+    // The frame in progress loaded the level.
+    skipframe = true;
+
+    for (int i = 0; i < NUMTHINKERPOOLS; i++) {
+        thinkerstart[i] = P_ThinkerCalls(i);
+    }
+    P_SightCacheStats(&sighthitstart, &sightmissstart);
+}
+
+static void BenchGrowSeries() {
+    maxframes = maxframes ? maxframes * 2 : 4096;
+
+    frames.times = I_Realloc(frames.times, maxframes * sizeof(*frames.times));
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        phases[i].times = I_Realloc(phases[i].times, maxframes * sizeof(*phases[i].times));
+    }
+}
+
+void BenchBeginFrame(void) {
+    if (!benchmarking) {
+        return;
+    }
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        phasetime[i] = 0;
+    }
+    framestart = I_GetTimeUS();
+}
+
+void BenchEndFrame(void) {
+    if (!benchmarking) {
+        return;
+    }
+    if (skipframe) {
+        skipframe = false;
+        return;
+    }
+    if (numframes == maxframes) {
+        BenchGrowSeries();
+    }
+
+    frames.times[numframes] = (uint32_t) (I_GetTimeUS() - framestart);
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        phases[i].times[numframes] = (uint32_t) phasetime[i];
+    }
+    numframes++;
+}
+
+void BenchBeginPhase(benchphase_t phase) {
+    if (!benchmarking) {
+        return;
+    }
+    phasestart[phase] = I_GetTimeUS();
+}
+
+void BenchEndPhase(benchphase_t phase) {
+    if (!benchmarking) {
+        return;
+    }
+    // A phase can run more than once in a frame, e.g. several tics.
+    phasetime[phase] += I_GetTimeUS() - phasestart[phase];
+}
+
+
+static int BenchCompareTimes(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void BenchSummarize(benchseries_t* series, uint32_t* sorted) {
+    memcpy(sorted, series->times, numframes * sizeof(*sorted));
+    qsort(sorted, numframes, sizeof(*sorted), BenchCompareTimes);
+
+    series->total = 0;
+    for (int i = 0; i < numframes; i++) {
+        series->total += sorted[i];
+    }
+    series->min = sorted[0];
+    series->max = sorted[numframes - 1];
+
+    // Nearest rank.
+    int rank = (numframes * 99 + 99) / 100;
+    series->p99 = sorted[rank - 1];
+}
+
+static double BenchMS(uint64_t us) {
+    return us / 1000.0;
+}
+
+static void BenchPrintSeries(const char* name, const benchseries_t* series) {
+    printf("%-22s %9.3f %9.3f %9.3f %9.3f %11.1f\n", name,
+           BenchMS(series->min), BenchMS(series->total) / numframes,
+           BenchMS(series->p99), BenchMS(series->max), BenchMS(series->total));
+}
+
+static void BenchWriteSeries(FILE* file, const benchseries_t* series) {
+    fprintf(file, "{\"min_ms\": %.3f, \"avg_ms\": %.3f, \"p99_ms\": %.3f, "
+                  "\"max_ms\": %.3f, \"total_ms\": %.3f}",
+            BenchMS(series->min), BenchMS(series->total) / numframes,
+            BenchMS(series->p99), BenchMS(series->max), BenchMS(series->total));
+}
+
+// Write s as a JSON string.
+static void BenchWriteString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void BenchWriteLimit(FILE* file, const char* name,
+                            const renderlimit_t* limit, const char* separator) {
+    fprintf(file, "\"%s\": {\"peak\": %d, \"overflows\": %d, \"vanilla\": %d}%s",
+            name, limit->peak, limit->overflows, limit->vanillalimit, separator);
+}
+
+static void BenchWriteJSON(const char* demoname, int gametics) {
+    FILE* file = M_fopen(benchfile, "w");
+    if (file == NULL) {
+        I_Error("BenchDump: Failed to open %s", benchfile);
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"demo\": ");
+    BenchWriteString(file, demoname);
+    fprintf(file, ",\n");
+    fprintf(file, "  \"gametics\": %d,\n", gametics);
+    fprintf(file, "  \"frames\": %d,\n", numframes);
+    fprintf(file, "  \"fps\": %.2f,\n", numframes / (BenchMS(frames.total) / 1000));
+    fprintf(file, "  \"frame\": ");
+    BenchWriteSeries(file, &frames);
+    fprintf(file, ",\n  \"phases\": {\n");
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        fprintf(file, "    \"%s\": ", phasenames[i]);
+        BenchWriteSeries(file, &phases[i]);
+        fprintf(file, "%s\n", i < NUMBENCHPHASES - 1 ? "," : "");
+    }
+    fprintf(file, "  },\n");
+
+    // Zone usage at the end of the demo.
+    fprintf(file, "  \"zone_bytes\": {");
+    const char* separator = "";
+    for (int tag = 0; tag < PU_NUM_TAGS; tag++) {
+        if (tagnames[tag] != NULL) {
+            fprintf(file, "%s\"%s\": %d", separator, tagnames[tag], Z_TagBytes(tag));
+            separator = ", ";
+        }
+    }
+    fprintf(file, "},\n");
+
+    // Thinkers run during the demo, by thinker function.
+    fprintf(file, "  \"thinker_calls\": {");
+    for (int i = 0; i < NUMTHINKERPOOLS; i++) {
+        fprintf(file, "%s\"%s\": %llu", i > 0 ? ", " : "", P_ThinkerName(i),
+                (unsigned long long) (P_ThinkerCalls(i) - thinkerstart[i]));
+    }
+    fprintf(file, "},\n");
+
+    uint64_t sighthits;
+    uint64_t sightmisses;
+    P_SightCacheStats(&sighthits, &sightmisses);
+    fprintf(file, "  \"sight_cache\": {\"hits\": %llu, \"misses\": %llu},\n",
+            (unsigned long long) (sighthits - sighthitstart),
+            (unsigned long long) (sightmisses - sightmissstart));
+
+    // Renderer pool usage, against the limits of the original executable.
+    renderlimits_t limits;
+    R_TotalLimits(&limits);
+    fprintf(file, "  \"render_limits\": {");
+    BenchWriteLimit(file, "visplanes", &limits.visplanes, ", ");
+    BenchWriteLimit(file, "openings", &limits.openings, ", ");
+    BenchWriteLimit(file, "drawsegs", &limits.drawsegs, ", ");
+    BenchWriteLimit(file, "vissprites", &limits.vissprites, "");
+    fprintf(file, "}\n}\n");
+
+    fclose(file);
+}
+
+void BenchDump(const char* demoname, int gametics) {
+    if (!benchmarking || numframes == 0) {
+        return;
+    }
+
+    uint32_t* sorted = I_Realloc(NULL, numframes * sizeof(*sorted));
+    BenchSummarize(&frames, sorted);
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        BenchSummarize(&phases[i], sorted);
+    }
+    free(sorted);
+
+    printf("\n%d frames, times in ms:\n", numframes);
+    printf("%-22s %9s %9s %9s %9s %11s\n", "", "min", "avg", "p99", "max", "total");
+    BenchPrintSeries("frame", &frames);
+    for (int i = 0; i < NUMBENCHPHASES; i++) {
+        BenchPrintSeries(phasenames[i], &phases[i]);
+    }
+
+    BenchWriteJSON(demoname, gametics);
+}
@@ -0,0 +1,55 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Per-phase frame timing for -timedemo, see -bench.
+//
+
+
+#ifndef __BENCH__
+#define __BENCH__
+
+
+typedef enum {
+    bench_ticker,
+    bench_rendersectors,
+    bench_drawplanes,
+    bench_drawmasked,
+    bench_drawqueue,
+    bench_hud,
+    bench_blit,
+    NUMBENCHPHASES
+} benchphase_t;
+
+// True when the phases are being timed.
+extern bool benchmarking;
+
+// Called by G_TimeDemo.
+void BenchInit(void);
+
+// Called when the demo starts playing. Drops everything timed so far,
+// which is only level loading.
+void BenchStart(void);
+
+void BenchBeginFrame(void);
+void BenchEndFrame(void);
+
+void BenchBeginPhase(benchphase_t phase);
+void BenchEndPhase(benchphase_t phase);
+
+// Called by G_CheckDemoStatus at the end of the demo.
+void BenchDump(const char* demoname, int gametics);
+
+
+#endif
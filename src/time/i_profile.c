@@ -0,0 +1,174 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Profiling zones. Zone begin and end events are buffered in memory
+//      and written out in the Chrome trace_event JSON format, which
+//      chrome://tracing, Perfetto and Tracy's import-chrome can all read.
+//
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+#include "i_profile.h"
+#include "i_system.h"
+#include "i_timer.h"
+
+
+// Events buffered before they are written to the file.
+#define MAXPROFILEEVENTS 65536
+
+typedef struct {
+    const char* name;
+    uint64_t time;
+    unsigned long thread;
+    bool begin;
+} profileevent_t;
+
+static FILE* profilefile = NULL;
+static bool firstevent;
+
+// Events are recorded into one buffer while a full one may be being
+// written out, with only the file locked.
+static profileevent_t* events;
+static profileevent_t* spareevents;
+static int numevents;
+
+// Zones can be entered from any thread.
+static SDL_SpinLock eventslock;
+
+// Held while writing to profilefile.
+static SDL_mutex* filelock;
+
+
+static void I_PrintProfileEvents(FILE* file, const profileevent_t* buffer,
+                                 int count) {
+    for (int i = 0; i < count; i++) {
+        const profileevent_t* event = &buffer[i];
+        fprintf(file,
+                "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,"
+                "\"pid\":1,\"tid\":%lu}",
+                firstevent ? "" : ",", event->name, event->begin ? 'B' : 'E',
+                (unsigned long long) event->time, event->thread);
+        firstevent = false;
+    }
+}
+
+static void I_WriteProfileEvents(const profileevent_t* buffer, int count) {
+    SDL_LockMutex(filelock);
+    // Dropped if the profile was stopped in the meantime.
+    if (profilefile != NULL) {
+        I_PrintProfileEvents(profilefile, buffer, count);
+    }
+    SDL_UnlockMutex(filelock);
+}
+
+static void I_AddProfileEvent(const char* name, bool begin) {
+    uint64_t time = I_GetTimeUS();
+    unsigned long thread = SDL_ThreadID();
+    profileevent_t* full = NULL;
+
+    SDL_AtomicLock(&eventslock);
+    if (profilefile != NULL) {
+        if (numevents == MAXPROFILEEVENTS) {
+            // Swap in the spare buffer, and write this one out once the
+            // lock is released.
+            full = events;
+            events = spareevents;
+            spareevents = NULL;
+            numevents = 0;
+        }
+        if (events == NULL) {
+            events = I_Realloc(NULL, MAXPROFILEEVENTS * sizeof(*events));
+        }
+        profileevent_t* event = &events[numevents];
+        numevents++;
+
+        event->name = name;
+        event->time = time;
+        event->thread = thread;
+        event->begin = begin;
+    }
+    SDL_AtomicUnlock(&eventslock);
+
+    if (full != NULL) {
+        I_WriteProfileEvents(full, MAXPROFILEEVENTS);
+
+        SDL_AtomicLock(&eventslock);
+        if (spareevents == NULL) {
+            spareevents = full;
+            full = NULL;
+        }
+        SDL_AtomicUnlock(&eventslock);
+        free(full);
+    }
+}
+
+void I_StartProfile(const char* filename) {
+    filelock = SDL_CreateMutex();
+    if (filelock == NULL) {
+        fprintf(stderr, "I_StartProfile: %s\n", SDL_GetError());
+        return;
+    }
+    profilefile = fopen(filename, "w");
+    if (profilefile == NULL) {
+        fprintf(stderr, "I_StartProfile: Failed to open %s\n", filename);
+        return;
+    }
+    fprintf(profilefile, "{\"traceEvents\":[");
+    firstevent = true;
+    numevents = 0;
+}
+
+void I_StopProfile(void) {
+    if (filelock == NULL) {
+        return;
+    }
+
+    // Full buffers still waiting for the file lock are dropped.
+    SDL_LockMutex(filelock);
+    SDL_AtomicLock(&eventslock);
+    FILE* file = profilefile;
+    profilefile = NULL;
+    profileevent_t* remaining = events;
+    int count = numevents;
+    events = NULL;
+    numevents = 0;
+    SDL_AtomicUnlock(&eventslock);
+
+    if (file != NULL) {
+        I_PrintProfileEvents(file, remaining, count);
+        fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(file);
+    }
+    SDL_UnlockMutex(filelock);
+
+    free(remaining);
+}
+
+void I_ProfileBegin(const char* name) {
+    if (profilefile == NULL) {
+        return;
+    }
+    I_AddProfileEvent(name, true);
+}
+
+void I_ProfileEnd(const char* name) {
+    if (profilefile == NULL) {
+        return;
+    }
+    I_AddProfileEvent(name, false);
+}
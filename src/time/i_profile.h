@@ -0,0 +1,46 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Profiling zones, written as a Chrome trace_event file.
+//      The zones are only compiled in with -DBROOM_PROFILE=ON.
+//
+
+
+#ifndef __I_PROFILE__
+#define __I_PROFILE__
+
+//
+// Every PROFILE_BEGIN must be matched by a PROFILE_END with the same name
+// on the same thread, including on early returns. Names must be string
+// literals, only the pointer is kept.
+//
+#ifdef BROOM_PROFILE
+#define PROFILE_BEGIN(name) I_ProfileBegin(name)
+#define PROFILE_END(name) I_ProfileEnd(name)
+#else
+#define PROFILE_BEGIN(name) ((void) 0)
+#define PROFILE_END(name) ((void) 0)
+#endif
+
+// Start writing zones to the given file. Called by D_DoomMain, see -profile.
+void I_StartProfile(const char* filename);
+
+// Write out the remaining zones and close the file.
+void I_StopProfile(void);
+
+void I_ProfileBegin(const char* name);
+void I_ProfileEnd(const char* name);
+
+#endif
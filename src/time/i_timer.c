@@ -47,6 +47,19 @@ int I_GetTimeMS() {
     return (int) I_NowMS();
 }
 
+uint64_t I_GetTimeUS() {
+    static uint64_t frequency = 0;
+    if (frequency == 0) {
+        frequency = SDL_GetPerformanceFrequency();
+    }
+    uint64_t counter = SDL_GetPerformanceCounter();
+
+    // Split the conversion, so that the multiplication can't overflow.
+    uint64_t seconds = counter / frequency;
+    uint64_t rest = counter % frequency;
+    return seconds * 1000000 + rest * 1000000 / frequency;
+}
+
 //
 // Sleep for a specified number of ms
 //
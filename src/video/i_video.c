@@ -35,6 +35,7 @@
 #include "doomtype.h"
 #include "i_input.h"
 #include "i_joystick.h"
+#include "i_profile.h"
 #include "i_system.h"
 #include "i_timer.h"
 #include "i_video.h"
@@ -171,6 +172,10 @@ bool screenvisible = true;
 // indicate FPS.
 static bool display_fps_dots;
 
+// If this is true, there is no window and the screen is only converted to
+// 32-bit color in memory, see -headless.
+bool headless;
+
 // If this is true, the screen is rendered but not blitted to the
 // video buffer.
 static bool noblit;
@@ -246,7 +251,7 @@ static void I_SetShowCursor(bool show) {
 
 void I_ShutdownGraphics(void)
 {
-    if (initialized)
+    if (initialized && !headless)
     {
         I_SetShowCursor(true);
 
@@ -409,7 +414,7 @@ static void I_GetEvent(void) {
 // I_StartTic
 //
 void I_StartTic(void) {
-    if (!initialized) {
+    if (!initialized || headless) {
         return;
     }
     I_GetEvent();
@@ -608,6 +613,9 @@ static void I_UpdateScreen() {
     // Blit from the paletted 8-bit screen buffer to the intermediate
     // 32-bit RGBA buffer that we can load into the texture.
     SDL_LowerBlit(screenbuffer, &blit_rect, argbbuffer, &blit_rect);
+    if (headless) {
+        return;
+    }
 
     // Update the intermediate texture with the contents of the RGBA buffer.
     SDL_UpdateTexture(texture, NULL, argbbuffer->pixels, argbbuffer->pitch);
@@ -633,7 +641,7 @@ static void I_UpdatePalette() {
     SDL_SetPaletteColors(sdl_palette, palette, 0, 256);
     palette_to_set = false;
 
-    if (vga_porch_flash) {
+    if (vga_porch_flash && !headless) {
         // "flash" the pillars/letterboxes with palette changes, emulating
         // VGA "porch" behaviour (GitHub issue #832)
         Uint8 r = palette[0].r;
@@ -709,10 +717,13 @@ void I_FinishUpdate() {
     if (!I_CanUpdateScreen()) {
         return;
     }
+    PROFILE_BEGIN("I_FinishUpdate");
     if (need_resize) {
         I_ResizeWindow();
     }
-    I_UpdateCursorGrab();
+    if (!headless) {
+        I_UpdateCursorGrab();
+    }
     if (display_fps_dots) {
         I_DrawFpsDots();
     }
@@ -724,6 +735,7 @@ void I_FinishUpdate() {
     I_UpdateScreen();
     // Restore background and undo the disk indicator, if it was drawn.
     V_RestoreDiskBackground();
+    PROFILE_END("I_FinishUpdate");
 }
 
 
@@ -845,6 +857,15 @@ void I_GraphicsCheckCommandLine(void)
 
     noblit = M_CheckParm ("-noblit");
 
+    //!
+    // @category video
+    //
+    // Don't open a window. The screen is drawn and converted to 32-bit
+    // color as usual, but only in memory. Used by broom-bench.
+    //
+
+    headless = M_ParmExists("-headless");
+
     //!
     // @category video 
     //
@@ -1328,7 +1349,17 @@ static void I_EmbedIntoXScreenSaverWindow(char *env) {
     putenv(winenv);
 }
 
-void I_InitGraphics(void) {
+//
+// Create only the screen buffers, for -headless.
+//
+static void I_InitHeadless(void) {
+    pixel_format = SDL_PIXELFORMAT_ARGB8888;
+    I_Create8BitSurface();
+    I_Create32BitSurface();
+    I_SetDoomPalette();
+}
+
+static void I_InitWindow(void) {
     SDL_Event dummy;
 
     char *env = getenv("XSCREENSAVER_WINDOW");
@@ -1376,6 +1407,17 @@ void I_InitGraphics(void) {
         SDL_Delay(startup_delay);
     }
 
+    // clear out any events waiting at the start and center the mouse
+    while (SDL_PollEvent(&dummy));
+}
+
+void I_InitGraphics(void) {
+    if (headless) {
+        I_InitHeadless();
+    } else {
+        I_InitWindow();
+    }
+
     // The actual 320x200 canvas that we draw to. This is the pixel buffer of
     // the 8-bit paletted screen buffer that gets blit on an intermediate
     // 32-bit RGBA screen buffer that gets loaded into a texture that gets
@@ -1386,9 +1428,6 @@ void I_InitGraphics(void) {
     // Clear the screen to black.
     memset(I_VideoBuffer, 0, SCREENWIDTH * SCREENHEIGHT * sizeof(*I_VideoBuffer));
 
-    // clear out any events waiting at the start and center the mouse
-    while (SDL_PollEvent(&dummy));
-
     initialized = true;
 
     // Call I_ShutdownGraphics on quit
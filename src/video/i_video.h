@@ -72,6 +72,7 @@ extern bool screenvisible;
 
 extern int vanilla_keyboard_mapping;
 extern bool screensaver_mode;
+extern bool headless;
 extern int usegamma;
 extern pixel_t *I_VideoBuffer;
 
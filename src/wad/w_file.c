@@ -45,11 +45,11 @@ wad_file_t *W_OpenFile(const char *path)
     //!
     // @category obscure
     //
-    // Use the OS's virtual memory subsystem to map WAD files
-    // directly into memory.
+    // Do not map WAD files into memory; read each lump into the
+    // zone when it is first used instead.
     //
 
-    if (!M_CheckParm("-mmap"))
+    if (M_CheckParm("-nommap"))
     {
         return stdc_wad_file.OpenFile(path);
     }
@@ -82,3 +82,11 @@ size_t W_Read(wad_file_t *wad, unsigned int offset,
     return wad->file_class->Read(wad, offset, buffer, buffer_len);
 }
 
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len)
+{
+    if (wad->mapped != NULL && wad->file_class->Prefetch != NULL)
+    {
+        wad->file_class->Prefetch(wad, offset, len);
+    }
+}
+
@@ -37,6 +37,11 @@ typedef struct
     // provided buffer.  Returns the number of bytes read.
     size_t (*Read)(wad_file_t *file, unsigned int offset,
                    void *buffer, size_t buffer_len);
+
+    // Hint that the specified range of a mapped file will be read
+    // soon.  May be NULL.
+    void (*Prefetch)(wad_file_t *file, unsigned int offset,
+                     size_t len);
 } wad_file_class_t;
 
 
@@ -83,4 +88,9 @@ void W_CloseFile(wad_file_t *wad);
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len);
 
+// Start reading the specified range of a mapped file into memory in
+// the background.  Does nothing if the file is not mapped.
+
+void W_Prefetch(wad_file_t *wad, unsigned int offset, size_t len);
+
 #endif /* #ifndef __W_FILE__ */
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "m_misc.h"
@@ -43,16 +44,13 @@ static void MapFile(posix_wad_file_t *wad, const char *filename)
     int protection;
     int flags;
 
-    // Mapped area can be read and written to.  Ideally
-    // this should be read-only, as none of the Doom code should 
-    // change the WAD files after being read.  However, there may
-    // be code lurking in the source that does.
-
-    protection = PROT_READ|PROT_WRITE;
-
-    // Writes to the mapped area result in private changes that are
-    // *not* written to disk.
+    // Mapped area is read-only.  Nothing writes to lumps returned
+    // by W_CacheLumpNum: lumps that need changing, like BLOCKMAP or
+    // a short REJECT, are copied with W_ReadLump first.  The pages
+    // are clean, so the OS can drop them under memory pressure
+    // instead of swapping them out.
 
+    protection = PROT_READ;
     flags = MAP_PRIVATE;
 
     result = mmap(NULL, wad->wad.length,
@@ -163,12 +161,40 @@ size_t W_POSIX_Read(wad_file_t *wad, unsigned int offset,
     return bytes_read;
 }
 
+// Ask the OS to start reading in the pages holding the specified
+// range of the mapped file.
+
+static void W_POSIX_Prefetch(wad_file_t *wad, unsigned int offset,
+                             size_t len)
+{
+    static uintptr_t page_mask = 0;
+    uintptr_t start, end;
+
+    if (len == 0)
+    {
+        return;
+    }
+
+    if (page_mask == 0)
+    {
+        page_mask = (uintptr_t) sysconf(_SC_PAGESIZE) - 1;
+    }
+
+    // madvise() needs a page aligned address.
+
+    start = (uintptr_t) (wad->mapped + offset) & ~page_mask;
+    end = (uintptr_t) (wad->mapped + offset + len);
+
+    madvise((void *) start, end - start, MADV_WILLNEED);
+}
+
 
 wad_file_class_t posix_wad_file = 
 {
     W_POSIX_OpenFile,
     W_POSIX_CloseFile,
     W_POSIX_Read,
+    W_POSIX_Prefetch,
 };
 
 
@@ -597,6 +597,10 @@ void W_MergeFile(const char *filename)
     // Perform the merge
 
     DoMerge();
+
+    // Lumps have moved
+
+    W_GenerateHashTable();
 }
 
 // Replace lumps in the given list with lumps from the PWAD
@@ -664,6 +668,7 @@ void W_NWTMergeFile(const char *filename, int flags)
     // Discard the PWAD
 
     numlumps = old_numlumps;
+    W_GenerateHashTable();
 }
 
 // Simulates the NWT -merge command line parameter.  What this does is load
@@ -716,6 +721,7 @@ void W_NWTDashMerge(const char *filename)
     // The PWAD must now be added in again with -file.
 
     numlumps = old_numlumps;
+    W_GenerateHashTable();
 
     W_CloseFile(wad_file);
 }
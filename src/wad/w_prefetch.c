@@ -0,0 +1,279 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Reading many lumps at once with several I/O threads.
+//
+//	The lumps are sorted by file and offset, and lumps lying close
+//	together are merged into runs that are read with a single request.
+//	Each I/O thread takes a contiguous share of the runs, so it reads
+//	its part of the file front to back with its own file handle. The
+//	zone is not thread safe: the threads read into malloc'd buffers,
+//	and the main thread copies the lumps into the lump cache afterwards.
+//
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_parallel.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "v_diskicon.h"
+#include "z_zone.h"
+
+#include "w_prefetch.h"
+
+
+#define DEFAULT_IOTHREADS 4
+
+// Lumps closer together than this are read as one run, gap included.
+#define RUN_GAP (64 * 1024)
+
+// Longest run, so the work still splits up between threads.
+#define MAX_RUN_LENGTH (4 * 1024 * 1024)
+
+
+typedef struct {
+    wad_file_t* wad;
+    unsigned int offset;
+    size_t length;
+
+    // Lumps in the run, in the sorted list.
+    int firstlump;
+    int numlumps;
+
+    // Read buffer, NULL if the file is memory-mapped.
+    byte* buffer;
+    size_t bytes_read;
+} prefetchrun_t;
+
+typedef struct {
+    prefetchrun_t* runs;
+    int numruns;
+    int numthreads;
+} prefetch_t;
+
+
+static int numiothreads;
+
+
+static int W_CompareLumpPositions(const void* a, const void* b) {
+    lumpindex_t x = *(const lumpindex_t*) a;
+    lumpindex_t y = *(const lumpindex_t*) b;
+    const lumpinfo_t* lx = lumpinfo[x];
+    const lumpinfo_t* ly = lumpinfo[y];
+
+    if (lx->wad_file != ly->wad_file) {
+        return (lx->wad_file > ly->wad_file) - (lx->wad_file < ly->wad_file);
+    }
+    if (lx->position != ly->position) {
+        return (lx->position > ly->position) - (lx->position < ly->position);
+    }
+    return (x > y) - (x < y);
+}
+
+static void W_InitIOThreads() {
+    //!
+    // @category obscure
+    // @arg <n>
+    //
+    // Read the lumps preloaded for a level with n threads. Default is 4.
+    //
+    int p = M_CheckParmWithArgs("-iothreads", 1);
+    if (p == 0) {
+        numiothreads = DEFAULT_IOTHREADS;
+        return;
+    }
+    if (!M_StrToInt(myargv[p + 1], &numiothreads) || numiothreads < 1) {
+        I_Error("W_InitIOThreads: Invalid thread count '%s'", myargv[p + 1]);
+    }
+}
+
+//
+// Sort the lumps and drop duplicates, lumps that are empty and lumps
+// that are already in the zone. Returns the new count.
+//
+static int W_SortPrefetchLumps(lumpindex_t* sorted, const lumpindex_t* lumps,
+                               int count)
+{
+    int numsorted = 0;
+    for (int i = 0; i < count; i++) {
+        if ((unsigned) lumps[i] >= numlumps) {
+            I_Error("W_PrefetchLumps: %i >= numlumps", lumps[i]);
+        }
+        const lumpinfo_t* lump = lumpinfo[lumps[i]];
+        if (lump->size > 0 && lump->cache == NULL) {
+            sorted[numsorted++] = lumps[i];
+        }
+    }
+
+    qsort(sorted, numsorted, sizeof(*sorted), W_CompareLumpPositions);
+
+    int numunique = 0;
+    for (int i = 0; i < numsorted; i++) {
+        if (numunique == 0 || sorted[numunique - 1] != sorted[i]) {
+            sorted[numunique++] = sorted[i];
+        }
+    }
+    return numunique;
+}
+
+//
+// Merge sorted lumps into runs. Returns the number of runs.
+//
+static int W_BuildRuns(prefetchrun_t* runs, const lumpindex_t* sorted, int count) {
+    int numruns = 0;
+    prefetchrun_t* run = NULL;
+
+    for (int i = 0; i < count; i++) {
+        const lumpinfo_t* lump = lumpinfo[sorted[i]];
+        unsigned int start = lump->position;
+        unsigned int end = start + lump->size;
+
+        if (run != NULL && run->wad == lump->wad_file
+            && start <= run->offset + run->length + RUN_GAP
+            && end - run->offset <= MAX_RUN_LENGTH)
+        {
+            if (end > run->offset + run->length) {
+                run->length = end - run->offset;
+            }
+            run->numlumps++;
+            continue;
+        }
+
+        run = &runs[numruns++];
+        run->wad = lump->wad_file;
+        run->offset = start;
+        run->length = lump->size;
+        run->firstlump = i;
+        run->numlumps = 1;
+        run->buffer = NULL;
+        run->bytes_read = 0;
+    }
+
+    return numruns;
+}
+
+//
+// Touch every page of a mapped run, so the page faults happen here and
+// not while drawing.
+//
+static void W_PageInRun(prefetchrun_t* run) {
+    W_Prefetch(run->wad, run->offset, run->length);
+
+    const volatile byte* data = run->wad->mapped + run->offset;
+    for (size_t i = 0; i < run->length; i += 4096) {
+        (void) data[i];
+    }
+    (void) data[run->length - 1];
+    run->bytes_read = run->length;
+}
+
+static void W_ReadRun(prefetchrun_t* run, FILE* file) {
+    if (fseek(file, run->offset, SEEK_SET) != 0) {
+        return;
+    }
+    run->bytes_read = fread(run->buffer, 1, run->length, file);
+}
+
+static void W_PrefetchWorker(void* data, int index) {
+    prefetch_t* prefetch = data;
+    int first = prefetch->numruns * index / prefetch->numthreads;
+    int last = prefetch->numruns * (index + 1) / prefetch->numthreads;
+
+    wad_file_t* openwad = NULL;
+    FILE* file = NULL;
+
+    for (int i = first; i < last; i++) {
+        prefetchrun_t* run = &prefetch->runs[i];
+        if (run->buffer == NULL) {
+            W_PageInRun(run);
+            continue;
+        }
+        if (run->wad != openwad) {
+            if (file != NULL) {
+                fclose(file);
+            }
+            openwad = run->wad;
+            file = M_fopen(openwad->path, "rb");
+        }
+        if (file != NULL) {
+            W_ReadRun(run, file);
+        }
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+//
+// Copy the lumps of a run that was read into the lump cache.
+//
+static void W_InstallRun(const prefetchrun_t* run, const lumpindex_t* sorted) {
+    for (int i = 0; i < run->numlumps; i++) {
+        lumpinfo_t* lump = lumpinfo[sorted[run->firstlump + i]];
+        size_t start = lump->position - run->offset;
+        if (lump->cache != NULL || start + lump->size > run->bytes_read) {
+            // A short read; W_CacheLumpNum will try again and report it.
+            continue;
+        }
+        lump->cache = Z_Malloc(lump->size, PU_CACHE, &lump->cache);
+        memcpy(lump->cache, run->buffer + start, lump->size);
+    }
+}
+
+void W_PrefetchLumps(const lumpindex_t* lumps, int count) {
+    if (numiothreads == 0) {
+        W_InitIOThreads();
+    }
+
+    lumpindex_t* sorted = I_Realloc(NULL, count * sizeof(*sorted));
+    count = W_SortPrefetchLumps(sorted, lumps, count);
+
+    prefetchrun_t* runs = I_Realloc(NULL, count * sizeof(*runs));
+    int numruns = W_BuildRuns(runs, sorted, count);
+
+    size_t totalbytes = 0;
+    for (int i = 0; i < numruns; i++) {
+        prefetchrun_t* run = &runs[i];
+        if (run->wad->mapped == NULL) {
+            run->buffer = I_Realloc(NULL, run->length);
+            totalbytes += run->length;
+        }
+    }
+    if (totalbytes > 0) {
+        V_BeginRead(totalbytes);
+    }
+
+    prefetch_t prefetch = {
+        .runs = runs,
+        .numruns = numruns,
+        .numthreads = numiothreads < numruns ? numiothreads : numruns,
+    };
+    I_ParallelFor(prefetch.numthreads, prefetch.numthreads, W_PrefetchWorker,
+                  &prefetch);
+
+    for (int i = 0; i < numruns; i++) {
+        if (runs[i].buffer != NULL) {
+            W_InstallRun(&runs[i], sorted);
+            free(runs[i].buffer);
+        }
+    }
+
+    free(runs);
+    free(sorted);
+}
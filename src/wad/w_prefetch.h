@@ -0,0 +1,32 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Reading many lumps at once with several I/O threads.
+//
+
+
+#ifndef __W_PREFETCH__
+#define __W_PREFETCH__
+
+#include "w_wad.h"
+
+
+// Gets every lump in the list ready for W_CacheLumpNum: lumps in
+// memory-mapped files are paged in, others are read into the lump
+// cache as PU_CACHE. The list may have duplicates and be in any order.
+void W_PrefetchLumps(const lumpindex_t* lumps, int count);
+
+
+#endif
@@ -20,12 +20,14 @@
 
 
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "doomtype.h"
 
+#include "i_profile.h"
 #include "i_swap.h"
 #include "i_system.h"
 #include "m_misc.h"
@@ -56,8 +58,18 @@ typedef PACKED_STRUCT({
 lumpinfo_t **lumpinfo;
 unsigned int numlumps = 0;
 
-// Hash table for fast lookups
-static lumpindex_t *lumphash;
+// Open addressing hash table for fast lookups, keyed by the lump name
+// uppercased and packed into 8 bytes. Empty slots have lump -1.
+typedef struct {
+    uint64_t key;
+    lumpindex_t lump;
+} lumphashentry_t;
+
+static lumphashentry_t *lumphash;
+static unsigned int lumphashsize;
+
+// Lumps in the table, which are always lumps [0, numhashedlumps).
+static unsigned int numhashedlumps;
 
 // Variables for the reload hack: filename of the PWAD to reload, and the
 // lumps from WADs before the reload file, so we can resent numlumps and
@@ -78,12 +90,75 @@ unsigned int W_LumpNameHash(const char *s)
 
     for (i=0; i < 8 && s[i] != '\0'; ++i)
     {
-        result = ((result << 5) ^ result ) ^ toupper(s[i]);
+        result = ((result << 5) ^ result ) ^ toupper((unsigned char) s[i]);
     }
 
     return result;
 }
 
+// Lump names are at most 8 characters, padded with NULs, so an
+// uppercased name fits in a 64-bit key and compares in one go.
+static uint64_t W_LumpNameKey(const char *name)
+{
+    char packed[8] = {0};
+    uint64_t key;
+    int i;
+
+    for (i = 0; i < 8 && name[i] != '\0'; ++i)
+    {
+        packed[i] = toupper((unsigned char) name[i]);
+    }
+
+    memcpy(&key, packed, sizeof(key));
+    return key;
+}
+
+static unsigned int W_LumpKeySlot(uint64_t key)
+{
+    // Fibonacci hashing; lumphashsize is a power of two.
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ull) >> 32)
+         & (lumphashsize - 1);
+}
+
+// Later lumps replace earlier ones with the same name, so the last
+// lump with a name wins, as with the reverse search of vanilla Doom.
+static void W_HashLump(lumpindex_t lump)
+{
+    uint64_t key = W_LumpNameKey(lumpinfo[lump]->name);
+    unsigned int slot = W_LumpKeySlot(key);
+
+    while (lumphash[slot].lump != -1 && lumphash[slot].key != key)
+    {
+        slot = (slot + 1) & (lumphashsize - 1);
+    }
+
+    lumphash[slot].key = key;
+    lumphash[slot].lump = lump;
+}
+
+// Add lumps appended by W_AddFile to an existing table.
+static void W_HashNewLumps(void)
+{
+    if (lumphash == NULL)
+    {
+        // Built on the first lookup.
+        return;
+    }
+
+    // Keep the table at most half full, and start again if lumps
+    // were dropped since it was built.
+    if (numlumps * 2 > lumphashsize || numhashedlumps > numlumps)
+    {
+        W_GenerateHashTable();
+        return;
+    }
+
+    for (; numhashedlumps < numlumps; ++numhashedlumps)
+    {
+        W_HashLump(numhashedlumps);
+    }
+}
+
 //
 // LUMP BASED ROUTINES.
 //
@@ -197,10 +272,8 @@ static void W_AddWadFileLumps(const char* filename, wad_file_t* wad_file) {
         ++filerover;
     }
 
-    if (lumphash != NULL) {
-        Z_Free(lumphash);
-        lumphash = NULL;
-    }
+    W_HashNewLumps();
+
     // If this is the reload file, we need to save some details about the
     // file so that we can close it later on when we do a reload.
     if (reloadname) {
@@ -251,45 +324,26 @@ wad_file_t* W_AddFile(const char* filename) {
 }
 
 //
-// Scan backwards so patch lump files take precedence.
+// W_CheckNumForName
+// Returns -1 if name not found.
 //
-static lumpindex_t W_SearchLumpArray(const char* name) {
-    for (lumpindex_t i = numlumps - 1; i >= 0; --i) {
-        if (!strncasecmp(lumpinfo[i]->name, name, 8)) {
-            return i;
-        }
+lumpindex_t W_CheckNumForName(const char* name) {
+    if (lumphash == NULL) {
+        W_GenerateHashTable();
     }
-    return -1;
-}
 
-static lumpindex_t W_SearchLumpHash(const char* name) {
-    int hash = W_LumpNameHash(name) % numlumps;
-    lumpindex_t i = lumphash[hash];
-    while (i != -1) {
-        if (!strncasecmp(lumpinfo[i]->name, name, 8)) {
-            return i;
+    uint64_t key = W_LumpNameKey(name);
+    unsigned int slot = W_LumpKeySlot(key);
+    while (lumphash[slot].lump != -1) {
+        if (lumphash[slot].key == key) {
+            return lumphash[slot].lump;
         }
-        i = lumpinfo[i]->next;
+        slot = (slot + 1) & (lumphashsize - 1);
     }
     return -1;
 }
 
 
-//
-// W_CheckNumForName
-// Returns -1 if name not found.
-//
-lumpindex_t W_CheckNumForName(const char* name) {
-    // Do we have a hash table yet?
-    if (lumphash != NULL) {
-        // We do! Excellent.
-        return W_SearchLumpHash(name);
-    }
-    // We don't have a hash table generate yet. Linear search :-(
-    return W_SearchLumpArray(name);
-}
-
-
 
 
 //
@@ -375,12 +429,35 @@ void* W_CacheLumpNum(lumpindex_t lumpnum, int tag) {
         return lump->cache;
     }
     // Not yet loaded, so load it now
+    PROFILE_BEGIN("W_CacheLumpNum");
     lump->cache = Z_Malloc(W_LumpLength(lumpnum), tag, &lump->cache);
     W_ReadLump(lumpnum, lump->cache);
+    PROFILE_END("W_CacheLumpNum");
     return lump->cache;
 }
 
 
+//
+// W_PrefetchLumpNum
+//
+// Get a lump ready to be used soon. If it is in a memory-mapped file,
+// the OS is asked to read it in the background; otherwise it is loaded
+// into the zone as PU_CACHE.
+//
+void W_PrefetchLumpNum(lumpindex_t lumpnum) {
+    if ((unsigned) lumpnum >= numlumps) {
+        I_Error("W_PrefetchLumpNum: %i >= numlumps", lumpnum);
+    }
+
+    const lumpinfo_t* lump = lumpinfo[lumpnum];
+    if (lump->wad_file->mapped != NULL) {
+        W_Prefetch(lump->wad_file, lump->position, lump->size);
+        return;
+    }
+    W_CacheLumpNum(lumpnum, PU_CACHE);
+}
+
+
 //
 // W_CacheLumpName
 //
@@ -416,38 +493,35 @@ void W_ReleaseLumpName(const char* name) {
 
 void W_GenerateHashTable(void)
 {
-    lumpindex_t i;
+    unsigned int size;
+    unsigned int i;
 
-    // Free the old hash table, if there is one:
-    if (lumphash != NULL)
+    // Room for the lumps of a few more files before it has to grow.
+    size = 64;
+    while (size < numlumps * 4)
     {
-        Z_Free(lumphash);
+        size *= 2;
     }
 
-    // Generate hash table
-    if (numlumps > 0)
+    if (size != lumphashsize)
     {
-        lumphash = Z_Malloc(sizeof(lumpindex_t) * numlumps, PU_STATIC, NULL);
-
-        for (i = 0; i < numlumps; ++i)
+        if (lumphash != NULL)
         {
-            lumphash[i] = -1;
+            Z_Free(lumphash);
         }
+        lumphash = Z_Malloc(sizeof(*lumphash) * size, PU_STATIC, NULL);
+        lumphashsize = size;
+    }
 
-        for (i = 0; i < numlumps; ++i)
-        {
-            unsigned int hash;
-
-            hash = W_LumpNameHash(lumpinfo[i]->name) % numlumps;
-
-            // Hook into the hash table
-
-            lumpinfo[i]->next = lumphash[hash];
-            lumphash[hash] = i;
-        }
+    for (i = 0; i < lumphashsize; ++i)
+    {
+        lumphash[i].lump = -1;
     }
 
-    // All done!
+    for (numhashedlumps = 0; numhashedlumps < numlumps; ++numhashedlumps)
+    {
+        W_HashLump(numhashedlumps);
+    }
 }
 
 // The Doom reload hack. The idea here is that if you give a WAD file to -file
@@ -502,3 +576,7 @@ const char* W_WadNameForLump(const lumpinfo_t* lump) {
 bool W_IsIWADLump(const lumpinfo_t* lump) {
     return lump->wad_file == lumpinfo[0]->wad_file;
 }
+
+bool W_IsReloadLump(lumpindex_t lump) {
+    return reloadlump >= 0 && lump >= reloadlump;
+}
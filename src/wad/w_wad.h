@@ -44,9 +44,6 @@ struct lumpinfo_s
     int position;
     int size;
     void *cache;
-
-    // Used for hash table lookups
-    lumpindex_t next;
 };
 
 
@@ -64,7 +61,11 @@ void W_ReadLump(lumpindex_t lump, void *dest);
 
 void *W_CacheLumpNum(lumpindex_t lump, int tag);
 void *W_CacheLumpName(const char *name, int tag);
+void W_PrefetchLumpNum(lumpindex_t lump);
 
+// Rebuild the lump name lookup table. Lumps added with W_AddFile are
+// added to it as they come; anything that reorders, renames or removes
+// lumps must call this afterwards.
 void W_GenerateHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
@@ -75,4 +76,7 @@ void W_ReleaseLumpName(const char *name);
 const char *W_WadNameForLump(const lumpinfo_t *lump);
 bool W_IsIWADLump(const lumpinfo_t *lump);
 
+// True if the lump is in the '~' WAD, whose lumps W_Reload frees.
+bool W_IsReloadLump(lumpindex_t lump);
+
 #endif